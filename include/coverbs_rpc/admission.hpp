@@ -0,0 +1,97 @@
+#pragma once
+
+#include "coverbs_rpc/common.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+
+namespace coverbs_rpc {
+
+/**
+ * @brief Decides, as each request arrives, whether the server takes it on or sheds it with an
+ * overloaded reply, so that latency stays bounded under a traffic spike instead of the handler
+ * queues growing without limit.
+ *
+ * A request counts against the limits from its arrival until its reply is handed off. One
+ * instance is shared by every connection of a server, so the limits apply server-wide. Without
+ * any limit configured, admit() only checks a flag.
+ */
+class admission_control {
+  struct fn_state {
+    uint32_t limit;
+    std::atomic<uint32_t> in_flight{0};
+  };
+
+public:
+  /**
+   * @brief Holds an admitted request's place; releasing it (by destruction) frees the place and,
+   * with the adaptive limit on, reports the request's latency.
+   */
+  class ticket {
+  public:
+    ticket() = default;
+    ticket(ticket &&other) noexcept;
+    auto operator=(ticket &&other) noexcept -> ticket &;
+    ~ticket();
+
+    // The handler is about to run, so the request no longer counts as queued.
+    auto start() noexcept -> void;
+
+  private:
+    friend class admission_control;
+    ticket(admission_control *owner, fn_state *fn, std::chrono::steady_clock::time_point arrived)
+        : owner_(owner)
+        , fn_(fn)
+        , arrived_(arrived) {}
+
+    auto release() noexcept -> void;
+
+    admission_control *owner_ = nullptr;
+    fn_state *fn_ = nullptr;
+    std::chrono::steady_clock::time_point arrived_{};
+    bool queued_ = true;
+  };
+
+  explicit admission_control(AdmissionConfig config);
+
+  /**
+   * @brief Cap the requests for one function in flight at once; 0 lifts the cap. Call before
+   * the server starts serving.
+   */
+  auto set_limit(uint32_t fn_id, uint32_t max_concurrency) -> void;
+
+  /**
+   * @brief Admit a request for `fn_id` that arrived at `arrived`, or return nothing if it is to
+   * be shed.
+   */
+  auto admit(uint32_t fn_id, std::chrono::steady_clock::time_point arrived)
+      -> std::optional<ticket>;
+
+  // The server-wide concurrency limit currently in force; 0 when there is none.
+  auto limit() const noexcept -> uint32_t { return limit_.load(std::memory_order_relaxed); }
+
+  // Requests shed so far.
+  auto shed() const noexcept -> uint64_t { return shed_.load(std::memory_order_relaxed); }
+
+private:
+  auto reject() noexcept -> std::optional<ticket>;
+  auto on_latency(std::chrono::nanoseconds latency) noexcept -> void;
+
+  AdmissionConfig const config_;
+  bool active_;
+  uint32_t const ceiling_;
+  std::unordered_map<uint32_t, std::unique_ptr<fn_state>> fns_;
+
+  alignas(64) std::atomic<uint32_t> in_flight_{0};
+  std::atomic<uint32_t> queued_{0};
+  alignas(64) std::atomic<uint32_t> limit_;
+  std::atomic<uint32_t> successes_{0};
+  std::atomic<int64_t> last_decrease_{0};
+  std::atomic<uint64_t> shed_{0};
+};
+
+} // namespace coverbs_rpc
@@ -1,23 +1,140 @@
 #pragma once
 
 #include "coverbs_rpc/common.hpp"
+#include "coverbs_rpc/registered_memory.hpp"
 
+#include <cppcoro/async_generator.hpp>
 #include <cppcoro/task.hpp>
 #include <memory>
 #include <rdmapp/qp.h>
 #include <span>
+#include <vector>
 
 namespace coverbs_rpc {
 
+/**
+ * @brief Where a call's continuation runs once its response has arrived.
+ *
+ * The default resumes inline on the client's completion thread, which is the cheapest option
+ * for trivial continuations but stalls every other in-flight response while it runs. Build one
+ * with resume_on() to hop onto the caller's scheduler instead.
+ */
+struct resume_target {
+  void *scheduler = nullptr;
+  auto (*hop)(void *scheduler) -> cppcoro::task<void> = nullptr;
+
+  auto is_inline() const noexcept -> bool { return hop == nullptr; }
+};
+
+namespace detail {
+template <typename Scheduler>
+auto hop_to(void *scheduler) -> cppcoro::task<void> {
+  co_await static_cast<Scheduler *>(scheduler)->schedule();
+}
+} // namespace detail
+
+/**
+ * @brief Resume calls on `scheduler` (anything with a cppcoro-style schedule(), e.g. a
+ * static_thread_pool or io_service), which must outlive the calls using it.
+ */
+template <typename Scheduler>
+auto resume_on(Scheduler &scheduler) noexcept -> resume_target {
+  return {.scheduler = &scheduler, .hop = &detail::hop_to<Scheduler>};
+}
+
+/**
+ * @brief Registered application memory a bulk call exposes to the server, which reads from or
+ * writes into it directly with one-sided RDMA instead of copying it through message slots.
+ */
+struct bulk_region {
+  rdmapp::local_mr const *mr = nullptr;
+  std::size_t offset = 0;
+  // Zero exposes everything from `offset` to the end of `mr`.
+  std::size_t length = 0;
+  bulk_access access = bulk_access::read;
+};
+
+struct bulk_result {
+  std::size_t resp_len;
+  // Bytes the server wrote into the bulk region.
+  std::size_t bulk_len;
+};
+
+namespace detail {
+struct BulkDesc;
+} // namespace detail
+
 class basic_client {
 public:
-  basic_client(std::shared_ptr<rdmapp::qp> qp, RpcConfig config = {});
+  /**
+   * @param arena Registered memory to carve this client's buffers from; when null, a private
+   * arena is created from config.memory.
+   */
+  basic_client(std::shared_ptr<rdmapp::qp> qp, RpcConfig config = {},
+               std::shared_ptr<registered_arena> arena = nullptr);
   ~basic_client();
 
-  auto call(uint32_t fn_id, std::span<const std::byte> req_data, std::span<std::byte> resp_buffer)
+  /**
+   * @brief Issue an RPC and wait for its response.
+   *
+   * Requests larger than max_req_payload are pulled by the server with RDMA READ instead of
+   * being copied into a send slot. Responses larger than `resp_buffer` are truncated. Throws
+   * deadline_exceeded if the server dropped the request for outliving config.deadline, and
+   * server_overloaded if it shed it at its admission limits.
+   *
+   * @param resume Where the caller continues once the response is in; inline by default.
+   */
+  auto call(rpc_method method, std::span<const std::byte> req_data,
+            std::span<std::byte> resp_buffer, resume_target resume = {})
+      -> cppcoro::task<std::size_t>;
+
+  /**
+   * @brief Like the span overload, but grows `resp_buffer` to fit a response larger than
+   * max_resp_payload.
+   */
+  auto call(rpc_method method, std::span<const std::byte> req_data,
+            std::vector<std::byte> &resp_buffer, resume_target resume = {})
       -> cppcoro::task<std::size_t>;
 
+  /**
+   * @brief Send a request the server executes without replying.
+   *
+   * Completes once the send has completed locally. The request holds one of the max_inflight
+   * slots, shared with calls, until the server credits it back after reposting the receive it
+   * used, so one-ways and calls together never outrun the server's receives. The request
+   * must fit in max_req_payload, since without a reply there is no point at which a
+   * rendezvous buffer could be released.
+   */
+  auto call_oneway(rpc_method method, std::span<const std::byte> req_data,
+                   resume_target resume = {}) -> cppcoro::task<void>;
+
+  /**
+   * @brief Like call(), but also hands the server `bulk`, which it accesses in place: it is read
+   * before the handler runs and written before the response is sent. Keep the region alive and
+   * untouched until the call completes. The request must fit in max_req_payload together with
+   * the bulk descriptor.
+   */
+  auto call_bulk(uint32_t fn_id, std::span<const std::byte> req_data,
+                 std::span<std::byte> resp_buffer, bulk_region bulk, resume_target resume = {})
+      -> cppcoro::task<bulk_result>;
+
+  /**
+   * @brief Open a server stream and yield its items as they arrive.
+   *
+   * The server runs at most config.stream_window items ahead of the consumer; credit is
+   * returned as items are consumed. Each yielded span is valid until the generator is resumed.
+   * Destroying the generator early cancels the stream. Throws if the server aborts it. The
+   * request must fit in max_req_payload.
+   */
+  auto call_stream(uint32_t fn_id, std::span<const std::byte> req_data)
+      -> cppcoro::async_generator<std::span<const std::byte>>;
+
 private:
+  auto call_impl(rpc_method method, std::span<const std::byte> req_data,
+                 std::span<std::byte> resp_buffer, std::vector<std::byte> *growable,
+                 resume_target resume, detail::BulkDesc const *bulk = nullptr,
+                 std::size_t *bulk_len = nullptr) -> cppcoro::task<std::size_t>;
+
   struct Impl;
   std::unique_ptr<Impl> impl_;
 };
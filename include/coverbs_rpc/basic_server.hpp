@@ -1,39 +1,107 @@
 #pragma once
 
+#include "coverbs_rpc/admission.hpp"
 #include "coverbs_rpc/common.hpp"
+#include "coverbs_rpc/detail/buffer_pool.hpp"
+#include "coverbs_rpc/detail/rendezvous.hpp"
+#include "coverbs_rpc/priority_scheduler.hpp"
+#include "coverbs_rpc/registered_memory.hpp"
 #include "coverbs_rpc/server_mux.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <cppcoro/async_scope.hpp>
 #include <cppcoro/static_thread_pool.hpp>
 #include <cppcoro/task.hpp>
 #include <cstdint>
 #include <memory>
+#include <mutex>
 #include <rdmapp/mr.h>
 #include <rdmapp/qp.h>
+#include <unordered_map>
 #include <vector>
 
 namespace coverbs_rpc {
 
 class basic_server {
 public:
+  /**
+   * @param arena Registered memory to carve this connection's buffers from; when null, a private
+   * arena is created from config.memory.
+   * @param admission Admission limits to share with other connections; when null, this
+   * connection gets limits of its own from config.admission.
+   * @param session The connection's session, handed to handlers through rpc_context; must
+   * outlive the server.
+   */
   basic_server(std::shared_ptr<rdmapp::qp> qp, basic_mux const &mux, RpcConfig config = {},
-               std::uint32_t thread_count = 4);
+               std::uint32_t thread_count = 4, std::shared_ptr<registered_arena> arena = nullptr,
+               std::shared_ptr<admission_control> admission = nullptr,
+               rpc_session *session = nullptr);
 
+  /**
+   * @brief Run handlers on an existing executor instead of a thread pool of its own.
+   *
+   * @param scheduler With config.priority enabled, the priority_scheduler over `executor` that
+   * other connections using it share; when null, this connection gets one of its own.
+   */
+  basic_server(std::shared_ptr<rdmapp::qp> qp, basic_mux const &mux, RpcConfig config,
+               std::shared_ptr<cppcoro::static_thread_pool> executor,
+               std::shared_ptr<registered_arena> arena = nullptr,
+               std::shared_ptr<admission_control> admission = nullptr,
+               std::shared_ptr<priority_scheduler> scheduler = nullptr,
+               rpc_session *session = nullptr);
+
+  // Serve until the QP fails, e.g. after a send to a client that went away, then return once
+  // the calls in progress have finished.
   auto run() -> cppcoro::task<void>;
 
 private:
-  auto server_worker(std::size_t idx) -> cppcoro::task<void>;
+  struct stream_state;
+
+  auto server_worker(std::size_t idx, cppcoro::async_scope &scope) -> cppcoro::task<void>;
+  auto release_rendezvous(uint64_t req_id) -> void;
+  // Registers `resp` until the client acks pulling it, and returns the descriptor to send.
+  auto stage_rendezvous(uint64_t req_id, std::vector<std::byte> resp) -> detail::RendezvousDesc;
+  auto serve_batch(std::span<std::byte> records, uint32_t count,
+                   std::chrono::steady_clock::time_point arrived) -> cppcoro::task<void>;
+  auto send_frame(detail::buffer_pool::buffer buf, std::size_t len) -> cppcoro::task<void>;
+  auto send_frame(uint64_t req_id, uint32_t fn_id, uint32_t flags,
+                  std::span<const std::byte> payload, uint32_t reserved = 0)
+      -> cppcoro::task<void>;
+  // Counts a served one-way request, whose receive is being reposted, towards the client's next
+  // credit frame, starting a sender unless one is already running.
+  auto return_oneway_credit(cppcoro::async_scope &scope) -> void;
+  auto send_oneway_credits() -> cppcoro::task<void>;
+  auto serve_stream(uint64_t req_id, uint32_t fn_id, uint32_t window, std::vector<std::byte> req)
+      -> cppcoro::task<void>;
+  auto update_stream(detail::RpcHeader const &header) -> void;
 
   basic_mux const &mux_;
   RpcConfig const config_;
   std::size_t const send_buffer_size_;
   std::size_t const recv_buffer_size_;
   std::shared_ptr<rdmapp::qp> qp_;
-  cppcoro::static_thread_pool tp_;
+  std::shared_ptr<cppcoro::static_thread_pool> tp_;
+
+  std::shared_ptr<registered_arena> arena_;
+  registered_arena::block recv_block_;
+  detail::buffer_pool send_pool_;
+  std::shared_ptr<admission_control> admission_;
+  // Null unless config.priority is enabled.
+  std::shared_ptr<priority_scheduler> scheduler_;
+  rpc_session *const session_;
+
+  // Large responses waiting for the client to pull them, keyed by req_id.
+  std::mutex rendezvous_mutex_;
+  std::unordered_map<uint64_t, std::unique_ptr<detail::RendezvousBuffer>> rendezvous_resps_;
+
+  // Open server streams, keyed by req_id, so credit and cancel frames can reach them.
+  std::mutex streams_mutex_;
+  std::unordered_map<uint64_t, std::shared_ptr<stream_state>> streams_;
 
-  std::vector<std::byte> recv_buffer_pool_;
-  rdmapp::local_mr recv_mr_;
-  std::vector<std::byte> send_buffer_pool_;
-  rdmapp::local_mr send_mr_;
+  // One-way requests served since the last credit frame, and whether a sender is running.
+  std::atomic<uint32_t> oneway_credits_{0};
+  std::atomic<bool> crediting_{false};
 };
 
 } // namespace coverbs_rpc
@@ -1,32 +1,295 @@
 #pragma once
 
+#include <algorithm>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <optional>
 #include <rdmapp/qp.h>
+#include <span>
+#include <stdexcept>
 
 namespace coverbs_rpc {
 
+enum class cq_sharing : uint8_t {
+  // A dedicated send/recv CQ pair, each with its own poller, per QP.
+  per_qp,
+  // A new CQ pair for every `qps_per_cq` QPs.
+  per_n_qps,
+  // One CQ pair per core; QPs go to the least-loaded pair.
+  per_core,
+};
+
+enum class wait_mode : uint8_t {
+  // Spin on cpu_relax() for as long as it takes: lowest latency, one core per waiter.
+  busy_poll,
+  // Spin for spin_budget, then yield, then sleep with exponential backoff up to max_sleep. CQ
+  // pollers instead arm the CQ's completion channel and sleep until the next completion.
+  hybrid,
+};
+
+struct WaitPolicy {
+  wait_mode mode = wait_mode::busy_poll;
+  std::chrono::nanoseconds spin_budget{20'000};
+  std::chrono::microseconds max_sleep{200};
+};
+
 struct ConnConfig {
+  // Completion entries per QP; shared CQs are sized for all the QPs they may serve.
   uint32_t cq_size = 256;
   rdmapp::qp_config qp_config = rdmapp::default_qp_config();
+  cq_sharing cq_policy = cq_sharing::per_qp;
+  uint32_t qps_per_cq = 16;
+  // How the pollers of the CQs created for these QPs wait for completions.
+  WaitPolicy wait{};
+};
+
+struct MemoryConfig {
+  // Back registered memory with 1 GiB / 2 MiB hugepages when available.
+  bool hugepages = true;
+  // NUMA node to bind registered memory to; -1 leaves placement to the kernel.
+  int numa_node = -1;
+  // Granularity of shared registrations; 0 maps exactly what each allocation needs.
+  std::size_t chunk_size = 0;
+};
+
+/**
+ * @brief What a bulk call lets the server do to the caller's buffer.
+ */
+enum class bulk_access : uint32_t {
+  read = 1u << 0,
+  write = 1u << 1,
+  read_write = read | write,
+};
+
+struct CoalesceConfig {
+  // Pack small requests issued concurrently into shared frames; the server answers such a frame
+  // with frames of packed responses. Trades a little latency for message rate.
+  bool enabled = false;
+  // Most requests per frame; a frame is also sent once the next request would not fit.
+  uint32_t max_records = 16;
+  // Longest a request waits for company before its frame is sent anyway,
+  std::chrono::nanoseconds max_delay{1'000};
+  // and how long an open frame may go without growing before it is sent early.
+  std::chrono::nanoseconds idle_delay{200};
+};
+
+struct AdmissionConfig {
+  // Requests a server holds at once, queued or running; beyond it they are shed. 0: no limit.
+  uint32_t max_concurrency = 0;
+  // Requests waiting for a handler thread; beyond it they are shed. 0: no limit.
+  uint32_t max_queued = 0;
+  // Adapt the concurrency limit to latency, AIMD style: one more for every limit's worth of
+  // requests answered within target_latency, a quarter less (at most once per target_latency)
+  // while they are not. Moves between min_concurrency and max_concurrency, or 1024 if that is 0.
+  bool adaptive = false;
+  std::chrono::microseconds target_latency{1'000};
+  uint32_t min_concurrency = 4;
+};
+
+struct AtMostOnceConfig {
+  // Client: tag each call with this client's id and a sequence number, so the server runs it at
+  // most once however often it arrives.
+  bool enabled = false;
+  // Client: times a call the server shed or let expire is sent again, under the same sequence
+  // number. Only takes effect with `enabled`.
+  uint32_t retries = 0;
+  // Server: completed replies kept per client for answering repeats. A client's oldest ones are
+  // dropped beyond it, and repeats of those are refused instead of run again.
+  uint32_t window = 1024;
+  // Server: how long a client that sends nothing more keeps its replies.
+  std::chrono::seconds client_ttl{60};
+};
+
+struct HedgeConfig {
+  // replicated_client: send a second copy of a call to another replica once the call has taken
+  // longer than `percentile` of recent ones, and take whichever answer arrives first.
+  bool enabled = false;
+  double percentile = 0.95;
+  // Shortest wait before hedging, so fast calls are not all doubled.
+  std::chrono::microseconds min_delay{100};
+  // Recent call latencies the percentile is taken over. Nothing is hedged until a sixteenth of
+  // them has been seen.
+  uint32_t window = 512;
+};
+
+struct ShardingConfig {
+  // Points each shard gets on sharded_client's hash ring; more spread keys more evenly.
+  uint32_t vnodes = 128;
+  // The ring is flattened into 2^ring_bits slots, so routing a key is one table lookup. Keep
+  // well above vnodes times the number of shards.
+  uint32_t ring_bits = 16;
+};
+
+struct ResponseCacheConfig {
+  // Bytes of requests and responses kept for cacheable handlers, split evenly between shards;
+  // the least recently used entries go first.
+  std::size_t max_bytes = std::size_t{64} << 20;
+  // Separately locked parts, so that threads looking up different keys rarely contend.
+  uint32_t shards = 16;
+};
+
+enum class rpc_priority : uint8_t {
+  // Latency-critical control traffic: leases, heartbeats.
+  high,
+  normal,
+  // Bulk work that may wait.
+  low,
+};
+
+struct PriorityConfig {
+  // Start handlers by the priority their function was given (basic_mux::set_priority) instead
+  // of in arrival order.
+  bool enabled = false;
+  // High handlers always start first; normal and low ones, while both wait, in this ratio.
+  uint32_t normal_weight = 4;
+  uint32_t low_weight = 1;
+  // Handler threads that normal and low handlers may not occupy, kept free for high ones.
+  uint32_t reserved_threads = 1;
 };
 
 struct RpcConfig {
   std::size_t max_inflight = 128;
   std::size_t max_req_payload = 256;
   std::size_t max_resp_payload = 4096;
+  // Server only: largest request a client may hand over by rendezvous. Longer ones are refused
+  // with malformed_request before anything is allocated for them.
+  std::size_t max_rendezvous_bytes = std::size_t{64} << 20;
+  // Server only: largest client buffer a bulk call may name; the server stages that much of its
+  // arena per call. Larger ones are refused with malformed_request.
+  std::size_t max_bulk_bytes = std::size_t{64} << 20;
+  // Smallest send-buffer size class; larger classes grow by 16x up to the max payload.
+  std::size_t min_send_class = 256;
+  MemoryConfig memory{};
+  cq_sharing cq_policy = cq_sharing::per_qp;
+  uint32_t qps_per_cq = 16;
+  // How this endpoint waits for completions, free slots and send buffers.
+  WaitPolicy wait{};
+  // Stream items a server may send ahead of the client consuming them.
+  uint32_t stream_window = 16;
+  CoalesceConfig coalesce{};
+  // Budget every call hands the server, which drops requests it cannot answer within it; such
+  // calls throw deadline_exceeded. Counted from the request's arrival at the server, so time on
+  // the wire is not included. Zero sends none.
+  std::chrono::microseconds deadline{0};
+  // Server only: when to shed requests rather than queue them.
+  AdmissionConfig admission{};
+  // Server only: the order handlers are started in.
+  PriorityConfig priority{};
+  // Server only: room for the responses of handlers registered as cacheable.
+  ResponseCacheConfig cache{};
+  AtMostOnceConfig at_most_once{};
 
   auto to_conn_config() const noexcept -> ConnConfig {
     ConnConfig cfg;
     cfg.qp_config.max_send_wr = max_inflight + 64;
     cfg.qp_config.max_recv_wr = max_inflight + 64;
+    cfg.cq_policy = cq_policy;
+    cfg.qps_per_cq = qps_per_cq;
+    cfg.wait = wait;
     return cfg;
   }
 };
 
+/**
+ * @brief Thrown by a call the server dropped because its deadline passed first.
+ */
+class deadline_exceeded : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
+/**
+ * @brief Thrown by a call the server shed because it was at its admission limits.
+ */
+class server_overloaded : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
+/**
+ * @brief Thrown by an at-most-once call whose repeat the server would not run because it no
+ * longer holds the first attempt's reply. The call may or may not have taken effect.
+ */
+class replay_refused : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
+/**
+ * @brief Thrown by a call whose handler threw on the server, or whose request the server could
+ * not parse.
+ */
+class remote_error : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
+/**
+ * @brief Thrown by a call whose request could not be sent, e.g. because the connection failed;
+ * the server never saw it.
+ */
+class transport_error : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
+/**
+ * @brief The function a call goes to: its fn_id and, when the caller knows it from a
+ * compile-time service, its dense index there, which lets the server skip the fn_id lookup.
+ */
+struct rpc_method {
+  static constexpr uint32_t kNoIndex = UINT32_MAX;
+
+  constexpr rpc_method(uint32_t fn_id, uint32_t index = kNoIndex) noexcept
+      : fn_id(fn_id)
+      , index(index) {}
+
+  uint32_t fn_id;
+  uint32_t index;
+};
+
+enum class transport_kind : uint8_t {
+  rdma,
+  // Same-host shared-memory rings.
+  shm,
+  // Kernel TCP, for hosts without a usable RDMA NIC.
+  tcp,
+};
+
 struct TypedRpcConfig : public RpcConfig {
   uint32_t device_nr = 0;
   uint32_t port_nr = 1;
+  // Bind registered memory to the NIC's NUMA node when memory.numa_node is unset.
+  bool numa_local = true;
+  // Registration granularity of the arena a typed_server shares across its connections, and of
+  // the one in client_resources.
+  std::size_t shared_chunk_size = 64ul << 20;
+  // Shared-nothing server mode when non-zero: the server is split into this many core shards,
+  // each owning a pinned handler thread, its CQs and its registered memory. Connections are
+  // assigned to a shard at accept time.
+  uint32_t num_cores = 0;
+  // Shard i's handler thread is pinned to CPU first_cpu + i.
+  uint32_t first_cpu = 0;
+  // Transports. A server offers every enabled one it can open; a client uses shared memory if
+  // it is on the server's host, else RDMA, else TCP, skipping any disabled on either side.
+  bool enable_rdma = true;
+  // Off by default: a client connected over shared memory has no streams, regions or bulk
+  // calls, which need RDMA.
+  bool enable_shm = false;
+  // Off by default: the TCP listener is unauthenticated and listens on every interface.
+  bool enable_tcp = false;
+  // Port of the TCP transport; 0 picks the one after the RPC port, which the RDMA connection
+  // handshake already occupies.
+  uint16_t tcp_port = 0;
+  // Bytes per direction of each shared-memory connection, rounded up to a power of two; a
+  // message may take up to half of it.
+  std::size_t shm_ring_size = 4ul << 20;
+
+  auto tcp_port_for(uint16_t port) const noexcept -> uint16_t {
+    return tcp_port != 0 ? tcp_port : static_cast<uint16_t>(port + 1);
+  }
 };
 
 namespace detail {
@@ -35,12 +298,149 @@ struct RpcHeader {
   uint64_t req_id;
   uint32_t payload_len;
   uint32_t fn_id;
+  uint32_t flags;
+  uint32_t reserved;
+};
+
+// The payload is a RendezvousDesc instead of the message itself.
+constexpr uint32_t kFlagRendezvous = 1u << 0;
+// Client -> server: a rendezvous response has been pulled and may be released.
+constexpr uint32_t kFlagRendezvousAck = 1u << 1;
+// Client -> server: fire-and-forget request; no response is sent. Server -> client: `reserved`
+// one-way requests have been served and their receives reposted, so their slots may be reused.
+constexpr uint32_t kFlagOneWay = 1u << 2;
+// Request: open a server stream, `reserved` carrying the initial credit window. Response: one
+// item of that stream; every frame of a stream shares the request's req_id.
+constexpr uint32_t kFlagStream = 1u << 3;
+// Server -> client: last frame of a stream, carrying no item.
+constexpr uint32_t kFlagStreamEnd = 1u << 4;
+// Server -> client, with kFlagStreamEnd: the stream failed on the server.
+constexpr uint32_t kFlagStreamAbort = 1u << 5;
+// Client -> server: the client consumed `reserved` more items of the stream.
+constexpr uint32_t kFlagStreamCredit = 1u << 6;
+// Client -> server: the client stopped consuming; end the stream early.
+constexpr uint32_t kFlagStreamCancel = 1u << 7;
+// Request: the payload starts with a BulkDesc naming a client buffer the server may READ or
+// WRITE directly. Response: `reserved` holds how many bytes the server wrote into it.
+constexpr uint32_t kFlagBulk = 1u << 8;
+// The payload is `reserved` complete messages, each an RpcHeader and its payload, packed at
+// 8-byte boundaries. Only plain requests and responses are packed.
+constexpr uint32_t kFlagBatch = 1u << 9;
+// Request: `reserved` holds the microseconds the client still gives the call.
+constexpr uint32_t kFlagDeadline = 1u << 10;
+// Response: the request's deadline passed on the server, which dropped it; no payload.
+constexpr uint32_t kFlagExpired = 1u << 11;
+// Response: the server was at its admission limits and shed the request; no payload.
+constexpr uint32_t kFlagOverloaded = 1u << 12;
+// Request: the high half of `flags` holds the method's index in its service; fn_id still names
+// the method, so a server that does not serve the service looks it up as usual.
+constexpr uint32_t kFlagIndexed = 1u << 13;
+constexpr uint32_t kMethodIndexShift = 16;
+constexpr std::size_t kMaxServiceMethods = std::size_t{1} << (32 - kMethodIndexShift);
+// Request: the payload starts with a ReplayDesc, ahead of any other descriptor; the server runs
+// the call at most once per client and sequence number.
+constexpr uint32_t kFlagReplay = 1u << 14;
+
+struct ReplayDesc {
+  uint64_t client;
+  uint64_t seq;
+  // Every call of this client numbered below it has completed and will not be repeated.
+  uint64_t acked;
+};
+
+// Response, payload-free: the call did not complete on the server; `reserved` says why.
+constexpr uint32_t kFlagFailed = 1u << 15;
+
+enum class failure_reason : uint32_t {
+  // An at-most-once repeat of a call whose reply the server has already dropped.
+  replay_refused = 1,
+  // The handler threw.
+  handler_failed = 2,
+  // The request could not be read: a descriptor did not parse or its payload could not be pulled.
+  malformed_request = 3,
+  // Never sent by a server: the client marks calls whose request it failed to send.
+  send_failed = 4,
 };
 
 constexpr uintptr_t kWaiterEmpty = 0;
+// Left by a response that arrived before its caller suspended; the caller then carries on
+// without suspending. Never a coroutine frame address, which is aligned.
+constexpr uintptr_t kWaiterDone = 1;
+
+// The high half is the slot's generation, bumped each time the slot is reused, so a stale
+// response for an earlier occupant of the slot can be told apart without a shared counter.
+auto inline make_req_id(uint32_t generation, uint32_t slot_idx) noexcept -> uint64_t {
+  return (static_cast<uint64_t>(generation) << 32) | static_cast<uint64_t>(slot_idx);
+}
+
+// Marks a request as carrying `budget`, in whole microseconds and at least one; zero leaves it
+// without a deadline.
+auto inline stamp_deadline(RpcHeader &header, std::chrono::microseconds budget) noexcept -> void {
+  if (budget.count() > 0) {
+    header.flags |= kFlagDeadline;
+    header.reserved = static_cast<uint32_t>(std::min<int64_t>(budget.count(), UINT32_MAX));
+  }
+}
+
+// When a request received at `arrived` stops being worth answering; time_point::max() if it
+// carries no deadline.
+auto inline request_deadline(RpcHeader const &header,
+                             std::chrono::steady_clock::time_point arrived) noexcept
+    -> std::chrono::steady_clock::time_point {
+  if (!(header.flags & kFlagDeadline)) {
+    return std::chrono::steady_clock::time_point::max();
+  }
+  return arrived + std::chrono::microseconds(header.reserved);
+}
+
+auto inline past(std::chrono::steady_clock::time_point deadline) noexcept -> bool {
+  return deadline != std::chrono::steady_clock::time_point::max() &&
+         std::chrono::steady_clock::now() >= deadline;
+}
+
+// Raises the error a payload-free rejection from the server stands for, if `resp_flags` hold one;
+// `reserved` is the response header's reserved word.
+auto inline check_rejected(uint32_t resp_flags, uint32_t reserved) -> void {
+  if (resp_flags & kFlagExpired) [[unlikely]] {
+    throw deadline_exceeded("call dropped by the server: deadline exceeded");
+  }
+  if (resp_flags & kFlagOverloaded) [[unlikely]] {
+    throw server_overloaded("call shed by the server: overloaded");
+  }
+  if (resp_flags & kFlagFailed) [[unlikely]] {
+    switch (static_cast<failure_reason>(reserved)) {
+      case failure_reason::replay_refused:
+        throw replay_refused("repeat refused by the server: the first attempt's reply was dropped");
+      case failure_reason::handler_failed:
+        throw remote_error("call failed on the server: the handler threw");
+      case failure_reason::malformed_request:
+        throw remote_error("call failed on the server: the request could not be read");
+      case failure_reason::send_failed:
+        throw transport_error("call failed: its request could not be sent");
+    }
+    throw remote_error("call failed on the server");
+  }
+}
+
+// Splits the ReplayDesc off the front of a kFlagReplay request's payload into `replay`. False if
+// the payload is too short to hold one.
+auto inline take_replay(uint32_t flags, std::span<std::byte> &payload,
+                        std::optional<ReplayDesc> &replay) noexcept -> bool {
+  if (!(flags & kFlagReplay)) {
+    return true;
+  }
+  if (payload.size() < sizeof(ReplayDesc)) [[unlikely]] {
+    return false;
+  }
+  std::memcpy(&replay.emplace(), payload.data(), sizeof(ReplayDesc));
+  payload = payload.subspan(sizeof(ReplayDesc));
+  return true;
+}
 
-auto inline make_req_id(uint64_t seq, uint32_t slot_idx) noexcept -> uint64_t {
-  return (seq << 32) | static_cast<uint64_t>(slot_idx);
+// Request flags naming `method`'s index in its service, if it has one.
+constexpr auto method_flags(rpc_method method) noexcept -> uint32_t {
+  return method.index < kMaxServiceMethods ? kFlagIndexed | (method.index << kMethodIndexShift)
+                                           : 0;
 }
 
 auto inline parse_slot_idx(uint64_t req_id) noexcept -> uint32_t {
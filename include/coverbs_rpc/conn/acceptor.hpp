@@ -1,12 +1,12 @@
 #pragma once
 
 #include "coverbs_rpc/common.hpp"
+#include "coverbs_rpc/conn/cq_pool.hpp"
 #include "coverbs_rpc/conn/transmission.hpp"
 
 #include <cppcoro/net/socket.hpp>
 #include <cppcoro/task.hpp>
 #include <cstdint>
-#include <list>
 #include <memory>
 #include <rdmapp/cq.h>
 #include <rdmapp/cq_poller.h>
@@ -32,6 +32,9 @@ struct qp_acceptor {
 
   auto accept() -> cppcoro::task<std::shared_ptr<qp_t>>;
 
+  // Accept a QP whose completion queues come from `cqs` rather than the acceptor's own pool.
+  auto accept(cq_pool &cqs) -> cppcoro::task<std::shared_ptr<qp_t>>;
+
   auto accept_multiple(qp_handshake &handshake)
       -> cppcoro::task<std::vector<std::shared_ptr<qp_t>>>;
 
@@ -40,15 +43,14 @@ struct qp_acceptor {
   ~qp_acceptor() = default;
 
 private:
-  auto accept_qp(cppcoro::net::socket &socket, std::shared_ptr<rdmapp::cq> send_cq,
-                 std::shared_ptr<rdmapp::cq> recv_cq) -> cppcoro::task<std::shared_ptr<qp_t>>;
-
-  auto alloc_cq() -> std::shared_ptr<rdmapp::cq>;
+  // Reserves a CQ pair from `pool` and hands it back if the handshake fails.
+  auto accept_qp(cppcoro::net::socket &socket, cq_pool &pool, bool unified = false)
+      -> cppcoro::task<std::shared_ptr<qp_t>>;
 
   cppcoro::net::socket acceptor_socket_;
   std::shared_ptr<pd> pd_;
   std::shared_ptr<srq> srq_;
-  std::list<cq_poller_t> pollers_;
+  cq_pool cqs_;
   uint16_t const port_;
   cppcoro::io_service &io_service_;
   ConnConfig const config_;
@@ -1,12 +1,12 @@
 #pragma once
 
 #include "coverbs_rpc/common.hpp"
+#include "coverbs_rpc/conn/cq_pool.hpp"
 #include "coverbs_rpc/conn/transmission.hpp"
 
 #include <cppcoro/net/socket.hpp>
 #include <cppcoro/task.hpp>
 #include <cstdint>
-#include <list>
 #include <memory>
 #include <rdmapp/cq.h>
 #include <rdmapp/cq_poller.h>
@@ -38,11 +38,9 @@ private:
   auto from_socket(cppcoro::net::socket &socket, std::span<std::byte const> userdata)
       -> cppcoro::task<std::shared_ptr<qp_t>>;
 
-  auto alloc_cq() noexcept -> std::shared_ptr<cq>;
-
   std::shared_ptr<pd> pd_;
   std::shared_ptr<srq> srq_;
-  std::list<cq_poller_t> pollers_;
+  cq_pool cqs_;
   cppcoro::io_service &io_service_;
   ConnConfig const config_;
 };
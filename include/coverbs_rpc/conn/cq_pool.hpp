@@ -0,0 +1,81 @@
+#pragma once
+
+#include "coverbs_rpc/common.hpp"
+#include "coverbs_rpc/conn/hybrid_cq_poller.hpp"
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <rdmapp/cq.h>
+#include <rdmapp/cq_poller.h>
+#include <rdmapp/pd.h>
+#include <rdmapp/qp.h>
+#include <vector>
+
+namespace coverbs_rpc {
+
+/**
+ * @brief Hands out completion queues (and their pollers) to new QPs according to
+ * ConnConfig::cq_policy.
+ *
+ * Completions on a shared CQ are demultiplexed by the pollers through each work request's
+ * wr_id, so any number of QPs may share a pair as long as the CQ is sized for all of them. With
+ * a hybrid ConnConfig::wait, each CQ gets a completion channel and a hybrid_cq_poller that sleeps
+ * on it once the CQ goes idle.
+ */
+class cq_pool {
+public:
+  struct cq_pair {
+    std::shared_ptr<rdmapp::cq> send;
+    std::shared_ptr<rdmapp::cq> recv;
+    std::size_t group;
+  };
+
+  cq_pool(std::shared_ptr<rdmapp::pd> pd, ConnConfig const &config);
+
+  /**
+   * @brief Reserve a CQ pair for a QP about to be created; pass the QP to attach() afterwards,
+   * or hand the reservation back with release() if the QP is never created.
+   *
+   * @param unified Use a single CQ for both directions when the QP gets a dedicated one.
+   */
+  auto acquire(bool unified = false) -> cq_pair;
+
+  auto attach(cq_pair const &pair, std::shared_ptr<rdmapp::qp> const &qp) -> void;
+
+  /**
+   * @brief Drop a reservation that attach() never consumed, e.g. after a failed handshake, so
+   * its group can still be reclaimed.
+   */
+  auto release(cq_pair const &pair) -> void;
+
+  auto num_groups() const -> std::size_t;
+
+private:
+  struct group {
+    std::size_t id{};
+    std::shared_ptr<rdmapp::cq> send;
+    std::shared_ptr<rdmapp::cq> recv;
+    std::list<rdmapp::native_cq_poller> pollers;
+    std::list<hybrid_cq_poller> hybrid_pollers;
+    std::vector<std::weak_ptr<rdmapp::qp>> qps;
+    std::size_t pending{};
+
+    auto load() const noexcept -> std::size_t { return qps.size() + pending; }
+  };
+
+  auto make_group(std::size_t nr_qps, bool unified) -> group &;
+  // Creates a CQ polled by a poller of `g`.
+  auto make_cq(group &g, std::size_t cq_size) -> std::shared_ptr<rdmapp::cq>;
+  auto pick_group(bool unified) -> group &;
+  auto prune() -> void;
+
+  std::shared_ptr<rdmapp::pd> pd_;
+  ConnConfig const config_;
+  mutable std::mutex mutex_;
+  std::list<group> groups_;
+  std::size_t next_group_id_{};
+};
+
+} // namespace coverbs_rpc
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "coverbs_rpc/common.hpp"
+
+#include <cstddef>
+#include <infiniband/verbs.h>
+#include <memory>
+#include <rdmapp/cq.h>
+#include <rdmapp/device.h>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+namespace coverbs_rpc {
+
+/**
+ * @brief Creates a CQ with its own completion channel and polls it according to a hybrid
+ * WaitPolicy: busy-polls while completions keep coming and for spin_budget after the last one,
+ * then arms the channel and sleeps on its event fd until the next completion arrives.
+ *
+ * Completions are dispatched as rdmapp::native_cq_poller dispatches them, so QPs on the CQ use
+ * the same awaitables whichever poller serves it.
+ */
+class hybrid_cq_poller {
+public:
+  hybrid_cq_poller(std::shared_ptr<rdmapp::device> const &device, std::size_t nr_cqe,
+                   WaitPolicy const &policy, std::size_t batch_size = 16);
+  hybrid_cq_poller(hybrid_cq_poller const &) = delete;
+  auto operator=(hybrid_cq_poller const &) -> hybrid_cq_poller & = delete;
+  ~hybrid_cq_poller();
+
+  auto cq() const noexcept -> std::shared_ptr<rdmapp::cq> const & { return cq_; }
+
+private:
+  auto run(std::stop_token stop) -> void;
+  // Polls one batch and dispatches it; returns whether there was anything.
+  auto poll_once() -> bool;
+  // Blocks until the armed channel fires or the poller is stopped.
+  auto wait_for_event() -> void;
+
+  std::shared_ptr<ibv_comp_channel> channel_;
+  std::shared_ptr<rdmapp::cq> cq_;
+  WaitPolicy const policy_;
+  std::vector<ibv_wc> wcs_;
+  // Written to on destruction to wake a sleeping poller.
+  int wake_fd_ = -1;
+  std::jthread thread_;
+};
+
+} // namespace coverbs_rpc
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "coverbs_rpc/registered_memory.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <rdmapp/mr.h>
+#include <vector>
+
+namespace coverbs_rpc::detail {
+
+/**
+ * @brief A registered send-buffer pool carved into size classes.
+ *
+ * Class k holds buffers of min_class * 16^k bytes; the last class holds max_size, and a class
+ * over half of that is folded into it. Every class holds `count` buffers, so `count` senders
+ * always find one that fits whatever their sizes; the smaller classes cost a fraction of the
+ * top one and keep small frames on small, cache-friendly buffers. Senders draw the smallest
+ * class that fits and fall back to larger ones when it is exhausted.
+ */
+class buffer_pool {
+public:
+  struct buffer {
+    std::byte *data{};
+    std::size_t capacity{};
+    uint32_t class_idx{};
+    uint32_t index{};
+  };
+
+  buffer_pool(registered_arena &arena, std::size_t max_size, std::size_t count,
+              std::size_t min_class = 256);
+  ~buffer_pool();
+
+  auto try_acquire(std::size_t size) -> std::optional<buffer>;
+
+  // Waits, according to `wait`, until a buffer of at least `size` bytes is free; once the
+  // backoff is spent, sleeps until another buffer is released.
+  auto acquire(std::size_t size, WaitPolicy const &wait = {}) -> buffer;
+
+  auto release(buffer const &buf) -> void;
+
+  auto view(buffer const &buf, std::size_t length) const -> rdmapp::mr_view;
+
+  auto registered_bytes() const noexcept -> std::size_t { return block_.size(); }
+
+private:
+  struct size_class;
+
+  static auto make_classes(std::size_t max_size, std::size_t count, std::size_t min_class)
+      -> std::vector<std::unique_ptr<size_class>>;
+
+  std::vector<std::unique_ptr<size_class>> classes_;
+  registered_arena::block block_;
+  // Bumped by every release(), for acquirers that ran out of backoff to sleep on.
+  std::atomic<uint32_t> releases_{0};
+};
+
+} // namespace coverbs_rpc::detail
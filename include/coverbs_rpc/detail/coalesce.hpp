@@ -0,0 +1,85 @@
+#pragma once
+
+#include "coverbs_rpc/common.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+namespace coverbs_rpc::detail {
+
+// Records in a kFlagBatch frame each start on an 8-byte boundary.
+constexpr auto batch_record_size(std::size_t payload_len) noexcept -> std::size_t {
+  return (sizeof(RpcHeader) + payload_len + 7) & ~std::size_t{7};
+}
+
+/**
+ * @brief Packs records into a frame buffer behind a kFlagBatch header, which finish() fills in
+ * once the record count is known.
+ */
+class batch_writer {
+public:
+  // `frame` holds the batch header plus `capacity` bytes of records.
+  batch_writer(std::byte *frame, std::size_t capacity) noexcept
+      : frame_(frame)
+      , capacity_(capacity) {}
+
+  auto fits(std::size_t payload_len) const noexcept -> bool {
+    return len_ + batch_record_size(payload_len) <= capacity_;
+  }
+
+  auto append(RpcHeader const &header, std::span<const std::byte> payload) noexcept -> void {
+    std::byte *at = frame_ + sizeof(RpcHeader) + len_;
+    std::memcpy(at, &header, sizeof(header));
+    std::copy_n(payload.data(), payload.size(), at + sizeof(header));
+    len_ += batch_record_size(payload.size());
+    ++records_;
+  }
+
+  auto records() const noexcept -> uint32_t { return records_; }
+
+  // Writes the batch header and returns the frame's length.
+  auto finish() noexcept -> std::size_t {
+    RpcHeader const header{
+        .req_id = 0,
+        .payload_len = static_cast<uint32_t>(len_),
+        .fn_id = 0,
+        .flags = kFlagBatch,
+        .reserved = records_,
+    };
+    std::memcpy(frame_, &header, sizeof(header));
+    return sizeof(header) + len_;
+  }
+
+private:
+  std::byte *frame_;
+  std::size_t capacity_;
+  std::size_t len_ = 0;
+  uint32_t records_ = 0;
+};
+
+/**
+ * @brief Calls f(header, payload) for each of the `count` records in a batch frame's payload.
+ * Stops at the first record that overruns it and returns false.
+ */
+template <typename F>
+auto for_each_record(std::span<std::byte> records, uint32_t count, F &&f) -> bool {
+  for (uint32_t i = 0; i < count; ++i) {
+    if (records.size() < sizeof(RpcHeader)) [[unlikely]] {
+      return false;
+    }
+    RpcHeader header;
+    std::memcpy(&header, records.data(), sizeof(header));
+    std::size_t const size = batch_record_size(header.payload_len);
+    if (sizeof(RpcHeader) + header.payload_len > records.size()) [[unlikely]] {
+      return false;
+    }
+    f(header, records.subspan(sizeof(RpcHeader), header.payload_len));
+    records = records.subspan(std::min(size, records.size()));
+  }
+  return true;
+}
+
+} // namespace coverbs_rpc::detail
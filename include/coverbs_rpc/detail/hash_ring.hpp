@@ -0,0 +1,82 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace coverbs_rpc::detail {
+
+// splitmix64's finalizer: spreads every input bit over the whole word.
+constexpr auto mix64(uint64_t x) noexcept -> uint64_t {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ull;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+// FNV-1a, mixed: the same on every host and build, unlike std::hash.
+constexpr auto hash_bytes(std::string_view bytes) noexcept -> uint64_t {
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (char c : bytes) {
+    h = (h ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+  }
+  return mix64(h);
+}
+
+// Where a shard key falls on the ring. Keys are integers or anything viewable as a string.
+template <typename Key>
+constexpr auto shard_hash(Key const &key) noexcept -> uint64_t {
+  if constexpr (std::is_integral_v<Key> || std::is_enum_v<Key>) {
+    return mix64(static_cast<uint64_t>(key));
+  } else {
+    static_assert(std::is_convertible_v<Key const &, std::string_view>,
+                  "shard keys are integers or strings");
+    return hash_bytes(std::string_view(key));
+  }
+}
+
+/**
+ * @brief A consistent-hash ring of named members, each placed at `vnodes` points, flattened into
+ * 2^bits slots that each name the member owning the slot's start. Adding or removing a member
+ * only moves the keys of the slots it gains or loses.
+ */
+class hash_ring {
+public:
+  hash_ring(std::vector<std::string> const &members, uint32_t vnodes, uint32_t bits)
+      : shift_(64 - std::clamp<uint32_t>(bits, 1, 24)) {
+    std::vector<std::pair<uint64_t, uint32_t>> points;
+    points.reserve(members.size() * vnodes);
+    for (uint32_t m = 0; m < members.size(); ++m) {
+      for (uint32_t v = 0; v < std::max<uint32_t>(vnodes, 1); ++v) {
+        points.emplace_back(hash_bytes(members[m] + "#" + std::to_string(v)), m);
+      }
+    }
+    std::sort(points.begin(), points.end());
+
+    slots_.resize(std::size_t{1} << (64 - shift_));
+    std::size_t p = 0;
+    for (std::size_t s = 0; s < slots_.size() && !points.empty(); ++s) {
+      uint64_t const start = static_cast<uint64_t>(s) << shift_;
+      while (p < points.size() && points[p].first < start) {
+        ++p;
+      }
+      // Past the last point the ring wraps around to the first.
+      slots_[s] = points[p < points.size() ? p : 0].second;
+    }
+  }
+
+  // Index into `members` of the member owning `hash`.
+  auto owner(uint64_t hash) const noexcept -> uint32_t { return slots_[hash >> shift_]; }
+
+private:
+  uint32_t shift_;
+  std::vector<uint32_t> slots_;
+};
+
+} // namespace coverbs_rpc::detail
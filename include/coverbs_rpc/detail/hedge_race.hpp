@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cppcoro/cancellation_source.hpp>
+#include <cppcoro/single_consumer_event.hpp>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+namespace coverbs_rpc::detail {
+
+/**
+ * @brief The copies of one hedged call racing each other: the first answer settles the call, and
+ * a failure only does once no other copy is still running.
+ */
+template <typename Resp>
+class hedge_race {
+public:
+  // Set once the call is settled; the caller waits on it, then take()s the outcome.
+  cppcoro::single_consumer_event settled;
+  // Cancelled once the call is settled, so a hedge not sent yet never is.
+  cppcoro::cancellation_source pending_hedge;
+
+  // Enter another copy of the call; false once it is settled and the copy is not needed.
+  auto join() -> bool {
+    std::lock_guard lock(mutex_);
+    if (done_) {
+      return false;
+    }
+    ++running_;
+    return true;
+  }
+
+  auto win(Resp resp) -> void {
+    {
+      std::lock_guard lock(mutex_);
+      --running_;
+      if (done_) {
+        return;
+      }
+      done_ = true;
+      resp_.emplace(std::move(resp));
+    }
+    settle();
+  }
+
+  auto lose(std::exception_ptr error) -> void {
+    {
+      std::lock_guard lock(mutex_);
+      if (--running_ > 0 || done_) {
+        return;
+      }
+      done_ = true;
+      error_ = std::move(error);
+    }
+    settle();
+  }
+
+  auto take() -> Resp {
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+    return std::move(*resp_);
+  }
+
+private:
+  auto settle() -> void {
+    pending_hedge.request_cancellation();
+    settled.set();
+  }
+
+  std::mutex mutex_;
+  // The first copy is entered from the start.
+  uint32_t running_ = 1;
+  bool done_ = false;
+  std::optional<Resp> resp_;
+  std::exception_ptr error_;
+};
+
+} // namespace coverbs_rpc::detail
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cppcoro/task.hpp>
+#include <rdmapp/mr.h>
+#include <rdmapp/qp.h>
+#include <span>
+#include <vector>
+
+namespace coverbs_rpc::detail {
+
+// Shipped as the payload of a frame flagged with kFlagRendezvous: the receiver pulls
+// `length` bytes from the sender's registered memory with an RDMA READ.
+struct RendezvousDesc {
+  uint64_t addr;
+  uint32_t length;
+  uint32_t rkey;
+};
+
+auto inline make_rendezvous_desc(rdmapp::local_mr const &mr) noexcept -> RendezvousDesc {
+  return RendezvousDesc{
+      .addr = reinterpret_cast<uint64_t>(mr.addr()),
+      .length = static_cast<uint32_t>(mr.length()),
+      .rkey = mr.rkey(),
+  };
+}
+
+auto inline to_remote_mr(RendezvousDesc const &desc, std::size_t length) noexcept
+    -> rdmapp::remote_mr {
+  return rdmapp::remote_mr(reinterpret_cast<void *>(desc.addr), static_cast<uint32_t>(length),
+                           desc.rkey);
+}
+
+// Registers `dst` and pulls the first `dst.size()` bytes described by `desc` into it.
+auto inline rendezvous_read(rdmapp::qp &qp, RendezvousDesc const &desc, std::span<std::byte> dst)
+    -> cppcoro::task<void> {
+  if (dst.empty()) {
+    co_return;
+  }
+  auto mr = qp.pd_ptr()->reg_mr(dst.data(), dst.size());
+  co_await qp.read(rdmapp::mr_view(mr, 0, dst.size()), to_remote_mr(desc, dst.size()),
+                   rdmapp::use_native_awaitable);
+}
+
+// Leads the payload of a kFlagBulk request.
+struct BulkDesc {
+  uint64_t addr;
+  uint32_t length;
+  uint32_t rkey;
+  uint32_t access; // bulk_access bits
+  uint32_t reserved;
+};
+
+auto inline bulk_target(BulkDesc const &bulk) noexcept -> RendezvousDesc {
+  return RendezvousDesc{.addr = bulk.addr, .length = bulk.length, .rkey = bulk.rkey};
+}
+
+// A heap buffer that stays registered until the peer has pulled it.
+struct RendezvousBuffer {
+  explicit RendezvousBuffer(rdmapp::pd &pd, std::vector<std::byte> buf)
+      : data(std::move(buf))
+      , mr(pd.reg_mr(data.data(), data.size())) {}
+
+  std::vector<std::byte> data;
+  rdmapp::local_mr mr;
+};
+
+} // namespace coverbs_rpc::detail
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "coverbs_rpc/common.hpp"
+
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <set>
+
+namespace coverbs_rpc::detail {
+
+/**
+ * @brief Numbers a client's at-most-once calls and tracks which are still waiting for their
+ * reply, whose oldest bounds what the client acknowledges to the server.
+ */
+class replay_sequencer {
+public:
+  replay_sequencer()
+      : client_(std::random_device{}() | (static_cast<uint64_t>(std::random_device{}()) << 32)) {}
+
+  // Number a new call; its repeats are sent under the same descriptor.
+  auto begin() -> ReplayDesc {
+    std::lock_guard lock(mutex_);
+    uint64_t const seq = next_++;
+    outstanding_.insert(seq);
+    return ReplayDesc{.client = client_, .seq = seq, .acked = *outstanding_.begin()};
+  }
+
+  // The call will not be sent again.
+  auto end(uint64_t seq) -> void {
+    std::lock_guard lock(mutex_);
+    outstanding_.erase(seq);
+  }
+
+private:
+  uint64_t const client_;
+  std::mutex mutex_;
+  uint64_t next_ = 0;
+  std::set<uint64_t> outstanding_;
+};
+
+} // namespace coverbs_rpc::detail
@@ -1,10 +1,15 @@
 #pragma once
 
+#include <cppcoro/async_generator.hpp>
 #include <cppcoro/task.hpp>
 #include <glaze/glaze.hpp>
 #include <tuple>
 #include <type_traits>
 
+namespace coverbs_rpc {
+struct rpc_context;
+} // namespace coverbs_rpc
+
 namespace coverbs_rpc::detail {
 
 template <typename T>
@@ -14,6 +19,15 @@ struct is_task<cppcoro::task<R>> : std::true_type {};
 template <typename T>
 inline constexpr bool is_task_v = is_task<T>::value;
 
+template <typename T>
+struct is_async_generator : std::false_type {};
+template <typename T>
+struct is_async_generator<cppcoro::async_generator<T>> : std::true_type {
+  using item_type = T;
+};
+template <typename T>
+inline constexpr bool is_async_generator_v = is_async_generator<T>::value;
+
 template <typename T>
 struct task_result {
   using type = T;
@@ -37,12 +51,23 @@ struct function_traits_base {
   using params = std::tuple<Args...>;
 
   static constexpr bool is_coro_fn_v = is_task_v<raw_resp_type>;
+  static constexpr bool is_stream_fn_v = is_async_generator_v<raw_resp_type>;
   using request_type = std::decay_t<std::tuple_element_t<0, params>>;
   using response_type = std::decay_t<task_result_t<raw_resp_type>>;
 
+  // A second parameter of type rpc_context& gives the handler its per-call context (bulk
+  // buffers and the like); any other second parameter is a session.
+  static constexpr bool takes_context() {
+    if constexpr (arity == 2) {
+      return std::is_same_v<std::tuple_element_t<1, params>, rpc_context &>;
+    }
+    return false;
+  }
+  static constexpr bool call_with_context = takes_context();
+
   static constexpr bool is_with_session() {
     if constexpr (arity == 2) {
-      return true;
+      return !call_with_context;
     }
     return false;
   }
@@ -77,9 +102,20 @@ using rpc_resp_t = typename function_traits<decltype(Handler)>::response_type;
 template <auto Handler>
 inline constexpr bool is_coro_fn_v = function_traits<decltype(Handler)>::is_coro_fn_v;
 
+// Server-streaming handlers return cppcoro::async_generator<Item>.
+template <auto Handler>
+inline constexpr bool is_stream_fn_v = function_traits<decltype(Handler)>::is_stream_fn_v;
+
+template <auto Handler>
+using rpc_stream_item_t = typename is_async_generator<
+    typename function_traits<decltype(Handler)>::raw_resp_type>::item_type;
+
 template <auto Handler>
 inline constexpr bool is_with_session_v = function_traits<decltype(Handler)>::call_with_session;
 
+template <auto Handler>
+inline constexpr bool is_with_context_v = function_traits<decltype(Handler)>::call_with_context;
+
 template <auto Handler>
 inline constexpr bool is_member_fn_v = function_traits<decltype(Handler)>::is_member_fn;
 
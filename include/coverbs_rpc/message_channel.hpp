@@ -0,0 +1,48 @@
+#pragma once
+
+#include "coverbs_rpc/common.hpp"
+
+#include <cstddef>
+#include <functional>
+#include <span>
+#include <stop_token>
+
+namespace coverbs_rpc {
+
+/**
+ * @brief A connection that carries whole RpcHeader-framed messages, for the transports that
+ * copy every message instead of using one-sided RDMA: same-host shared memory and TCP.
+ *
+ * send() may be called from any thread; receive() from one thread only.
+ */
+class message_channel {
+public:
+  using on_message_fn = std::function<void(std::span<std::byte> message)>;
+
+  virtual ~message_channel() = default;
+
+  /**
+   * @brief Queue one message made of `header` followed by `payload`, waiting per `wait` while
+   * the transport is backed up. Throws if the message can never fit or the connection is gone.
+   */
+  virtual auto send(std::span<const std::byte> header, std::span<const std::byte> payload,
+                    WaitPolicy const &wait) -> void = 0;
+
+  /**
+   * @brief Block until at least one message has arrived and hand each one that has to
+   * `on_message`; a message is only valid for the duration of that call.
+   *
+   * @return false, without calling `on_message`, once `stop` is requested or the connection is
+   * closed.
+   */
+  virtual auto receive(on_message_fn const &on_message, WaitPolicy const &wait,
+                       std::stop_token const &stop) -> bool = 0;
+
+  // Tell the peer this side is done; safe to call more than once.
+  virtual auto close() noexcept -> void = 0;
+
+  // Largest message, header included, send() accepts.
+  virtual auto max_message() const noexcept -> std::size_t = 0;
+};
+
+} // namespace coverbs_rpc
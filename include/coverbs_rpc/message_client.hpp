@@ -0,0 +1,46 @@
+#pragma once
+
+#include "coverbs_rpc/basic_client.hpp"
+#include "coverbs_rpc/common.hpp"
+#include "coverbs_rpc/message_channel.hpp"
+
+#include <cppcoro/task.hpp>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace coverbs_rpc {
+
+/**
+ * @brief basic_client over a message_channel (shared memory or TCP).
+ *
+ * Same framing and call semantics as basic_client, minus RDMA: messages of any size up to the
+ * channel's max_message() are copied through it whole, so there is no rendezvous path and no
+ * registered memory. Streams, bulk calls and published regions need RDMA and are not offered.
+ */
+class message_client {
+public:
+  explicit message_client(std::unique_ptr<message_channel> ch, RpcConfig config = {});
+  ~message_client();
+
+  auto call(rpc_method method, std::span<const std::byte> req_data,
+            std::span<std::byte> resp_buffer, resume_target resume = {})
+      -> cppcoro::task<std::size_t>;
+
+  auto call(rpc_method method, std::span<const std::byte> req_data,
+            std::vector<std::byte> &resp_buffer, resume_target resume = {})
+      -> cppcoro::task<std::size_t>;
+
+  auto call_oneway(rpc_method method, std::span<const std::byte> req_data,
+                   resume_target resume = {}) -> cppcoro::task<void>;
+
+private:
+  auto call_impl(rpc_method method, std::span<const std::byte> req_data,
+                 std::span<std::byte> resp_buffer, std::vector<std::byte> *growable,
+                 resume_target resume) -> cppcoro::task<std::size_t>;
+
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+} // namespace coverbs_rpc
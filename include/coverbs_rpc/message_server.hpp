@@ -0,0 +1,49 @@
+#pragma once
+
+#include "coverbs_rpc/admission.hpp"
+#include "coverbs_rpc/common.hpp"
+#include "coverbs_rpc/message_channel.hpp"
+#include "coverbs_rpc/priority_scheduler.hpp"
+#include "coverbs_rpc/server_mux.hpp"
+
+#include <chrono>
+#include <cppcoro/static_thread_pool.hpp>
+#include <cppcoro/task.hpp>
+#include <memory>
+#include <stop_token>
+#include <vector>
+
+namespace coverbs_rpc {
+
+/**
+ * @brief basic_server over a message_channel, dispatching through the same mux.
+ *
+ * Handler responses go back whole, whether they were written to the response span or to
+ * rpc_context::large_resp.
+ */
+class message_server {
+public:
+  // `admission`, `scheduler` and `session` as for basic_server.
+  message_server(std::unique_ptr<message_channel> ch, basic_mux const &mux, RpcConfig config,
+                 std::shared_ptr<cppcoro::static_thread_pool> executor,
+                 std::shared_ptr<admission_control> admission = nullptr,
+                 std::shared_ptr<priority_scheduler> scheduler = nullptr,
+                 rpc_session *session = nullptr);
+
+  // Serve until the client disconnects or `stop` is requested, blocking the calling thread.
+  auto run(std::stop_token stop) -> void;
+
+private:
+  auto handle(std::vector<std::byte> frame, std::chrono::steady_clock::time_point arrived,
+              admission_control::ticket admitted) -> cppcoro::task<void>;
+
+  std::unique_ptr<message_channel> ch_;
+  basic_mux const &mux_;
+  RpcConfig const config_;
+  std::shared_ptr<cppcoro::static_thread_pool> tp_;
+  std::shared_ptr<admission_control> admission_;
+  std::shared_ptr<priority_scheduler> scheduler_;
+  rpc_session *const session_;
+};
+
+} // namespace coverbs_rpc
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "coverbs_rpc/common.hpp"
+
+#include <array>
+#include <coroutine>
+#include <cppcoro/static_thread_pool.hpp>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+namespace coverbs_rpc {
+
+/**
+ * @brief Starts handlers on a thread pool by priority class rather than in arrival order.
+ *
+ * Waiting high handlers always go first. Normal and low ones share what is left in the ratio
+ * of their weights, and never occupy more than the pool's threads minus reserved_threads, so a
+ * burst of them cannot keep a high handler from a thread. Each waiting handler posts one
+ * runner to the pool; whichever runner gets a thread first resumes the most urgent handler
+ * waiting at that moment.
+ */
+class priority_scheduler {
+public:
+  /**
+   * @brief A handler's claim on a pool thread; give it back with finish() once the handler is
+   * done, or by destroying it.
+   */
+  class running {
+  public:
+    running() = default;
+    running(running &&other) noexcept;
+    auto operator=(running &&other) noexcept -> running &;
+    ~running() { finish(); }
+
+    auto finish() noexcept -> void;
+
+  private:
+    friend class priority_scheduler;
+    running(priority_scheduler *owner, rpc_priority priority)
+        : owner_(owner)
+        , priority_(priority) {}
+
+    priority_scheduler *owner_ = nullptr;
+    rpc_priority priority_ = rpc_priority::normal;
+  };
+
+  class schedule_operation {
+  public:
+    auto await_ready() const noexcept -> bool { return false; }
+    auto await_suspend(std::coroutine_handle<> h) -> void { scheduler_.enqueue(priority_, h); }
+    auto await_resume() noexcept -> running { return running(&scheduler_, priority_); }
+
+  private:
+    friend class priority_scheduler;
+    schedule_operation(priority_scheduler &scheduler, rpc_priority priority) noexcept
+        : scheduler_(scheduler)
+        , priority_(priority) {}
+
+    priority_scheduler &scheduler_;
+    rpc_priority priority_;
+  };
+
+  priority_scheduler(std::shared_ptr<cppcoro::static_thread_pool> executor, PriorityConfig config);
+
+  // Resume on a pool thread once every more urgent handler waiting has been started.
+  auto schedule(rpc_priority priority) noexcept -> schedule_operation {
+    return schedule_operation(*this, priority);
+  }
+
+private:
+  static constexpr std::size_t kClasses = 3;
+
+  auto enqueue(rpc_priority priority, std::coroutine_handle<> h) -> void;
+  auto spawn_runner() -> void;
+  // Requires mutex_. Null if nothing may start right now.
+  auto pick() -> std::coroutine_handle<>;
+  auto release(rpc_priority priority) noexcept -> void;
+
+  std::shared_ptr<cppcoro::static_thread_pool> executor_;
+  uint32_t const normal_weight_;
+  uint32_t const low_weight_;
+  // Threads normal and low handlers may occupy together.
+  uint32_t const shared_threads_;
+
+  std::mutex mutex_;
+  std::array<std::deque<std::coroutine_handle<>>, kClasses> waiting_;
+  uint32_t normal_credit_ = 0;
+  uint32_t low_credit_ = 0;
+  uint32_t running_shared_ = 0;
+};
+
+} // namespace coverbs_rpc
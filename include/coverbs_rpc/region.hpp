@@ -0,0 +1,115 @@
+#pragma once
+
+#include "coverbs_rpc/detail/rendezvous.hpp"
+
+#include <atomic>
+#include <cppcoro/task.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <glaze/glaze.hpp>
+#include <memory>
+#include <mutex>
+#include <rdmapp/mr.h>
+#include <rdmapp/pd.h>
+#include <rdmapp/qp.h>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace coverbs_rpc {
+
+namespace detail {
+
+// Leads every published region. `version` is odd while the server rewrites the region; a reader
+// accepts a snapshot only if it saw an even version and the checksum matches the data.
+struct RegionHeader {
+  std::atomic<uint64_t> version;
+  uint64_t length;
+  uint64_t checksum;
+  uint64_t reserved;
+};
+static_assert(sizeof(RegionHeader) == 32);
+
+auto region_checksum(std::span<const std::byte> data) noexcept -> uint64_t;
+
+struct RegionLookupReq {
+  std::string name;
+};
+
+struct RegionLookupResp {
+  bool found;
+  uint64_t addr;
+  uint32_t length;
+  uint32_t rkey;
+};
+
+// Identifies the built-in lookup RPC on the wire; typed_server binds the real implementation.
+auto inline region_lookup(RegionLookupReq const &) -> RegionLookupResp { return {}; }
+
+} // namespace detail
+
+/**
+ * @brief Server memory that clients read with one-sided RDMA READ, without a server thread in
+ * the path.
+ *
+ * Writers are serialized and bracket each update with an odd/even version (a seqlock), so a
+ * remote read racing an update is detected and retried or answered by a normal RPC instead.
+ */
+class published_region {
+public:
+  published_region(rdmapp::pd &pd, std::size_t capacity);
+
+  auto capacity() const noexcept -> std::size_t { return capacity_; }
+
+  // Replaces the region's contents; throws if `data` exceeds capacity().
+  auto publish(std::span<const std::byte> data) -> void;
+
+  template <typename T>
+  auto store(T const &value) -> void {
+    thread_local std::vector<std::byte> scratch;
+    auto ec = glz::write_beve(value, scratch);
+    if (ec) [[unlikely]] {
+      throw std::runtime_error("published_region: failed to serialize value");
+    }
+    publish(std::span{scratch.data(), ec.count});
+  }
+
+  auto descriptor() const noexcept -> detail::RendezvousDesc {
+    return detail::make_rendezvous_desc(mr_);
+  }
+
+private:
+  auto header() noexcept -> detail::RegionHeader & {
+    return *reinterpret_cast<detail::RegionHeader *>(memory_.data());
+  }
+
+  std::size_t const capacity_;
+  std::mutex write_mutex_;
+  std::vector<std::byte> memory_;
+  rdmapp::local_mr mr_;
+};
+
+/**
+ * @brief Client handle on a published_region. Holds a registered landing buffer, so use one
+ * handle per concurrent reader.
+ */
+class remote_region {
+public:
+  remote_region(std::shared_ptr<rdmapp::qp> qp, detail::RendezvousDesc desc);
+
+  /**
+   * @brief Read a consistent snapshot of the region into `out`.
+   *
+   * @return false if the read raced an update (odd version or checksum mismatch).
+   */
+  auto read(std::vector<std::byte> &out) -> cppcoro::task<bool>;
+
+private:
+  std::shared_ptr<rdmapp::qp> qp_;
+  detail::RendezvousDesc desc_;
+  std::vector<std::byte> landing_;
+  rdmapp::local_mr mr_;
+};
+
+} // namespace coverbs_rpc
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "coverbs_rpc/common.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <rdmapp/mr.h>
+#include <rdmapp/pd.h>
+#include <span>
+
+namespace coverbs_rpc {
+
+/**
+ * @brief Registered memory shared by every connection of a client or server.
+ *
+ * Memory is mapped in large chunks, backed by 1 GiB or 2 MiB hugepages when available (falling
+ * back to transparent hugepages), bound to a NUMA node, prefaulted, and registered once. Pools
+ * then carve blocks out of a chunk instead of calling reg_mr per connection.
+ */
+class registered_arena : public std::enable_shared_from_this<registered_arena> {
+  struct chunk;
+
+public:
+  class block {
+  public:
+    block() = default;
+    block(block &&other) noexcept;
+    auto operator=(block &&other) noexcept -> block &;
+    block(block const &) = delete;
+    auto operator=(block const &) -> block & = delete;
+    ~block();
+
+    auto span() const noexcept -> std::span<std::byte> { return {data_, size_}; }
+    auto data() const noexcept -> std::byte * { return data_; }
+    auto size() const noexcept -> std::size_t { return size_; }
+
+    auto view(std::size_t offset, std::size_t length) const -> rdmapp::mr_view;
+
+  private:
+    friend class registered_arena;
+    block(std::shared_ptr<registered_arena> arena, chunk *c, std::size_t offset, std::size_t size);
+    auto reset() noexcept -> void;
+
+    std::shared_ptr<registered_arena> arena_;
+    chunk *chunk_{};
+    std::size_t offset_{};
+    std::size_t size_{};
+    std::byte *data_{};
+  };
+
+  static auto create(std::shared_ptr<rdmapp::pd> pd, MemoryConfig config = {})
+      -> std::shared_ptr<registered_arena>;
+
+  ~registered_arena();
+
+  auto allocate(std::size_t size) -> block;
+
+  auto registered_bytes() const -> std::size_t;
+
+private:
+  registered_arena(std::shared_ptr<rdmapp::pd> pd, MemoryConfig config);
+
+  auto add_chunk(std::size_t min_size) -> chunk &;
+  auto free(chunk *c, std::size_t offset, std::size_t size) -> void;
+
+  std::shared_ptr<rdmapp::pd> pd_;
+  MemoryConfig const config_;
+  mutable std::mutex mutex_;
+  std::list<chunk> chunks_;
+};
+
+/**
+ * @brief NUMA node the RDMA device `device_nr` is attached to, or -1 if unknown.
+ */
+auto nic_numa_node(uint32_t device_nr) -> int;
+
+/**
+ * @brief config.memory, bound to the NIC's NUMA node if config.numa_local asks for it.
+ */
+auto nic_local_memory_config(TypedRpcConfig const &config) -> MemoryConfig;
+
+} // namespace coverbs_rpc
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "coverbs_rpc/common.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace coverbs_rpc {
+
+struct rpc_context;
+
+/**
+ * @brief The replies of at-most-once calls, kept per client by sequence number so that a
+ * retried call is answered with its first reply instead of running its handler again.
+ *
+ * A client's replies are dropped once it acknowledges them (ReplayDesc::acked), once they fall
+ * out of its window, or once it has been idle for client_ttl. A repeat arriving while the first
+ * is still running waits for its reply.
+ */
+class replay_cache {
+  struct client_state;
+
+public:
+  /**
+   * @brief A request's turn at its call: either it runs the handler and records the reply with
+   * complete(), or the reply was already there. Destroyed without complete(), as when the handler
+   * throws, it lets a repeat run the call instead.
+   */
+  class claim {
+  public:
+    claim(claim &&other) noexcept;
+    auto operator=(claim &&) -> claim & = delete;
+    ~claim();
+
+    // Whether this request runs the handler.
+    auto owned() const noexcept -> bool { return state_ != nullptr; }
+
+    auto complete(std::span<const std::byte> reply) -> void;
+
+  private:
+    friend class replay_cache;
+    claim() = default;
+    claim(std::shared_ptr<client_state> state, uint64_t seq) noexcept
+        : state_(std::move(state))
+        , seq_(seq) {}
+
+    std::shared_ptr<client_state> state_;
+    uint64_t seq_ = 0;
+  };
+
+  explicit replay_cache(AtMostOnceConfig config);
+  ~replay_cache();
+
+  /**
+   * @brief Claim the call `id` names. If it ran before, its reply is copied into `resp` (or
+   * ctx.large_resp when it does not fit) and `len` set to its size; a repeat of a call the client
+   * already acknowledged gets an empty reply.
+   */
+  auto acquire(detail::ReplayDesc const &id, std::span<std::byte> resp, rpc_context &ctx,
+               std::size_t &len) -> claim;
+
+  // Requests answered from a recorded reply.
+  auto replayed() const noexcept -> uint64_t { return replayed_.load(std::memory_order_relaxed); }
+
+private:
+  static constexpr std::size_t kShards = 16;
+
+  struct shard {
+    std::mutex mutex;
+    std::unordered_map<uint64_t, std::shared_ptr<client_state>> clients;
+  };
+
+  auto client(uint64_t id) -> std::shared_ptr<client_state>;
+
+  AtMostOnceConfig const config_;
+  std::array<shard, kShards> shards_;
+  std::atomic<uint64_t> replayed_{0};
+};
+
+} // namespace coverbs_rpc
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "coverbs_rpc/detail/hedge_race.hpp"
+#include "coverbs_rpc/typed_client.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cppcoro/async_scope.hpp>
+#include <cppcoro/io_service.hpp>
+#include <cppcoro/operation_cancelled.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace coverbs_rpc {
+
+/**
+ * @brief Calls a service that runs on several interchangeable servers, each through its own
+ * typed_client, sending every call to the replica that looks least loaded: the fewest calls in
+ * flight, weighted by its moving-average latency.
+ *
+ * With hedge.enabled, a call that outlives hedge.percentile of recent ones is sent once more to
+ * the best other replica, and the first answer is returned. The slower copy is not cancelled on
+ * its server, so hedge only idempotent handlers; its answer is dropped when it arrives. At-most-
+ * once records are kept per server and do not span replicas.
+ */
+class replicated_client {
+public:
+  /**
+   * @brief Connect to every replica as typed_client does; throws if any fails to connect.
+   * Timers of pending hedges run on `io_service`, which must keep processing events until the
+   * client is destroyed.
+   */
+  replicated_client(cppcoro::io_service &io_service, std::vector<server_address> const &replicas,
+                    TypedRpcConfig config = {}, HedgeConfig hedge = {});
+
+  // Waits for the slower copies of hedged calls to finish.
+  ~replicated_client();
+
+  /**
+   * @brief Call Handler on the least loaded replica, as typed_client::call. One-way calls are
+   * never hedged.
+   */
+  template <auto Handler>
+  auto call(detail::rpc_req_t<Handler> req, resume_target resume = {})
+      -> cppcoro::task<detail::rpc_resp_t<Handler>> {
+    using Resp = detail::rpc_resp_t<Handler>;
+    std::size_t const primary = pick(kNoReplica);
+    if constexpr (std::is_void_v<Resp>) {
+      co_await timed_call<Handler>(primary, req, resume);
+    } else {
+      auto const delay = hedge_delay();
+      if (!delay) {
+        co_return co_await timed_call<Handler>(primary, req, resume);
+      }
+      auto race = std::make_shared<detail::hedge_race<Resp>>();
+      scope_.spawn(run_copy<Handler>(race, primary, req));
+      scope_.spawn(hedge_after<Handler>(race, *delay, primary, req));
+      co_await race->settled;
+      if (!resume.is_inline()) {
+        co_await resume.hop(resume.scheduler);
+      }
+      co_return race->take();
+    }
+  }
+
+  auto size() const noexcept -> std::size_t { return replicas_.size(); }
+  auto replica(std::size_t i) noexcept -> typed_client & { return *replicas_[i]->client; }
+
+  // Calls replica i is answering right now, hedge copies included.
+  auto in_flight(std::size_t i) const noexcept -> uint32_t {
+    return replicas_[i]->in_flight.load(std::memory_order_relaxed);
+  }
+
+  // Replica i's moving-average call latency; zero until it has answered.
+  auto latency(std::size_t i) const noexcept -> std::chrono::nanoseconds {
+    return std::chrono::nanoseconds(replicas_[i]->latency_ns.load(std::memory_order_relaxed));
+  }
+
+  // Hedge copies sent so far.
+  auto hedged() const noexcept -> uint64_t { return hedged_.load(std::memory_order_relaxed); }
+
+private:
+  static constexpr std::size_t kNoReplica = SIZE_MAX;
+
+  struct replica_state {
+    std::unique_ptr<typed_client> client;
+    std::atomic<uint32_t> in_flight{0};
+    std::atomic<int64_t> latency_ns{0};
+  };
+
+  // The least loaded replica other than `exclude`.
+  auto pick(std::size_t exclude) noexcept -> std::size_t;
+  auto hedge_delay() const noexcept -> std::optional<std::chrono::nanoseconds>;
+  // Account for a call replica i finished, started at `start`.
+  auto finish(std::size_t i, std::chrono::steady_clock::time_point start, bool ok) -> void;
+
+  template <auto Handler>
+  auto timed_call(std::size_t i, detail::rpc_req_t<Handler> const &req, resume_target resume)
+      -> cppcoro::task<detail::rpc_resp_t<Handler>> {
+    auto &target = *replicas_[i];
+    target.in_flight.fetch_add(1, std::memory_order_relaxed);
+    auto const start = std::chrono::steady_clock::now();
+    try {
+      if constexpr (std::is_void_v<detail::rpc_resp_t<Handler>>) {
+        co_await target.client->call<Handler>(req, resume);
+        finish(i, start, true);
+      } else {
+        auto resp = co_await target.client->call<Handler>(req, resume);
+        finish(i, start, true);
+        co_return resp;
+      }
+    } catch (...) {
+      finish(i, start, false);
+      throw;
+    }
+  }
+
+  template <auto Handler>
+  auto run_copy(std::shared_ptr<detail::hedge_race<detail::rpc_resp_t<Handler>>> race,
+                std::size_t i, detail::rpc_req_t<Handler> req) -> cppcoro::task<void> {
+    try {
+      race->win(co_await timed_call<Handler>(i, req, {}));
+    } catch (...) {
+      race->lose(std::current_exception());
+    }
+  }
+
+  template <auto Handler>
+  auto hedge_after(std::shared_ptr<detail::hedge_race<detail::rpc_resp_t<Handler>>> race,
+                   std::chrono::nanoseconds delay, std::size_t primary,
+                   detail::rpc_req_t<Handler> req) -> cppcoro::task<void> {
+    try {
+      co_await io_service_.schedule_after(delay, race->pending_hedge.token());
+    } catch (const cppcoro::operation_cancelled &) {
+      co_return;
+    }
+    if (!race->join()) {
+      co_return;
+    }
+    hedged_.fetch_add(1, std::memory_order_relaxed);
+    co_await run_copy<Handler>(std::move(race), pick(primary), std::move(req));
+  }
+
+  HedgeConfig const hedge_;
+  cppcoro::io_service &io_service_;
+  std::vector<std::unique_ptr<replica_state>> replicas_;
+  // Where the next pick starts scanning, so that equally loaded replicas take turns.
+  std::atomic<std::size_t> cursor_{0};
+  std::atomic<uint64_t> hedged_{0};
+
+  // Recent call latencies, for the hedge delay.
+  std::mutex samples_mutex_;
+  std::vector<int64_t> samples_;
+  std::size_t samples_seen_ = 0;
+  // hedge.percentile of samples_, refreshed every sixteenth of the window; negative before.
+  std::atomic<int64_t> hedge_delay_ns_{-1};
+
+  // Copies of hedged calls still running, the caller possibly gone.
+  cppcoro::async_scope scope_;
+};
+
+} // namespace coverbs_rpc
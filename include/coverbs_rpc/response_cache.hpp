@@ -0,0 +1,97 @@
+#pragma once
+
+#include "coverbs_rpc/common.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace coverbs_rpc {
+
+/**
+ * @brief When a cacheable function's stored responses stop being valid.
+ */
+struct cache_policy {
+  // Age at which a response is dropped; zero keeps it until evicted or outdated by `version`.
+  std::chrono::microseconds ttl{0};
+  // Read on every call; responses stored under another version are not served. Null when the
+  // function's responses never go stale.
+  std::function<uint64_t()> version;
+};
+
+/**
+ * @brief Serialized responses of idempotent handlers, keyed by fn_id and the request's bytes, so
+ * a repeated request is answered with a copy instead of running the handler again.
+ *
+ * Split into independently locked shards, each a bounded LRU list. Only cache functions whose
+ * response depends on nothing but the request (and what `version` tracks).
+ */
+class response_cache {
+public:
+  explicit response_cache(ResponseCacheConfig config);
+  ~response_cache();
+
+  // Cache fn_id's responses under `policy`. Call before serving.
+  auto set_policy(uint32_t fn_id, cache_policy policy) -> void;
+
+  // fn_id's policy; null if its responses are not cached.
+  auto policy(uint32_t fn_id) const -> cache_policy const * {
+    auto it = policies_.find(fn_id);
+    return it != policies_.end() ? &it->second : nullptr;
+  }
+
+  /**
+   * @brief Copy the response stored for `req` under `version` into `out` and return its size,
+   * or nothing if there is no such response or it does not fit.
+   */
+  auto lookup(uint32_t fn_id, std::span<const std::byte> req, uint64_t version,
+              std::span<std::byte> out) -> std::optional<std::size_t>;
+
+  // Keep `resp` as the response to `req` under `version`, for as long as fn_id's policy allows.
+  auto store(uint32_t fn_id, std::span<const std::byte> req, uint64_t version,
+             std::span<const std::byte> resp) -> void;
+
+  auto hits() const noexcept -> uint64_t { return hits_.load(std::memory_order_relaxed); }
+  auto misses() const noexcept -> uint64_t { return misses_.load(std::memory_order_relaxed); }
+
+private:
+  struct entry {
+    std::string key;
+    std::vector<std::byte> resp;
+    uint64_t version;
+    std::chrono::steady_clock::time_point expires;
+  };
+
+  struct shard {
+    std::mutex mutex;
+    // Most recently used first.
+    std::list<entry> lru;
+    // Keys view the entries' own.
+    std::unordered_map<std::string_view, std::list<entry>::iterator> index;
+    std::size_t bytes = 0;
+  };
+
+  // Builds the key in a per-thread buffer and picks its shard.
+  auto locate(uint32_t fn_id, std::span<const std::byte> req)
+      -> std::pair<shard &, std::string_view>;
+  auto erase(shard &s, std::list<entry>::iterator it) -> void;
+
+  std::size_t const shard_bytes_;
+  std::vector<std::unique_ptr<shard>> shards_;
+  std::unordered_map<uint32_t, cache_policy> policies_;
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+};
+
+} // namespace coverbs_rpc
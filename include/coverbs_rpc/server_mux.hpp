@@ -1,25 +1,144 @@
 #pragma once
 
+#include "coverbs_rpc/common.hpp"
+#include "coverbs_rpc/session.hpp"
+
+#include <concepts>
+#include <cppcoro/async_generator.hpp>
 #include <cstdint>
 #include <functional>
 #include <map>
+#include <memory>
+#include <optional>
 #include <span>
 #include <string_view>
+#include <type_traits>
+#include <vector>
 
 namespace coverbs_rpc {
 
+class replay_cache;
+class response_cache;
+
+/**
+ * @brief Per-request state handed to handlers alongside the request payload.
+ */
+struct rpc_context {
+  // A handler whose response does not fit the registered send slot writes it here instead and
+  // returns its size; the server then ships it through the rendezvous path.
+  std::vector<std::byte> large_resp;
+
+  // Bulk calls only. bulk_in holds the client's buffer when it granted read access. With write
+  // access, bulk_out is registered memory the size of that buffer: the handler fills it and sets
+  // bulk_written, and those bytes are written straight into the client's buffer before the
+  // response is sent. With both, the two view the same memory, so it can be updated in place.
+  std::span<const std::byte> bulk_in;
+  std::span<std::byte> bulk_out;
+  std::size_t bulk_written = 0;
+
+  // The connection the request came in on; null when the server was given no session.
+  rpc_session *session = nullptr;
+
+  // At-most-once calls: the client and sequence number the request was sent under.
+  std::optional<detail::ReplayDesc> replay;
+  // Set instead of a response when the call was a repeat the server could no longer answer.
+  std::optional<detail::failure_reason> failure;
+};
+
 class basic_mux {
 public:
-  using Handler =
-      std::function<std::size_t(std::span<std::byte> payload, std::span<std::byte> resp)>;
+  using Handler = std::function<std::size_t(std::span<std::byte> payload,
+                                            std::span<std::byte> resp, rpc_context &ctx)>;
 
   auto register_handler(uint32_t fn_id, std::string_view fn_name, Handler h) -> void;
 
-  auto dispatch(uint32_t fn_id, std::span<std::byte> payload, std::span<std::byte> resp) const
-      -> std::size_t;
+  template <typename F>
+    requires std::is_invocable_r_v<std::size_t, F &, std::span<std::byte>, std::span<std::byte>>
+  auto register_handler(uint32_t fn_id, std::string_view fn_name, F f) -> void {
+    register_handler(fn_id, fn_name,
+                     Handler([f = std::move(f)](std::span<std::byte> payload,
+                                                std::span<std::byte> resp, rpc_context &) mutable {
+                       return f(payload, resp);
+                     }));
+  }
+
+  /**
+   * @brief Server-streaming handler: yields the serialized items of its response one by one. An
+   * item only has to stay valid until the generator is resumed again.
+   */
+  using StreamHandler =
+      std::function<cppcoro::async_generator<std::span<const std::byte>>(std::span<std::byte>)>;
+
+  auto register_stream_handler(uint32_t fn_id, std::string_view fn_name, StreamHandler h) -> void;
+
+  // Class fn_id's handlers are started with when the server schedules by priority.
+  auto set_priority(uint32_t fn_id, rpc_priority priority) -> void;
+  auto priority(uint32_t fn_id) const -> rpc_priority;
+
+  /**
+   * @brief One method of a compile-time service: the fn_id it also answers to, and a function
+   * that runs it on the service's instance.
+   */
+  struct method_entry {
+    uint32_t fn_id;
+    // Null for methods only reachable by fn_id, such as streams.
+    std::size_t (*invoke)(void *instance, std::span<std::byte> payload, std::span<std::byte> resp,
+                          rpc_context &ctx);
+  };
+
+  /**
+   * @brief Serve requests carrying a method index through `methods`, indexed directly; the table
+   * must outlive the mux. Its methods are registered by fn_id separately.
+   */
+  auto register_service(std::span<method_entry const> methods, void *instance) -> void;
+
+  /**
+   * @brief Answer requests for the functions `cache` holds a policy for from it when they repeat
+   * one it has a response to. Call before serving.
+   */
+  auto set_cache(std::shared_ptr<response_cache> cache) -> void;
+
+  /**
+   * @brief Run each request carrying a ReplayDesc at most once, answering its repeats from
+   * `replay`. Call before serving.
+   */
+  auto set_replay(std::shared_ptr<replay_cache> replay) -> void;
+
+  auto dispatch(uint32_t fn_id, std::span<std::byte> payload, std::span<std::byte> resp,
+                rpc_context &ctx) const -> std::size_t;
+
+  // As above, but through a service's table when the request names a method index it matches.
+  auto dispatch(detail::RpcHeader const &header, std::span<std::byte> payload,
+                std::span<std::byte> resp, rpc_context &ctx) const -> std::size_t;
+
+  // Throws if no stream handler is registered under fn_id, so the stream is aborted rather than
+  // ending as if it were empty.
+  auto open_stream(uint32_t fn_id, std::span<std::byte> payload) const
+      -> cppcoro::async_generator<std::span<const std::byte>>;
 
 private:
+  auto invoke(uint32_t fn_id, std::span<std::byte> payload, std::span<std::byte> resp,
+              rpc_context &ctx) const -> std::size_t;
+  // Runs `run` unless the cache has fn_id's response to `payload`, and caches what it returns.
+  template <typename Run>
+  auto through_cache(uint32_t fn_id, std::span<std::byte> payload, std::span<std::byte> resp,
+                     rpc_context &ctx, Run &&run) const -> std::size_t;
+  // Runs `run` unless the at-most-once call in ctx.replay already ran, and records its reply.
+  template <typename Run>
+  auto through_replay(std::span<std::byte> resp, rpc_context &ctx, Run &&run) const
+      -> std::size_t;
+
   std::map<uint32_t, Handler> handlers_;
+  std::map<uint32_t, StreamHandler> stream_handlers_;
+  std::map<uint32_t, rpc_priority> priorities_;
+
+  struct registered_service {
+    std::span<method_entry const> methods;
+    void *instance;
+  };
+  std::vector<registered_service> services_;
+  std::shared_ptr<response_cache> cache_;
+  std::shared_ptr<replay_cache> replay_;
 };
 
 } // namespace coverbs_rpc
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "coverbs_rpc/common.hpp"
+#include "coverbs_rpc/detail/traits.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace coverbs_rpc {
+
+/**
+ * @brief A service interface fixed at compile time: the handlers it lists, all free functions or
+ * all members of one class, each indexed by its position in the list.
+ *
+ * Declare one as `using kv_service = service<&kv::get, &kv::put>;`, serve it with
+ * typed_server::serve<kv_service>(&store) and call it through typed_client::stub<kv_service>().
+ * Calls carry the method's index, so the server runs them straight from a table instead of
+ * looking their fn_id up. Reordering the list changes the indices, so clients and servers must
+ * agree on it; a mismatch is caught by the fn_id check and falls back to the lookup.
+ */
+template <auto... Methods>
+struct service {
+  static constexpr std::size_t size = sizeof...(Methods);
+  static_assert(size > 0, "a service needs at least one method");
+  static_assert(size <= detail::kMaxServiceMethods, "too many methods to index");
+
+  static constexpr std::array<uint32_t, size> ids{detail::function_id<Methods>...};
+
+  static constexpr bool distinct = [] {
+    for (std::size_t i = 0; i < size; ++i) {
+      for (std::size_t j = i + 1; j < size; ++j) {
+        if (ids[i] == ids[j]) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }();
+  static_assert(distinct, "a service lists each method once");
+
+  template <auto Method>
+  static constexpr std::size_t index_of = [] {
+    for (std::size_t i = 0; i < size; ++i) {
+      if (ids[i] == detail::function_id<Method>) {
+        return i;
+      }
+    }
+    return size;
+  }();
+
+  template <auto Method>
+  static constexpr bool contains = index_of<Method> < size;
+
+  // How a client names Method when calling it through this service.
+  template <auto Method>
+  static constexpr auto method() noexcept -> rpc_method {
+    static_assert(contains<Method>, "Method is not part of this service");
+    return {detail::function_id<Method>, static_cast<uint32_t>(index_of<Method>)};
+  }
+};
+
+} // namespace coverbs_rpc
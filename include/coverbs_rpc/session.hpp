@@ -0,0 +1,53 @@
+#pragma once
+
+#include "coverbs_rpc/common.hpp"
+
+#include <any>
+#include <cstdint>
+#include <utility>
+
+namespace coverbs_rpc {
+
+/**
+ * @brief State that lives as long as one client connection, handed to handlers taking
+ * (const Req &, rpc_session &).
+ *
+ * Keep per-connection data such as an authenticated principal, caches or prepared statements in
+ * its state slot instead of in a global map keyed by connection. Fill the slot from
+ * typed_server::on_session_open: handlers of one connection may run concurrently, so whatever
+ * they change in the state must be safe to share between them.
+ */
+class rpc_session {
+public:
+  rpc_session(uint64_t id, transport_kind transport) noexcept
+      : id_(id)
+      , transport_(transport) {}
+
+  rpc_session(rpc_session const &) = delete;
+  auto operator=(rpc_session const &) -> rpc_session & = delete;
+
+  // Unique among the sessions of one server.
+  auto id() const noexcept -> uint64_t { return id_; }
+  auto transport() const noexcept -> transport_kind { return transport_; }
+
+  // Replace the state slot's contents with a T built from `args`.
+  template <typename T, typename... Args>
+  auto emplace_state(Args &&...args) -> T & {
+    return state_.emplace<T>(std::forward<Args>(args)...);
+  }
+
+  // The state slot's contents; null if it is empty or holds something other than a T.
+  template <typename T>
+  auto state() noexcept -> T * {
+    return std::any_cast<T>(&state_);
+  }
+
+  auto reset_state() noexcept -> void { state_.reset(); }
+
+private:
+  uint64_t const id_;
+  transport_kind const transport_;
+  std::any state_;
+};
+
+} // namespace coverbs_rpc
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "coverbs_rpc/detail/hash_ring.hpp"
+#include "coverbs_rpc/typed_client.hpp"
+
+#include <atomic>
+#include <cppcoro/io_service.hpp>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace coverbs_rpc {
+
+/**
+ * @brief Calls a service whose data is partitioned across servers, routing each call by a key
+ * taken from its request over a consistent-hash ring with virtual nodes (see ShardingConfig).
+ *
+ * Every shard connection goes through one client_resources, so the device, protection domain,
+ * registered memory and, with a shared config.cq_policy, the CQs and their pollers are opened
+ * once for all shards. Routing a call costs a hash of its key and a table lookup.
+ */
+class sharded_client {
+public:
+  /**
+   * @brief Connect to every shard as typed_client does; throws if any fails to connect.
+   */
+  sharded_client(cppcoro::io_service &io_service, std::vector<server_address> const &shards,
+                 TypedRpcConfig config = {}, ShardingConfig sharding = {});
+  ~sharded_client();
+
+  /**
+   * @brief Call Handler on the shard owning KeyOf(req), as typed_client::call. KeyOf maps the
+   * request to an integer or a string, e.g. `[](PutReq const &r) { return r.key; }`.
+   */
+  template <auto Handler, auto KeyOf>
+  auto call(detail::rpc_req_t<Handler> req, resume_target resume = {})
+      -> cppcoro::task<detail::rpc_resp_t<Handler>> {
+    uint64_t const hash = detail::shard_hash(KeyOf(std::as_const(req)));
+    return call_hashed<Handler>(hash, std::move(req), resume);
+  }
+
+  // Call Handler on the shard owning `key`.
+  template <auto Handler>
+  auto call_key(auto const &key, detail::rpc_req_t<Handler> req, resume_target resume = {})
+      -> cppcoro::task<detail::rpc_resp_t<Handler>> {
+    return call_hashed<Handler>(detail::shard_hash(key), std::move(req), resume);
+  }
+
+  /**
+   * @brief Rebalance onto a new membership: connect the shards not yet in it, then route over a
+   * ring of `shards`. Keys move only to or from the shards that joined or left. A shard that left
+   * is disconnected, at this or a later change, once the calls routed to it have finished.
+   * Throws, leaving routing as it was, if a new shard fails to connect.
+   */
+  auto set_members(std::vector<server_address> const &shards) -> void;
+
+  auto members() const -> std::vector<server_address>;
+
+  // The shard a key is routed to right now.
+  auto owner(auto const &key) const -> server_address {
+    ring const *r = ring_.load();
+    return r->shards[r->table.owner(detail::shard_hash(key))]->address;
+  }
+
+private:
+  struct shard {
+    server_address address;
+    // Null once it has left the ring and its calls have finished.
+    std::unique_ptr<typed_client> client;
+    std::atomic<uint32_t> in_flight{0};
+  };
+
+  struct ring {
+    detail::hash_ring table;
+    std::vector<shard *> shards;
+  };
+
+  // Holds a shard connected for the duration of a call.
+  class lease {
+  public:
+    explicit lease(shard &s) noexcept
+        : shard_(s) {}
+    lease(lease const &) = delete;
+    auto operator=(lease const &) -> lease & = delete;
+    ~lease() { shard_.in_flight.fetch_sub(1); }
+
+    auto client() const noexcept -> typed_client & { return *shard_.client; }
+
+  private:
+    shard &shard_;
+  };
+
+  auto acquire(uint64_t hash) noexcept -> shard & {
+    while (true) {
+      ring const *r = ring_.load();
+      shard *s = r->shards[r->table.owner(hash)];
+      // Counted before checking that the ring is still current: set_members publishes a ring
+      // before reading the counts of the shards that left it, so it either sees this call or
+      // this call sees the new ring.
+      s->in_flight.fetch_add(1);
+      if (ring_.load() == r) [[likely]] {
+        return *s;
+      }
+      s->in_flight.fetch_sub(1);
+    }
+  }
+
+  template <auto Handler>
+  auto call_hashed(uint64_t hash, detail::rpc_req_t<Handler> req, resume_target resume)
+      -> cppcoro::task<detail::rpc_resp_t<Handler>> {
+    lease held(acquire(hash));
+    co_return co_await held.client().call<Handler>(req, resume);
+  }
+
+  TypedRpcConfig config_;
+  ShardingConfig const sharding_;
+  cppcoro::io_service &io_service_;
+  // Null when connecting without RDMA.
+  std::shared_ptr<client_resources> rdma_;
+
+  mutable std::mutex membership_mutex_;
+  // Every shard and ring ever routed over; callers may still be reading an old ring, so they
+  // stay allocated until the client is destroyed. Membership changes are rare.
+  std::vector<std::unique_ptr<shard>> shards_;
+  std::vector<std::unique_ptr<ring>> rings_;
+  // Shards that left the ring but may still have calls running.
+  std::vector<shard *> leaving_;
+  std::atomic<ring const *> ring_{nullptr};
+};
+
+} // namespace coverbs_rpc
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "coverbs_rpc/common.hpp"
+#include "coverbs_rpc/message_channel.hpp"
+#include "coverbs_rpc/shm/ring.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stop_token>
+#include <string_view>
+
+namespace coverbs_rpc::shm {
+
+/**
+ * @brief One connection over shared memory: a mapped segment holding a ring per direction.
+ *
+ * The segment is an anonymous memfd the server creates and hands to the client over a Unix
+ * socket; the socket stays open for the life of the connection so either side notices when the
+ * other goes away. Concurrent sends are serialized, so each ring keeps a single producer.
+ */
+class channel final : public message_channel {
+public:
+  enum class side : uint8_t { client, server };
+
+  channel(int sock, std::byte *base, std::size_t map_len, std::size_t ring_size, side s);
+  ~channel() override;
+
+  channel(channel const &) = delete;
+  auto operator=(channel const &) -> channel & = delete;
+
+  auto send(std::span<const std::byte> header, std::span<const std::byte> payload,
+            WaitPolicy const &wait) -> void override;
+
+  // busy_poll spins throughout; hybrid spins for the spin budget, then parks on the ring's futex.
+  auto receive(on_message_fn const &on_message, WaitPolicy const &wait,
+               std::stop_token const &stop) -> bool override;
+
+  auto close() noexcept -> void override;
+
+  auto max_message() const noexcept -> std::size_t override { return outbound_.max_record(); }
+
+  // False once either side closed the connection or the peer process went away.
+  auto alive() noexcept -> bool;
+
+private:
+  static constexpr uint64_t kCheckStride = 1024;
+  // A parked receiver wakes this often to notice a stop request or a vanished peer.
+  static constexpr std::chrono::milliseconds kParkTimeout{50};
+
+  int sock_;
+  std::byte *base_;
+  std::size_t map_len_;
+  side side_;
+  spsc_ring inbound_;
+  spsc_ring outbound_;
+  std::mutex send_mutex_;
+};
+
+/**
+ * @brief Server side: listens on an abstract Unix socket named after the RDMA port, so a local
+ * client finds it knowing only the address it would have dialled anyway.
+ */
+class listener {
+public:
+  listener(uint16_t port, std::size_t ring_size);
+  ~listener();
+
+  listener(listener const &) = delete;
+  auto operator=(listener const &) -> listener & = delete;
+
+  // Blocks for the next client; null once close() was called. A client whose handshake fails
+  // is logged and dropped, and accept() waits for the next one.
+  auto accept() -> std::unique_ptr<channel>;
+
+  auto close() noexcept -> void;
+
+private:
+  // Sets up the shared segment for an accepted socket and sends it over; throws on failure.
+  auto handshake(int conn) -> std::unique_ptr<channel>;
+
+  int sock_;
+  std::size_t ring_size_;
+  std::atomic<bool> closed_{false};
+};
+
+/**
+ * @brief Client side: connect to a server on this host listening for `port`, or null if there
+ * is none.
+ */
+auto connect(uint16_t port) -> std::unique_ptr<channel>;
+
+/**
+ * @brief Whether `hostname` names this machine: loopback, or an address of a local interface.
+ */
+auto is_local_host(std::string_view hostname) -> bool;
+
+} // namespace coverbs_rpc::shm
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+namespace coverbs_rpc::shm {
+
+/**
+ * @brief Control block of an SPSC ring living in shared memory.
+ *
+ * head and tail are running byte offsets, so head == tail means empty and the pair never has to
+ * distinguish "full" from "empty". Each sits on its own cache line; `seq` is the futex word a
+ * parked consumer sleeps on.
+ */
+struct ring_header {
+  alignas(64) std::atomic<uint64_t> tail;
+  alignas(64) std::atomic<uint64_t> head;
+  alignas(64) std::atomic<uint32_t> seq;
+  std::atomic<uint32_t> waiting;
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+static_assert(sizeof(ring_header) == 192);
+
+/**
+ * @brief Single-producer single-consumer ring of variable-length records over shared memory.
+ *
+ * A view: the memory belongs to whoever mapped it, and either process may construct a view of
+ * the same ring. Records are a 4-byte length followed by the bytes, padded to 8; a record never
+ * straddles the end of the ring, the producer writes a wrap marker and starts over at offset 0
+ * instead.
+ */
+class spsc_ring {
+public:
+  static constexpr std::size_t kHeaderSize = 256;
+
+  // Bytes of shared memory a ring with `capacity` bytes of records occupies.
+  static constexpr auto footprint(std::size_t capacity) noexcept -> std::size_t {
+    return kHeaderSize + capacity;
+  }
+
+  /**
+   * @param base Start of the ring's memory, footprint(capacity) bytes.
+   * @param capacity Power of two.
+   */
+  spsc_ring(std::byte *base, std::size_t capacity) noexcept;
+
+  // Initializes a freshly mapped ring; exactly one side calls this, before either side uses it.
+  static auto init(std::byte *base) noexcept -> void;
+
+  // The largest record the ring accepts, so that a wrap can never leave it unable to fit.
+  auto max_record() const noexcept -> std::size_t { return capacity_ / 2 - kLenSize; }
+
+  /**
+   * @brief Producer: append one record made of `first` followed by `second`.
+   * @return false if the ring is too full right now.
+   */
+  auto try_push(std::span<const std::byte> first, std::span<const std::byte> second) noexcept
+      -> bool;
+
+  /**
+   * @brief Consumer: hand the oldest record to `f` in place, then release it.
+   * @return false if the ring is empty.
+   */
+  template <typename F>
+  auto try_pop(F &&f) -> bool {
+    while (true) {
+      if (head_ == tail_cache_) {
+        tail_cache_ = header_->tail.load(std::memory_order_acquire);
+        if (head_ == tail_cache_) {
+          return false;
+        }
+      }
+      std::size_t const pos = head_ & (capacity_ - 1);
+      uint32_t len;
+      std::memcpy(&len, data_ + pos, sizeof(len));
+      if (len == kWrapMarker) {
+        head_ += capacity_ - pos;
+        continue;
+      }
+      f(std::span<std::byte>(data_ + pos + kLenSize, len));
+      head_ += record_size(len);
+      header_->head.store(head_, std::memory_order_release);
+      return true;
+    }
+  }
+
+  // Producer: wake the consumer if it is parked.
+  auto notify() noexcept -> void;
+
+  // Consumer: park until notified or `timeout` passes, unless a record is already waiting.
+  auto wait(std::chrono::milliseconds timeout) noexcept -> void;
+
+  auto empty() const noexcept -> bool {
+    return header_->tail.load(std::memory_order_acquire) == head_;
+  }
+
+private:
+  static constexpr std::size_t kLenSize = sizeof(uint32_t);
+  static constexpr uint32_t kWrapMarker = UINT32_MAX;
+
+  static constexpr auto record_size(std::size_t len) noexcept -> std::size_t {
+    return (kLenSize + len + 7) & ~std::size_t{7};
+  }
+
+  ring_header *header_;
+  std::byte *data_;
+  std::size_t capacity_;
+  // Each side's own offset, plus a cached copy of the other side's to avoid touching its line.
+  uint64_t head_;
+  uint64_t tail_;
+  uint64_t head_cache_;
+  uint64_t tail_cache_;
+};
+
+} // namespace coverbs_rpc::shm
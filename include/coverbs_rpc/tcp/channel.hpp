@@ -0,0 +1,95 @@
+#pragma once
+
+#include "coverbs_rpc/common.hpp"
+#include "coverbs_rpc/message_channel.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+namespace coverbs_rpc::tcp {
+
+/**
+ * @brief One connection over a kernel TCP socket, for hosts without a usable RDMA NIC.
+ *
+ * The stream is a plain sequence of RpcHeader-framed messages; payload_len is the length prefix.
+ * Both directions batch. Senders append to a pending buffer, and whichever finds no flush in
+ * progress writes everything queued so far with a single send(). The receiver reads as much as
+ * the socket holds per recv() and delivers every complete frame in it.
+ */
+class channel final : public message_channel {
+public:
+  explicit channel(int sock);
+  ~channel() override;
+
+  channel(channel const &) = delete;
+  auto operator=(channel const &) -> channel & = delete;
+
+  auto send(std::span<const std::byte> header, std::span<const std::byte> payload,
+            WaitPolicy const &wait) -> void override;
+
+  // busy_poll retries the non-blocking read; hybrid does so for the spin budget, then blocks in
+  // poll().
+  auto receive(on_message_fn const &on_message, WaitPolicy const &wait,
+               std::stop_token const &stop) -> bool override;
+
+  auto close() noexcept -> void override;
+
+  auto max_message() const noexcept -> std::size_t override { return kMaxMessage; }
+
+private:
+  static constexpr std::size_t kMaxMessage = std::size_t{1} << 30;
+  static constexpr std::size_t kReadChunk = 64 * 1024;
+  // Senders wait while this much is queued, so a stalled peer cannot grow the buffer unbounded.
+  static constexpr std::size_t kMaxPending = 16ul << 20;
+  static constexpr std::chrono::milliseconds kParkTimeout{50};
+
+  // Hands every complete frame in the read buffer to `on_message`; false if there was none.
+  auto deliver(on_message_fn const &on_message) -> bool;
+  auto write_all(std::span<const std::byte> bytes) -> bool;
+
+  int sock_;
+  std::atomic<bool> closed_{false};
+
+  std::mutex send_mutex_;
+  std::vector<std::byte> pending_;
+  std::vector<std::byte> flushing_buf_;
+  bool flushing_ = false;
+
+  std::vector<std::byte> read_buf_;
+  std::size_t read_begin_ = 0;
+  std::size_t read_end_ = 0;
+};
+
+/**
+ * @brief Server side: a listening TCP socket on all interfaces.
+ */
+class listener {
+public:
+  explicit listener(uint16_t port);
+  ~listener();
+
+  listener(listener const &) = delete;
+  auto operator=(listener const &) -> listener & = delete;
+
+  // Blocks for the next client; null once close() was called.
+  auto accept() -> std::unique_ptr<channel>;
+
+  auto close() noexcept -> void;
+
+private:
+  int sock_;
+  std::atomic<bool> closed_{false};
+};
+
+/**
+ * @brief Client side: connect to hostname:port, or null if nothing accepts there.
+ */
+auto connect(std::string_view hostname, uint16_t port) -> std::unique_ptr<channel>;
+
+} // namespace coverbs_rpc::tcp
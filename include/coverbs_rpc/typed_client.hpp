@@ -3,26 +3,121 @@
 #include "coverbs_rpc/basic_client.hpp"
 #include "coverbs_rpc/conn/connector.hpp"
 #include "coverbs_rpc/detail/traits.hpp"
+#include "coverbs_rpc/message_client.hpp"
+#include "coverbs_rpc/region.hpp"
+#include "coverbs_rpc/service.hpp"
 
 #include <cppcoro/io_service.hpp>
 #include <cppcoro/sync_wait.hpp>
 #include <glaze/glaze.hpp>
 #include <memory>
+#include <optional>
 #include <stdexcept>
+#include <string>
 #include <vector>
 
 namespace coverbs_rpc {
 
+template <typename Resp>
+struct bulk_response {
+  Resp resp;
+  // Bytes the server wrote into the bulk region.
+  std::size_t bulk_len;
+};
+
+struct server_address {
+  std::string hostname;
+  uint16_t port;
+};
+
+/**
+ * @brief RDMA state that clients of many servers share: one device context and protection
+ * domain, one connector whose CQs and pollers are shared as config.cq_policy says, and one
+ * registered arena growing in shared_chunk_size chunks.
+ */
+struct client_resources {
+  // Throws if the device cannot be opened.
+  static auto open(cppcoro::io_service &io_service, TypedRpcConfig const &config)
+      -> std::shared_ptr<client_resources>;
+
+  std::shared_ptr<rdmapp::device> device;
+  std::shared_ptr<rdmapp::pd> pd;
+  std::unique_ptr<qp_connector> connector;
+  std::shared_ptr<registered_arena> arena;
+};
+
 class typed_client {
 public:
+  /**
+   * @brief Connect to the typed_server at hostname:port: over shared memory when it runs on
+   * this host, else over RDMA, else over TCP (see TypedRpcConfig). Throws if none connects.
+   *
+   * @param shared RDMA state to connect through instead of opening the device for this client
+   * alone; see client_resources.
+   */
   typed_client(cppcoro::io_service &io_service, std::string_view hostname, uint16_t port,
-               TypedRpcConfig config = {});
+               TypedRpcConfig config = {}, std::shared_ptr<client_resources> shared = nullptr);
 
+  /**
+   * @brief Call Handler remotely. Handlers returning void are one-way: the call completes once
+   * the request is sent and the server replies with nothing. Throws deadline_exceeded when the
+   * server drops the call for outliving config.deadline, and server_overloaded when it sheds it.
+   *
+   * @param resume Where deserialization and the caller's continuation run; pass
+   * resume_on(pool) to keep them off the completion thread.
+   */
   template <auto Handler>
-  auto call(auto &&req) -> cppcoro::task<detail::rpc_resp_t<Handler>> {
+  auto call(auto &&req, resume_target resume = {}) -> cppcoro::task<detail::rpc_resp_t<Handler>> {
+    return call_method<Handler>(detail::function_id<Handler>, std::forward<decltype(req)>(req),
+                                resume);
+  }
+
+  /**
+   * @brief Calls Service's methods by their index, which the server dispatches from a table when
+   * it serves Service (see typed_server::serve). Valid while the client is.
+   */
+  template <typename Service>
+  class service_stub {
+  public:
+    explicit service_stub(typed_client &client) noexcept
+        : client_(client) {}
+
+    // As typed_client::call<Method>, for a Method of Service.
+    template <auto Method>
+    auto call(auto &&req, resume_target resume = {})
+        -> cppcoro::task<detail::rpc_resp_t<Method>> {
+      return client_.call_method<Method>(Service::template method<Method>(),
+                                         std::forward<decltype(req)>(req), resume);
+    }
+
+  private:
+    typed_client &client_;
+  };
+
+  template <typename Service>
+  auto stub() noexcept -> service_stub<Service> {
+    return service_stub<Service>(*this);
+  }
+
+  auto transport() const noexcept -> transport_kind { return transport_; }
+
+  /**
+   * @brief Protection domain of this client's connection; register bulk regions with it. Null
+   * unless connected over RDMA.
+   */
+  auto pd() const noexcept -> std::shared_ptr<rdmapp::pd> const & { return pd_; }
+
+  /**
+   * @brief Call Handler with `bulk` exposed for one-sided access. The handler takes
+   * (const Req &, rpc_context &) and finds the region's contents in ctx.bulk_in (read access)
+   * and/or fills ctx.bulk_out and sets ctx.bulk_written (write access); nothing is copied through
+   * message slots.
+   */
+  template <auto Handler>
+  auto call_bulk(detail::rpc_req_t<Handler> const &req, bulk_region bulk, resume_target resume = {})
+      -> cppcoro::task<bulk_response<detail::rpc_resp_t<Handler>>> {
     using Resp = detail::rpc_resp_t<Handler>;
-    using Req = detail::rpc_req_t<Handler>;
-    static_assert(std::same_as<Req, std::decay_t<decltype(req)>>);
+    static_assert(detail::is_with_context_v<Handler>, "bulk handlers take an rpc_context &");
     constexpr uint32_t fn_id = detail::function_id<Handler>;
 
     std::vector<std::byte> send_buffer(config_.max_req_payload);
@@ -30,29 +125,165 @@ public:
     if (ec) [[unlikely]] {
       throw std::runtime_error("typed_client: failed to serialize request");
     }
-    std::size_t req_size = ec.count;
 
     std::vector<std::byte> recv_buffer(config_.max_resp_payload);
-    std::size_t resp_size =
-        co_await client_->call(fn_id, std::span{send_buffer.data(), req_size}, recv_buffer);
+    auto result = co_await rdma("bulk calls").call_bulk(
+        fn_id, std::span{send_buffer.data(), ec.count}, recv_buffer, bulk, resume);
 
-    Resp resp{};
-    auto err = glz::read_beve(resp, std::span{recv_buffer.data(), resp_size});
+    bulk_response<Resp> out{.resp = {}, .bulk_len = result.bulk_len};
+    auto err = glz::read_beve(out.resp, std::span{recv_buffer.data(), result.resp_len});
     if (err) [[unlikely]] {
       throw std::runtime_error("typed_client: failed to deserialize response");
     }
+    co_return out;
+  }
+
+  /**
+   * @brief Call a server-streaming Handler (one returning cppcoro::async_generator<Item>) and
+   * yield its items as they arrive, with at most config.stream_window in flight. Breaking out
+   * of the loop early cancels the stream on the server.
+   */
+  template <auto Handler>
+  auto stream(detail::rpc_req_t<Handler> req)
+      -> cppcoro::async_generator<detail::rpc_stream_item_t<Handler>> {
+    using Item = detail::rpc_stream_item_t<Handler>;
+    static_assert(detail::is_stream_fn_v<Handler>, "use call<Handler>() for unary handlers");
+    constexpr uint32_t fn_id = detail::function_id<Handler>;
+
+    std::vector<std::byte> send_buffer(config_.max_req_payload);
+    auto ec = glz::write_beve(req, send_buffer);
+    if (ec) [[unlikely]] {
+      throw std::runtime_error("typed_client: failed to serialize request");
+    }
 
-    co_return resp;
+    auto frames = rdma("streams").call_stream(fn_id, std::span{send_buffer.data(), ec.count});
+    auto frame = co_await frames.begin();
+    while (frame != frames.end()) {
+      Item item{};
+      auto err = glz::read_beve(item, *frame);
+      if (err) [[unlikely]] {
+        throw std::runtime_error("typed_client: failed to deserialize stream item");
+      }
+      co_yield item;
+      co_await ++frame;
+    }
+  }
+
+  /**
+   * @brief Look up a region the server published under `name`; throws if there is none.
+   */
+  auto open_region(std::string name) -> cppcoro::task<remote_region> {
+    rdma("regions");
+    auto resp = co_await call<&detail::region_lookup>(detail::RegionLookupReq{std::move(name)});
+    if (!resp.found) [[unlikely]] {
+      throw std::runtime_error("typed_client: no region published under that name");
+    }
+    co_return remote_region(
+        qp_, detail::RendezvousDesc{.addr = resp.addr, .length = resp.length, .rkey = resp.rkey});
+  }
+
+  /**
+   * @brief Read a T the server stored into `region`, with no server CPU involved. Empty if every
+   * attempt raced an update.
+   */
+  template <typename T>
+  auto read_region(remote_region &region, uint32_t attempts = 3)
+      -> cppcoro::task<std::optional<T>> {
+    std::vector<std::byte> bytes;
+    for (uint32_t i = 0; i < attempts; ++i) {
+      if (!co_await region.read(bytes)) {
+        continue;
+      }
+      T value{};
+      if (glz::read_beve(value, bytes)) [[unlikely]] {
+        throw std::runtime_error("typed_client: failed to deserialize region");
+      }
+      co_return value;
+    }
+    co_return std::nullopt;
+  }
+
+  /**
+   * @brief Answer with the response the server stored into `region` when a consistent snapshot
+   * can be read, and call Handler with `req` otherwise. The region holds a single response, so
+   * this suits handlers that answer every request alike, such as a config or membership view;
+   * `req` only matters to the fallback call.
+   */
+  template <auto Handler>
+  auto read_snapshot_or_call(remote_region &region, detail::rpc_req_t<Handler> req)
+      -> cppcoro::task<detail::rpc_resp_t<Handler>> {
+    if (auto value = co_await read_region<detail::rpc_resp_t<Handler>>(region)) {
+      co_return std::move(*value);
+    }
+    co_return co_await call<Handler>(req);
   }
 
 private:
+  template <auto Handler>
+  auto call_method(rpc_method method, auto &&req, resume_target resume)
+      -> cppcoro::task<detail::rpc_resp_t<Handler>> {
+    using Resp = detail::rpc_resp_t<Handler>;
+    using Req = detail::rpc_req_t<Handler>;
+    static_assert(std::same_as<Req, std::decay_t<decltype(req)>>);
+    static_assert(!detail::is_stream_fn_v<Handler>, "use stream<Handler>() for stream handlers");
+
+    // Requests outgrowing max_req_payload take the rendezvous path in basic_client.
+    std::vector<std::byte> send_buffer(config_.max_req_payload);
+    auto ec = glz::write_beve(req, send_buffer);
+    if (ec) [[unlikely]] {
+      throw std::runtime_error("typed_client: failed to serialize request");
+    }
+    std::size_t req_size = ec.count;
+
+    auto const req_bytes = std::span{send_buffer.data(), req_size};
+    if constexpr (std::is_void_v<Resp>) {
+      if (msg_client_) {
+        co_await msg_client_->call_oneway(method, req_bytes, resume);
+      } else {
+        co_await client_->call_oneway(method, req_bytes, resume);
+      }
+      co_return;
+    } else {
+      std::vector<std::byte> recv_buffer(config_.max_resp_payload);
+      std::size_t resp_size = 0;
+      if (msg_client_) {
+        resp_size = co_await msg_client_->call(method, req_bytes, recv_buffer, resume);
+      } else {
+        resp_size = co_await client_->call(method, req_bytes, recv_buffer, resume);
+      }
+
+      Resp resp{};
+      auto err = glz::read_beve(resp, std::span{recv_buffer.data(), resp_size});
+      if (err) [[unlikely]] {
+        throw std::runtime_error("typed_client: failed to deserialize response");
+      }
+
+      co_return resp;
+    }
+  }
+
+  auto connect_rdma(std::string_view hostname, uint16_t port,
+                    std::shared_ptr<client_resources> shared) -> void;
+
+  // Streams, bulk calls and regions are built on one-sided RDMA and have no message path.
+  auto rdma(std::string_view feature) const -> basic_client & {
+    if (!client_) [[unlikely]] {
+      throw std::runtime_error("typed_client: " + std::string(feature) +
+                               " need the RDMA transport");
+    }
+    return *client_;
+  }
+
   TypedRpcConfig const config_;
-  std::shared_ptr<rdmapp::device> device_;
-  std::shared_ptr<rdmapp::pd> pd_;
   cppcoro::io_service &io_service_;
-  qp_connector connector_;
+  transport_kind transport_ = transport_kind::rdma;
+  // RDMA transport; all null when connected otherwise.
+  std::shared_ptr<client_resources> rdma_;
+  std::shared_ptr<rdmapp::pd> pd_;
   std::shared_ptr<rdmapp::qp> qp_;
   std::unique_ptr<basic_client> client_;
+  // Shared-memory or TCP transport.
+  std::unique_ptr<message_client> msg_client_;
 };
 
 } // namespace coverbs_rpc
@@ -1,20 +1,47 @@
 #pragma once
 
+#include "coverbs_rpc/admission.hpp"
 #include "coverbs_rpc/conn/acceptor.hpp"
+#include "coverbs_rpc/conn/cq_pool.hpp"
 #include "coverbs_rpc/detail/traits.hpp"
+#include "coverbs_rpc/region.hpp"
+#include "coverbs_rpc/registered_memory.hpp"
+#include "coverbs_rpc/response_cache.hpp"
 #include "coverbs_rpc/server_mux.hpp"
+#include "coverbs_rpc/service.hpp"
+#include "coverbs_rpc/message_channel.hpp"
+#include "coverbs_rpc/priority_scheduler.hpp"
+#include "coverbs_rpc/shm/channel.hpp"
+#include "coverbs_rpc/tcp/channel.hpp"
+#include "coverbs_rpc/utils/core_local.hpp"
 
+#include <array>
+#include <atomic>
 #include <cppcoro/io_service.hpp>
+#include <cppcoro/single_consumer_event.hpp>
+#include <cppcoro/static_thread_pool.hpp>
 #include <cppcoro/task.hpp>
 #include <exception>
+#include <functional>
 #include <glaze/glaze.hpp>
+#include <list>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace coverbs_rpc {
 
 class typed_server {
 public:
+  /**
+   * @brief Serve on `port` over every transport config enables: RDMA, shared memory for clients
+   * on this host, and TCP on config.tcp_port_for(port), all dispatching to the same handlers.
+   * Without a usable RDMA device the server carries on over the other transports.
+   */
   typed_server(cppcoro::io_service &io_service, uint16_t port, TypedRpcConfig config = {},
                std::uint32_t thread_count = 4);
 
@@ -35,26 +62,169 @@ public:
     register_handler_impl<Handler>(invoker);
   }
 
+  /**
+   * @brief Serve every method of Service, a service<...> of free functions. Calls made through
+   * a typed_client stub are dispatched by method index rather than looked up by fn_id.
+   */
+  template <typename Service>
+  auto serve() -> void {
+    serve_impl(Service{}, static_cast<void *>(nullptr));
+  }
+
+  // As above, for a service of `instance`'s member functions.
+  template <typename Service, typename Class>
+  auto serve(Class *instance) -> void {
+    serve_impl(Service{}, instance);
+  }
+
+  /**
+   * @brief Shed calls to Handler beyond `max_concurrency` in flight across every connection, on
+   * top of config.admission; 0 lifts the cap. Call before run().
+   */
+  template <auto Handler>
+  auto limit(uint32_t max_concurrency) -> void {
+    admission_->set_limit(detail::function_id<Handler>, max_concurrency);
+  }
+
+  /**
+   * @brief Start Handler's calls in `priority`'s class; takes effect with config.priority
+   * enabled. Call before run().
+   */
+  template <auto Handler>
+  auto prioritize(rpc_priority priority) -> void {
+    mux_.set_priority(detail::function_id<Handler>, priority);
+  }
+
+  /**
+   * @brief Answer repeats of a request to Handler with its stored serialized response instead of
+   * running it again, for as long as `policy` allows; room is set by config.cache. Handler's
+   * response must depend on the request alone. Call before run().
+   */
+  template <auto Handler>
+  auto cache(cache_policy policy) -> void {
+    static_assert(!detail::is_stream_fn_v<Handler> && !std::is_void_v<detail::rpc_resp_t<Handler>>,
+                  "only unary handlers with a response can be cached");
+    static_assert(!detail::is_with_session_v<Handler>,
+                  "a handler taking a session answers per connection and cannot be cached");
+    if (!cache_) {
+      cache_ = std::make_shared<response_cache>(config_.cache);
+      mux_.set_cache(cache_);
+    }
+    cache_->set_policy(detail::function_id<Handler>, std::move(policy));
+  }
+
+  // Null until a handler is cached.
+  auto responses() const noexcept -> response_cache const * { return cache_.get(); }
+
+  /**
+   * @brief Call `hook` with each connection's session before any of its requests is handled,
+   * e.g. to fill its state slot. Call before run(); exceptions from the hook are logged.
+   */
+  auto on_session_open(std::function<void(rpc_session &)> hook) -> void {
+    session_open_ = std::move(hook);
+  }
+
+  // Call `hook` with each connection's session once the connection has closed. An RDMA
+  // connection closes when its QP fails; a client that went away is noticed at the next reply.
+  auto on_session_close(std::function<void(rpc_session &)> hook) -> void {
+    session_close_ = std::move(hook);
+  }
+
+  // Current limits and the count of calls shed so far.
+  auto admission() const noexcept -> admission_control const & { return *admission_; }
+
+  /**
+   * @brief Create a region of `capacity` bytes that clients can open by `name` and read with
+   * one-sided RDMA READ (see typed_client::open_region). Needs the RDMA transport.
+   */
+  auto publish(std::string name, std::size_t capacity) -> std::shared_ptr<published_region>;
+
   auto run() -> cppcoro::task<void>;
 
+  /**
+   * @brief Stop accepting clients and close every connection, so that run() returns once the
+   * calls in progress have finished. Safe from any thread, a handler's included, but a reply
+   * still being sent when stop() is called may be lost.
+   */
+  auto stop() -> void;
+
   ~typed_server();
 
 private:
   template <auto Handler, typename Invoker>
   auto register_handler_impl(Invoker invoker) -> void {
+    if constexpr (detail::is_stream_fn_v<Handler>) {
+      register_stream_handler_impl<Handler>(std::move(invoker));
+    } else {
+      register_unary_handler_impl<Handler>(std::move(invoker));
+    }
+  }
+
+  template <auto Handler, typename Invoker>
+  auto register_stream_handler_impl(Invoker invoker) -> void {
     using Req = detail::rpc_req_t<Handler>;
-    using Resp = detail::rpc_resp_t<Handler>;
+    static_assert(!detail::is_with_session_v<Handler>, "stream handlers take no session");
     constexpr uint32_t fn_id = detail::function_id<Handler>;
     constexpr std::string_view fn_name = detail::function_name<Handler>;
 
-    auto h = [inv = std::move(invoker)](std::span<std::byte> req_bytes,
-                                        std::span<std::byte> resp_bytes) -> std::size_t {
+    auto h = [inv = std::move(invoker)](std::span<std::byte> req_bytes)
+        -> cppcoro::async_generator<std::span<const std::byte>> {
       Req req{};
       auto err = glz::read_beve(req, req_bytes);
       if (err) [[unlikely]] {
         throw std::runtime_error("typed_server: failed to deserialize request");
       }
 
+      // Each item is serialized into the same buffer, which only has to outlive the send.
+      std::vector<std::byte> item_bytes;
+      auto items = inv(req);
+      auto item = co_await items.begin();
+      while (item != items.end()) {
+        auto ec = glz::write_beve(*item, item_bytes);
+        if (ec) [[unlikely]] {
+          throw std::runtime_error("typed_server: failed to serialize stream item");
+        }
+        co_yield std::span<const std::byte>(item_bytes.data(), ec.count);
+        co_await ++item;
+      }
+    };
+
+    mux_.register_stream_handler(fn_id, fn_name, std::move(h));
+  }
+
+  template <auto Handler, typename Invoker>
+  auto register_unary_handler_impl(Invoker invoker) -> void {
+    constexpr uint32_t fn_id = detail::function_id<Handler>;
+    constexpr std::string_view fn_name = detail::function_name<Handler>;
+
+    auto h = [inv = std::move(invoker)](std::span<std::byte> req_bytes,
+                                        std::span<std::byte> resp_bytes,
+                                        rpc_context &ctx) -> std::size_t {
+      return serve_unary<Handler>(inv, req_bytes, resp_bytes, ctx);
+    };
+
+    mux_.register_handler(fn_id, fn_name, std::move(h));
+  }
+
+  // Deserializes the request, runs Handler through `inv` and serializes its response.
+  template <auto Handler, typename Invoker>
+  static auto serve_unary(Invoker const &inv, std::span<std::byte> req_bytes,
+                          std::span<std::byte> resp_bytes, rpc_context &ctx) -> std::size_t {
+    using Req = detail::rpc_req_t<Handler>;
+    using Resp = detail::rpc_resp_t<Handler>;
+
+    Req req{};
+    auto err = glz::read_beve(req, req_bytes);
+    if (err) [[unlikely]] {
+      throw std::runtime_error("typed_server: failed to deserialize request");
+    }
+
+    if constexpr (std::is_void_v<Resp>) {
+      // One-way: typed_client sends these with kFlagOneWay, so nothing is replied.
+      static_assert(!detail::is_coro_fn_v<Handler>, "async handlers are not supported yet");
+      invoke<Handler>(inv, req, ctx);
+      return 0;
+    } else {
       Resp resp;
       if constexpr (detail::is_coro_fn_v<Handler>) {
         // Current architecture doesn't support async handlers yet, but we can add later
@@ -62,28 +232,143 @@ private:
         std::terminate(); // Not implemented
         static_assert(!sizeof(Handler));
       } else {
-        resp = inv(req);
+        resp = invoke<Handler>(inv, req, ctx);
       }
 
       auto ec = glz::write_beve(resp, resp_bytes);
       if (ec) [[unlikely]] {
-        throw std::runtime_error("typed_server: failed to serialize response");
+        // Too large for the send slot: hand it to the server's rendezvous path.
+        ec = glz::write_beve(resp, ctx.large_resp);
+        if (ec) {
+          throw std::runtime_error("typed_server: failed to serialize response");
+        }
+        ctx.large_resp.resize(ec.count);
       }
       return ec.count;
-    };
+    }
+  }
 
-    mux_.register_handler(fn_id, fn_name, std::move(h));
+  template <auto... Methods, typename Class>
+  auto serve_impl(service<Methods...>, Class *instance) -> void {
+    // Registered by fn_id too, for streams and for clients calling them directly.
+    if constexpr (std::is_void_v<Class>) {
+      (register_handler<Methods>(), ...);
+    } else {
+      (register_handler<Methods>(instance), ...);
+    }
+    static constexpr std::array<basic_mux::method_entry, sizeof...(Methods)> table{
+        basic_mux::method_entry{detail::function_id<Methods>, method_invoker<Methods, Class>()}...};
+    mux_.register_service(table, instance);
   }
 
+  // Runs Method on a type-erased instance; null for streams, which are not indexed.
+  template <auto Method, typename Class>
+  static constexpr auto method_invoker()
+      -> std::size_t (*)(void *, std::span<std::byte>, std::span<std::byte>, rpc_context &) {
+    if constexpr (detail::is_stream_fn_v<Method>) {
+      return nullptr;
+    } else {
+      return [](void *instance, std::span<std::byte> req_bytes, std::span<std::byte> resp_bytes,
+                rpc_context &ctx) -> std::size_t {
+        if constexpr (std::is_void_v<Class>) {
+          return serve_unary<Method>(Method, req_bytes, resp_bytes, ctx);
+        } else {
+          auto inv = [self = static_cast<Class *>(instance)](auto &&...args) {
+            return std::invoke(Method, self, std::forward<decltype(args)>(args)...);
+          };
+          return serve_unary<Method>(inv, req_bytes, resp_bytes, ctx);
+        }
+      };
+    }
+  }
+
+  template <auto Handler, typename Invoker, typename Req>
+  static auto invoke(Invoker const &inv, Req const &req, rpc_context &ctx) -> decltype(auto) {
+    if constexpr (detail::is_with_context_v<Handler>) {
+      return inv(req, ctx);
+    } else if constexpr (detail::is_with_session_v<Handler>) {
+      static_assert(std::is_same_v<std::tuple_element_t<1, typename detail::function_traits<
+                                                               decltype(Handler)>::params>,
+                                   rpc_session &>,
+                    "a handler's second parameter is rpc_context & or rpc_session &");
+      if (ctx.session == nullptr) [[unlikely]] {
+        throw std::runtime_error("typed_server: handler needs a session, but none was given");
+      }
+      return inv(req, *ctx.session);
+    } else {
+      return inv(req);
+    }
+  }
+
+  // Everything one core owns in shared-nothing mode.
+  struct core_shard {
+    core_shard(uint32_t id, std::shared_ptr<rdmapp::pd> pd, ConnConfig const &conn,
+               MemoryConfig const &memory, PriorityConfig const &priority);
+
+    uint32_t const id;
+    std::shared_ptr<cppcoro::static_thread_pool> executor;
+    // Null unless config.priority is enabled.
+    std::shared_ptr<priority_scheduler> scheduler;
+    cq_pool cqs;
+    std::shared_ptr<registered_arena> arena;
+    std::atomic<std::size_t> connections{0};
+  };
+
   auto handle_connection(std::shared_ptr<rdmapp::qp> qp) -> cppcoro::task<void>;
+  auto handle_connection(std::shared_ptr<rdmapp::qp> qp, core_shard &shard)
+      -> cppcoro::task<void>;
+  auto pick_shard() -> core_shard &;
+  // Keeps `qp` where stop() can fail it, or fails it at once if stop() already ran.
+  auto track(std::shared_ptr<rdmapp::qp> const &qp) -> void;
+  auto accept_messages(transport_kind kind, std::string_view transport,
+                       std::function<std::unique_ptr<message_channel>()> accept) -> void;
+  // Run the session hooks, logging what they throw.
+  auto open_session(rpc_session &session) noexcept -> void;
+  auto close_session(rpc_session &session) noexcept -> void;
+  auto lookup_region(detail::RegionLookupReq const &req) -> detail::RegionLookupResp;
 
   TypedRpcConfig const config_;
   uint32_t const thread_count_;
   std::shared_ptr<rdmapp::device> device_;
   std::shared_ptr<rdmapp::pd> pd_;
   cppcoro::io_service &io_service_;
-  qp_acceptor acceptor_;
+  // Null with RDMA disabled.
+  std::unique_ptr<qp_acceptor> acceptor_;
   basic_mux mux_;
+  std::shared_ptr<admission_control> admission_;
+  std::shared_ptr<response_cache> cache_;
+  // Shared by every connection, so accepting one does not register fresh memory.
+  std::shared_ptr<registered_arena> arena_;
+  std::vector<std::unique_ptr<core_shard>> shards_;
+
+  std::mutex regions_mutex_;
+  std::map<std::string, std::shared_ptr<published_region>, std::less<>> regions_;
+
+  std::function<void(rpc_session &)> session_open_;
+  std::function<void(rpc_session &)> session_close_;
+  std::atomic<uint64_t> next_session_{0};
+
+  std::atomic<bool> stopping_{false};
+  // The QPs of the RDMA connections being served, for stop() to move to the error state.
+  std::mutex rdma_mutex_;
+  std::vector<std::weak_ptr<rdmapp::qp>> rdma_qps_;
+
+  // Shared-memory and TCP transports: a thread per listener accepts clients, and each
+  // connection gets a receive thread feeding handlers to a pool shared by all of them. Declared
+  // last so these threads are joined before anything they use is torn down.
+  std::unique_ptr<shm::listener> shm_listener_;
+  std::unique_ptr<tcp::listener> tcp_listener_;
+  std::shared_ptr<cppcoro::static_thread_pool> msg_executor_;
+  std::shared_ptr<priority_scheduler> msg_scheduler_;
+  cppcoro::single_consumer_event msg_closed_;
+  struct msg_connection {
+    // Set by the thread as it exits, so the next accept can join it without blocking.
+    std::atomic<bool> done{false};
+    std::jthread thread;
+  };
+  std::mutex msg_mutex_;
+  std::list<msg_connection> msg_connections_;
+  std::vector<std::jthread> msg_acceptors_;
 };
 
 } // namespace coverbs_rpc
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "coverbs_rpc/common.hpp"
+#include "coverbs_rpc/utils/spin_wait.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+namespace coverbs_rpc::utils {
+
+/**
+ * @brief One waiter's progression through a WaitPolicy.
+ *
+ * Call pause() once per failed check of the awaited condition. In busy_poll mode it is a plain
+ * cpu_relax(); in hybrid mode the waiter escalates from spinning to yielding to sleeping, so a
+ * wait that outlives the spin budget stops burning its core.
+ */
+class backoff {
+public:
+  explicit backoff(WaitPolicy const &policy) noexcept
+      : policy_(policy) {}
+
+  void pause() {
+    if (policy_.mode == wait_mode::busy_poll) {
+      detail::cpu_relax();
+      return;
+    }
+    // Only read the clock every kClockStride spins to keep the fast path cheap.
+    if (spins_++ % kClockStride != 0 || !budget_spent()) {
+      detail::cpu_relax();
+      return;
+    }
+    if (yields_ < kMaxYields) {
+      ++yields_;
+      std::this_thread::yield();
+      return;
+    }
+    std::this_thread::sleep_for(sleep_);
+    sleep_ = std::min<std::chrono::microseconds>(sleep_ * 2, policy_.max_sleep);
+  }
+
+  void reset() noexcept {
+    spins_ = 0;
+    yields_ = 0;
+    start_ = {};
+    sleep_ = std::chrono::microseconds{1};
+  }
+
+private:
+  static constexpr uint32_t kClockStride = 64;
+  static constexpr uint32_t kMaxYields = 16;
+
+  auto budget_spent() -> bool {
+    auto now = std::chrono::steady_clock::now();
+    if (start_ == std::chrono::steady_clock::time_point{}) {
+      start_ = now;
+      return policy_.spin_budget.count() == 0;
+    }
+    return now - start_ >= policy_.spin_budget;
+  }
+
+  WaitPolicy policy_;
+  uint64_t spins_{};
+  uint32_t yields_{};
+  std::chrono::steady_clock::time_point start_{};
+  std::chrono::microseconds sleep_{1};
+};
+
+} // namespace coverbs_rpc::utils
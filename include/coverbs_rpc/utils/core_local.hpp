@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+namespace coverbs_rpc {
+
+namespace detail {
+inline thread_local int tls_core_id = -1;
+} // namespace detail
+
+/**
+ * @brief Index of the server core shard the calling thread belongs to, or -1 outside of one.
+ */
+inline auto current_core() noexcept -> int { return detail::tls_core_id; }
+
+namespace utils {
+
+/**
+ * @brief One cache-line-isolated instance of T per core shard.
+ *
+ * Handlers running in a shared-nothing typed_server reach their shard's instance through
+ * local() without locks or cross-core traffic.
+ */
+template <typename T>
+class core_local {
+public:
+  explicit core_local(std::size_t cores, T const &init = T{})
+      : slots_(cores, slot{init}) {}
+
+  auto local() -> T & {
+    int core = current_core();
+    assert(core >= 0 && static_cast<std::size_t>(core) < slots_.size());
+    return slots_[core].value;
+  }
+
+  auto operator[](std::size_t core) -> T & { return slots_[core].value; }
+  auto operator[](std::size_t core) const -> T const & { return slots_[core].value; }
+
+  auto size() const noexcept -> std::size_t { return slots_.size(); }
+
+private:
+  struct alignas(64) slot {
+    T value;
+  };
+  std::vector<slot> slots_;
+};
+
+} // namespace utils
+
+} // namespace coverbs_rpc
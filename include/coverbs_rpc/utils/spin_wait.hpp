@@ -1,10 +1,14 @@
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <cassert>
+#include <chrono>
 #include <coroutine>
+#include <cstdint>
 #include <cppcoro/awaitable_traits.hpp>
 #include <exception>
+#include <thread>
 #include <type_traits>
 #include <utility>
 
@@ -14,17 +18,115 @@ namespace detail {
 
 inline void cpu_relax() noexcept { __builtin_ia32_pause(); }
 
+} // namespace detail
+
+/**
+ * @brief How often SpinEvent waits ended in each phase, summed over all threads.
+ *
+ * `immediate` waits found the result already there; the others completed while spinning, after
+ * yielding, or only after parking on the futex.
+ */
+struct spin_wait_counters {
+  uint64_t immediate;
+  uint64_t spun;
+  uint64_t yielded;
+  uint64_t parked;
+};
+
+namespace detail {
+
+struct phase_counters {
+  struct alignas(64) counter {
+    std::atomic<uint64_t> value{0};
+    void add() noexcept { value.fetch_add(1, std::memory_order_relaxed); }
+  };
+  counter immediate, spun, yielded, parked;
+};
+
+inline auto spin_stats() noexcept -> phase_counters & {
+  static phase_counters stats;
+  return stats;
+}
+
+// Number of cpu_relax() iterations that take roughly kSpinBudget, measured once per process.
+inline auto calibrated_spins() noexcept -> uint32_t {
+  static uint32_t const spins = [] {
+    constexpr auto kSpinBudget = std::chrono::microseconds(20);
+    constexpr uint32_t kSamples = 2048;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < kSamples; ++i) {
+      cpu_relax();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    auto ns_per_spin = std::max<double>(
+        1.0, std::chrono::duration<double, std::nano>(elapsed).count() / kSamples);
+    return static_cast<uint32_t>(
+        std::chrono::duration<double, std::nano>(kSpinBudget).count() / ns_per_spin);
+  }();
+  return spins;
+}
+
+/**
+ * Spins for a calibrated ~20us, yields a few times, then parks on the state word. notify()
+ * only issues the wake-up syscall when the waiter has actually parked.
+ */
 struct SpinEvent {
-  std::atomic<bool> ready_{false};
-  void notify() noexcept { ready_.store(true, std::memory_order_release); }
+  static constexpr uint32_t kEmpty = 0;
+  static constexpr uint32_t kParked = 1;
+  static constexpr uint32_t kReady = 2;
+  static constexpr uint32_t kYieldRounds = 16;
+
+  std::atomic<uint32_t> state_{kEmpty};
+  // Set once notify() no longer touches this event; the owner may free it only after that.
+  std::atomic<bool> released_{false};
+
+  void notify() noexcept {
+    if (state_.exchange(kReady, std::memory_order_acq_rel) == kParked) {
+      state_.notify_one();
+    }
+    released_.store(true, std::memory_order_release);
+  }
+
   void wait() noexcept {
-    if (ready_.load(std::memory_order_acquire))
+    auto &stats = spin_stats();
+    if (is_ready()) {
+      stats.immediate.add();
       return;
-    while (!ready_.load(std::memory_order_acquire)) {
+    }
+    for (uint32_t i = calibrated_spins(); i > 0; --i) {
       cpu_relax();
+      if (is_ready()) {
+        stats.spun.add();
+        return;
+      }
     }
+    for (uint32_t i = 0; i < kYieldRounds; ++i) {
+      std::this_thread::yield();
+      if (is_ready()) {
+        stats.yielded.add();
+        return;
+      }
+    }
+    uint32_t expected = kEmpty;
+    if (!state_.compare_exchange_strong(expected, kParked, std::memory_order_acq_rel)) {
+      // Became ready between the last yield and the park attempt.
+      stats.yielded.add();
+      return;
+    }
+    do {
+      state_.wait(kParked, std::memory_order_acquire);
+    } while (!is_ready());
+    stats.parked.add();
   }
-  bool is_ready() const noexcept { return ready_.load(std::memory_order_acquire); }
+
+  // Waits until a notify() that has already made the event ready has fully returned.
+  void wait_released() const noexcept {
+    while (!released_.load(std::memory_order_acquire)) {
+      cpu_relax();
+    }
+  }
+
+  bool is_ready() const noexcept { return state_.load(std::memory_order_acquire) == kReady; }
 };
 
 template <typename T>
@@ -146,6 +248,8 @@ struct spin_wait_task {
   ~spin_wait_task() {
     if (h_) {
       h_.promise().event_.wait();
+      // The event lives in the frame: keep it alive until notify() is done with it.
+      h_.promise().event_.wait_released();
       h_.destroy();
     }
   }
@@ -200,6 +304,19 @@ using safe_spin_result_t = typename safe_spin_result<T>::type;
 
 } // namespace detail
 
+/**
+ * @brief Snapshot of the per-phase counters of every spin_wait() so far.
+ */
+inline auto spin_wait_stats() noexcept -> spin_wait_counters {
+  auto &stats = detail::spin_stats();
+  return {
+      .immediate = stats.immediate.value.load(std::memory_order_relaxed),
+      .spun = stats.spun.value.load(std::memory_order_relaxed),
+      .yielded = stats.yielded.value.load(std::memory_order_relaxed),
+      .parked = stats.parked.value.load(std::memory_order_relaxed),
+  };
+}
+
 template <typename Awaitable>
 auto spin_wait(Awaitable &&awaitable)
     -> detail::safe_spin_result_t<typename cppcoro::awaitable_traits<Awaitable>::await_result_t> {
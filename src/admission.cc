@@ -0,0 +1,134 @@
+#include "coverbs_rpc/admission.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace coverbs_rpc {
+
+namespace {
+
+constexpr uint32_t kDefaultCeiling = 1024;
+
+auto ticks(std::chrono::steady_clock::time_point t) noexcept -> int64_t {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+
+} // namespace
+
+admission_control::ticket::ticket(ticket &&other) noexcept
+    : owner_(std::exchange(other.owner_, nullptr))
+    , fn_(other.fn_)
+    , arrived_(other.arrived_)
+    , queued_(other.queued_) {}
+
+auto admission_control::ticket::operator=(ticket &&other) noexcept -> ticket & {
+  if (this != &other) {
+    release();
+    owner_ = std::exchange(other.owner_, nullptr);
+    fn_ = other.fn_;
+    arrived_ = other.arrived_;
+    queued_ = other.queued_;
+  }
+  return *this;
+}
+
+admission_control::ticket::~ticket() { release(); }
+
+auto admission_control::ticket::start() noexcept -> void {
+  if (owner_ != nullptr && queued_) {
+    queued_ = false;
+    owner_->queued_.fetch_sub(1, std::memory_order_relaxed);
+  }
+}
+
+auto admission_control::ticket::release() noexcept -> void {
+  if (owner_ == nullptr) {
+    return;
+  }
+  start();
+  owner_->in_flight_.fetch_sub(1, std::memory_order_relaxed);
+  if (fn_ != nullptr) {
+    fn_->in_flight.fetch_sub(1, std::memory_order_relaxed);
+  }
+  if (owner_->config_.adaptive) {
+    owner_->on_latency(std::chrono::steady_clock::now() - arrived_);
+  }
+  owner_ = nullptr;
+}
+
+admission_control::admission_control(AdmissionConfig config)
+    : config_(config)
+    , active_(config.max_concurrency != 0 || config.max_queued != 0 || config.adaptive)
+    , ceiling_(config.max_concurrency != 0 ? config.max_concurrency : kDefaultCeiling)
+    , limit_(config.adaptive ? ceiling_ : config.max_concurrency) {}
+
+auto admission_control::set_limit(uint32_t fn_id, uint32_t max_concurrency) -> void {
+  if (max_concurrency == 0) {
+    fns_.erase(fn_id);
+    return;
+  }
+  auto &fn = fns_[fn_id];
+  if (!fn) {
+    fn = std::make_unique<fn_state>();
+  }
+  fn->limit = max_concurrency;
+  active_ = true;
+}
+
+auto admission_control::admit(uint32_t fn_id, std::chrono::steady_clock::time_point arrived)
+    -> std::optional<ticket> {
+  if (!active_) {
+    return ticket{};
+  }
+  if (config_.max_queued != 0 &&
+      queued_.load(std::memory_order_relaxed) >= config_.max_queued) {
+    return reject();
+  }
+  uint32_t const limit = limit_.load(std::memory_order_relaxed);
+  if (in_flight_.fetch_add(1, std::memory_order_relaxed) >= limit && limit != 0) {
+    in_flight_.fetch_sub(1, std::memory_order_relaxed);
+    return reject();
+  }
+  fn_state *fn = nullptr;
+  if (auto it = fns_.find(fn_id); it != fns_.end()) {
+    fn = it->second.get();
+    if (fn->in_flight.fetch_add(1, std::memory_order_relaxed) >= fn->limit) {
+      fn->in_flight.fetch_sub(1, std::memory_order_relaxed);
+      in_flight_.fetch_sub(1, std::memory_order_relaxed);
+      return reject();
+    }
+  }
+  queued_.fetch_add(1, std::memory_order_relaxed);
+  return ticket(this, fn, arrived);
+}
+
+auto admission_control::reject() noexcept -> std::optional<ticket> {
+  shed_.fetch_add(1, std::memory_order_relaxed);
+  return std::nullopt;
+}
+
+auto admission_control::on_latency(std::chrono::nanoseconds latency) noexcept -> void {
+  uint32_t const limit = limit_.load(std::memory_order_relaxed);
+  if (latency <= config_.target_latency) {
+    // Additive increase: one more per limit's worth of requests served in time.
+    if (successes_.fetch_add(1, std::memory_order_relaxed) + 1 >= limit) {
+      successes_.store(0, std::memory_order_relaxed);
+      limit_.store(std::min(ceiling_, limit + 1), std::memory_order_relaxed);
+    }
+    return;
+  }
+  // Multiplicative decrease, once per target interval: the requests already admitted under
+  // the old limit report slow too, and should not compound the cut.
+  int64_t const now = ticks(std::chrono::steady_clock::now());
+  int64_t last = last_decrease_.load(std::memory_order_relaxed);
+  auto const interval = std::chrono::nanoseconds(config_.target_latency).count();
+  if (now - last < interval ||
+      !last_decrease_.compare_exchange_strong(last, now, std::memory_order_relaxed)) {
+    return;
+  }
+  uint32_t const floor = std::min(config_.min_concurrency, ceiling_);
+  limit_.store(std::max(floor, limit - limit / 4), std::memory_order_relaxed);
+  successes_.store(0, std::memory_order_relaxed);
+}
+
+} // namespace coverbs_rpc
@@ -1,58 +1,131 @@
 #include "coverbs_rpc/basic_client.hpp"
+#include "coverbs_rpc/detail/buffer_pool.hpp"
+#include "coverbs_rpc/detail/coalesce.hpp"
 #include "coverbs_rpc/detail/logger.hpp"
-
+#include "coverbs_rpc/detail/rendezvous.hpp"
+#include "coverbs_rpc/detail/replay_sequencer.hpp"
+#include "coverbs_rpc/utils/backoff.hpp"
+#include "coverbs_rpc/utils/spin_wait.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <concurrentqueue.h>
 #include <cppcoro/async_scope.hpp>
 #include <cppcoro/sync_wait.hpp>
+#include <cstring>
+#include <deque>
+#include <exception>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <rdmapp/qp.h>
+#include <stdexcept>
 
 namespace coverbs_rpc {
 using detail::get_logger;
 
 namespace detail {
 
-struct RpcSlot {
+// Everything a call and the recv worker touch per request, one cache line per slot so callers
+// and workers on different slots never false-share. Rendezvous state is cold and kept apart.
+struct alignas(64) RpcSlot {
   std::atomic<uintptr_t> waiter{kWaiterEmpty};
+  uint64_t expected_req_id{};
   std::span<std::byte> user_resp_buffer{};
   std::size_t actual_len{};
-  uint64_t expected_req_id{};
+  uint32_t resp_flags{};
+  uint32_t generation{};
+  // The response header's reserved word: bytes the server wrote into a bulk call's region, or
+  // why a call flagged kFlagFailed failed.
+  uint32_t resp_reserved{};
+};
+static_assert(sizeof(RpcSlot) == 64);
+
+// Items of a server stream that arrived ahead of the consumer. Cold: only streams touch it.
+struct StreamState {
+  std::mutex mutex;
+  std::deque<std::vector<std::byte>> items;
+  std::coroutine_handle<> waiter;
+  bool ended = false;
+  bool aborted = false;
+  // The consumer is gone; the slot is freed once the end frame arrives.
+  bool abandoned = false;
+};
+
+struct StreamItemAwaitable {
+  StreamState &state;
+  constexpr auto await_ready() const noexcept -> bool { return false; }
+  auto await_suspend(std::coroutine_handle<> h) -> bool {
+    std::lock_guard lock(state.mutex);
+    if (!state.items.empty() || state.ended) {
+      return false;
+    }
+    state.waiter = h;
+    return true;
+  }
+  // Empty once the stream has ended and every item has been consumed.
+  auto await_resume() -> std::optional<std::vector<std::byte>> {
+    std::lock_guard lock(state.mutex);
+    if (state.items.empty()) {
+      return std::nullopt;
+    }
+    auto item = std::move(state.items.front());
+    state.items.pop_front();
+    return item;
+  }
 };
 
 struct RpcResponseAwaitable {
   RpcSlot &slot;
   constexpr auto await_ready() const noexcept -> bool { return false; }
-  void await_suspend(std::coroutine_handle<> h) noexcept {
-    slot.waiter.store(uintptr_t(h.address()));
+  auto await_suspend(std::coroutine_handle<> h) noexcept -> bool {
+    uintptr_t expected = kWaiterEmpty;
+    return slot.waiter.compare_exchange_strong(expected, uintptr_t(h.address()));
   }
   auto await_resume() noexcept -> std::size_t { return slot.actual_len; }
 };
 
-static auto pause() noexcept -> void { __builtin_ia32_pause(); }
-
 } // namespace detail
 
 struct basic_client::Impl {
-  Impl(std::shared_ptr<rdmapp::qp> qp, RpcConfig config)
+  // A coalesced frame being filled, with the slots of the calls in it.
+  struct open_batch {
+    detail::buffer_pool::buffer buf;
+    detail::batch_writer writer;
+    std::vector<uint32_t> slots;
+  };
+
+  Impl(std::shared_ptr<rdmapp::qp> qp, RpcConfig config, std::shared_ptr<registered_arena> arena)
       : config_(config)
       , send_buffer_size_(config_.max_req_payload + sizeof(detail::RpcHeader))
       , recv_buffer_size_(config_.max_resp_payload + sizeof(detail::RpcHeader))
       , qp_(qp)
-      , send_buffer_pool_(config_.max_inflight * send_buffer_size_)
-      , send_mr_(qp->pd_ptr()->reg_mr(send_buffer_pool_.data(), send_buffer_pool_.size()))
-      , recv_buffer_pool_(config_.max_inflight * recv_buffer_size_)
-      , recv_mr_(qp->pd_ptr()->reg_mr(recv_buffer_pool_.data(), recv_buffer_pool_.size()))
+      , arena_(arena ? std::move(arena) : registered_arena::create(qp->pd_ptr(), config_.memory))
+      , send_pool_(*arena_, send_buffer_size_, config_.max_inflight, config_.min_send_class)
+      , recv_block_(arena_->allocate(config_.max_inflight * recv_buffer_size_))
       , slots_(config_.max_inflight)
+      , rendezvous_(config_.max_inflight)
+      , streams_(config_.max_inflight)
       , free_slots_(config_.max_inflight * 2)
+      , oneway_slots_(config_.max_inflight)
       , worker_(&basic_client::Impl::start_recv_workers, this) {
+    if (config_.max_req_payload < sizeof(detail::RendezvousDesc)) [[unlikely]] {
+      throw std::runtime_error("max_req_payload too small to carry a rendezvous descriptor");
+    }
     for (uint32_t i = 0; i < config_.max_inflight; ++i) {
       free_slots_.enqueue(i);
     }
+    if (config_.coalesce.enabled && config_.coalesce.max_records > 1) {
+      flusher_ = std::jthread([this](std::stop_token stop) { run_flusher(stop); });
+    }
 
-    get_logger()->info("Client initialized with {} slots, send_buf={}, recv_buf={}",
-                       config_.max_inflight, send_buffer_size_, recv_buffer_size_);
+    get_logger()->info("Client initialized with {} slots, send_pool={}, recv_buf={}",
+                       config_.max_inflight, send_pool_.registered_bytes(), recv_buffer_size_);
   }
 
+  ~Impl() { cppcoro::sync_wait(cancels_.join()); }
+
   void start_recv_workers() {
     cppcoro::async_scope scope;
     for (std::size_t i = 0; i < config_.max_inflight; ++i) {
@@ -64,8 +137,9 @@ struct basic_client::Impl {
   auto recv_worker(std::size_t worker_idx) -> cppcoro::task<void> {
     get_logger()->debug("Client: recv_worker[{}] started", worker_idx);
     std::size_t offset = worker_idx * recv_buffer_size_;
+    std::vector<uint32_t> ready;
     while (true) {
-      auto recv_slice_mr = rdmapp::mr_view(recv_mr_, offset, recv_buffer_size_);
+      auto recv_slice_mr = recv_block_.view(offset, recv_buffer_size_);
       try {
         auto [nbytes, _] = co_await qp_->recv(recv_slice_mr, rdmapp::use_native_awaitable);
 
@@ -74,110 +148,635 @@ struct basic_client::Impl {
           continue;
         }
 
-        auto buffer_ptr = recv_buffer_pool_.data() + offset;
+        auto buffer_ptr = recv_block_.data() + offset;
         auto header = reinterpret_cast<detail::RpcHeader *>(buffer_ptr);
+        std::size_t const payload_len =
+            std::min<std::size_t>(header->payload_len, nbytes - sizeof(detail::RpcHeader));
+        auto const payload = std::span{buffer_ptr + sizeof(detail::RpcHeader), payload_len};
 
-        uint64_t recv_id = header->req_id;
-        uint32_t slot_idx = detail::parse_slot_idx(recv_id);
-
-        if (slot_idx >= config_.max_inflight) [[unlikely]] {
-          get_logger()->error("Client: invalid slot_idx decoded: {}", slot_idx);
+        if (header->flags & detail::kFlagOneWay) {
+          return_oneway_slots(header->reserved);
           continue;
         }
 
-        detail::RpcSlot &slot = slots_[slot_idx];
+        if (header->flags & detail::kFlagBatch) {
+          // Fill every slot before resuming any caller, so one slow continuation does not hold
+          // back the rest of the batch.
+          ready.clear();
+          bool const well_formed = detail::for_each_record(
+              payload, header->reserved,
+              [&](detail::RpcHeader const &record, std::span<std::byte> record_payload) {
+                if (auto slot_idx = deliver(record, record_payload)) {
+                  ready.push_back(*slot_idx);
+                }
+              });
+          if (!well_formed) [[unlikely]] {
+            get_logger()->error("Client: malformed batch of {} records", header->reserved);
+          }
+          for (uint32_t slot_idx : ready) {
+            resume_slot(slot_idx);
+          }
+          continue;
+        }
 
-        if (slot.expected_req_id != recv_id) [[unlikely]] {
-          get_logger()->error("Client: mismatch req_id: expected={} get={}", slot.expected_req_id,
-                              recv_id);
-          std::terminate();
+        if (auto slot_idx = deliver(*header, payload)) {
+          resume_slot(*slot_idx);
         }
+      } catch (const std::exception &e) {
+        get_logger()->error("Client: recv worker error: {}", e.what());
+        break;
+      }
+    }
+  }
 
-        std::size_t payload_len = header->payload_len;
-        std::size_t copy_len = std::min((std::size_t)payload_len, slot.user_resp_buffer.size());
+  // Hands one response to its slot. Returns the slot if a caller is waiting on it; stream frames
+  // and bad ids return nothing.
+  auto deliver(detail::RpcHeader const &header, std::span<const std::byte> payload)
+      -> std::optional<uint32_t> {
+    uint64_t recv_id = header.req_id;
+    uint32_t slot_idx = detail::parse_slot_idx(recv_id);
 
-        std::copy_n(buffer_ptr + sizeof(detail::RpcHeader), copy_len, slot.user_resp_buffer.data());
+    if (slot_idx >= config_.max_inflight) [[unlikely]] {
+      get_logger()->error("Client: invalid slot_idx decoded: {}", slot_idx);
+      return std::nullopt;
+    }
 
-        slot.actual_len = copy_len;
+    detail::RpcSlot &slot = slots_[slot_idx];
 
-        uintptr_t w;
-        while ((w = slot.waiter.load()) == detail::kWaiterEmpty) {
-          detail::pause();
-        }
-        auto h = std::coroutine_handle<>::from_address(reinterpret_cast<void *>(w));
-        h.resume();
+    if (slot.expected_req_id != recv_id) [[unlikely]] {
+      get_logger()->error("Client: mismatch req_id: expected={} get={}", slot.expected_req_id,
+                          recv_id);
+      std::terminate();
+    }
 
-      } catch (const std::exception &e) {
-        get_logger()->error("Client: recv worker error: {}", e.what());
+    if (header.flags & detail::kFlagStream) {
+      on_stream_frame(slot_idx, header.flags, payload);
+      return std::nullopt;
+    }
+
+    slot.resp_flags = header.flags;
+    slot.resp_reserved = header.reserved;
+    if (header.flags & detail::kFlagRendezvous) {
+      // The caller pulls the payload itself once resumed.
+      auto &desc = rendezvous_[slot_idx];
+      std::memcpy(&desc, payload.data(), sizeof(desc));
+      slot.actual_len = desc.length;
+    } else {
+      std::size_t copy_len = std::min(payload.size(), slot.user_resp_buffer.size());
+      std::copy_n(payload.data(), copy_len, slot.user_resp_buffer.data());
+      slot.actual_len = copy_len;
+    }
+    return slot_idx;
+  }
+
+  // Resumes the caller waiting on a filled slot. A caller still on its way into the awaitable
+  // finds the slot done and does not suspend, so the worker never waits for it.
+  auto resume_slot(uint32_t slot_idx) -> void {
+    uintptr_t const w = slots_[slot_idx].waiter.exchange(detail::kWaiterDone);
+    if (w != detail::kWaiterEmpty) {
+      std::coroutine_handle<>::from_address(reinterpret_cast<void *>(w)).resume();
+    }
+  }
+
+  // Whether a request of `len` bytes should share a frame with others.
+  auto coalescable(std::size_t len) const noexcept -> bool {
+    return flusher_.joinable() && detail::batch_record_size(len) <= config_.max_req_payload / 2;
+  }
+
+  // Adds a request to the open batch, opening one if needed. Returns a batch that is now due
+  // for sending, either because this record did not fit or because it filled the batch.
+  auto add_to_batch(detail::RpcHeader const &header, std::span<const std::byte> payload,
+                    uint32_t slot_idx) -> std::optional<open_batch> {
+    std::optional<open_batch> due;
+    std::lock_guard lock(batch_mutex_);
+    if (batch_ && !batch_->writer.fits(payload.size())) {
+      due = take_batch();
+    }
+    if (!batch_) {
+      auto buf = send_pool_.acquire(send_buffer_size_, config_.wait);
+      batch_.emplace(open_batch{buf, detail::batch_writer(buf.data, config_.max_req_payload), {}});
+      batch_open_.store(true, std::memory_order_release);
+      batch_open_.notify_one();
+    }
+    batch_->writer.append(header, payload);
+    batch_->slots.push_back(slot_idx);
+    batch_records_.store(batch_->writer.records(), std::memory_order_relaxed);
+    if (!due && batch_->writer.records() >= config_.coalesce.max_records) {
+      due = take_batch();
+    }
+    return due;
+  }
+
+  // Requires batch_mutex_.
+  auto take_batch() -> open_batch {
+    open_batch batch = std::move(*batch_);
+    batch_.reset();
+    batch_records_.store(0, std::memory_order_relaxed);
+    batch_open_.store(false, std::memory_order_relaxed);
+    batch_gen_.fetch_add(1, std::memory_order_release);
+    return batch;
+  }
+
+  // Sends a batch. If that fails, every call in it completes as failed with send_failed, so each
+  // caller throws transport_error; one not yet suspended, like the caller flushing the batch,
+  // just finds its slot done.
+  auto flush_batch(open_batch batch) -> cppcoro::task<void> {
+    std::size_t const len = batch.writer.finish();
+    try {
+      co_await send_frame(batch.buf, len);
+      co_return;
+    } catch (const std::exception &e) {
+      get_logger()->error("Client: batched send of {} requests failed: {}", batch.slots.size(),
+                          e.what());
+    }
+    for (uint32_t slot_idx : batch.slots) {
+      auto &slot = slots_[slot_idx];
+      slot.resp_flags = detail::kFlagFailed;
+      slot.resp_reserved = static_cast<uint32_t>(detail::failure_reason::send_failed);
+      slot.actual_len = 0;
+      resume_slot(slot_idx);
+    }
+  }
+
+  // Sends the open batch once it has waited max_delay, or sooner if it stops growing for
+  // idle_delay. Batches that fill up are sent by the caller that filled them.
+  void run_flusher(std::stop_token stop) {
+    auto const &coalesce = config_.coalesce;
+    std::stop_callback wake(stop, [this] {
+      batch_open_.store(true);
+      batch_open_.notify_one();
+    });
+    while (!stop.stop_requested()) {
+      batch_open_.wait(false, std::memory_order_acquire);
+      uint64_t const gen = batch_gen_.load(std::memory_order_acquire);
+      auto const opened = std::chrono::steady_clock::now();
+      auto grew = opened;
+      uint32_t records = batch_records_.load(std::memory_order_relaxed);
+      while (!stop.stop_requested() && batch_gen_.load(std::memory_order_acquire) == gen) {
+        auto const now = std::chrono::steady_clock::now();
+        if (uint32_t n = batch_records_.load(std::memory_order_relaxed); n != records) {
+          records = n;
+          grew = now;
+        }
+        if (now - opened < coalesce.max_delay && now - grew < coalesce.idle_delay) {
+          utils::detail::cpu_relax();
+          continue;
+        }
+        std::optional<open_batch> due;
+        {
+          std::lock_guard lock(batch_mutex_);
+          if (batch_ && batch_gen_.load(std::memory_order_relaxed) == gen) {
+            due = take_batch();
+          }
+        }
+        if (due) {
+          cppcoro::sync_wait(flush_batch(std::move(*due)));
+        }
         break;
       }
     }
   }
 
+  // Sends the first `len` bytes of `buf` and returns it to the pool.
+  auto send_frame(detail::buffer_pool::buffer buf, std::size_t len) -> cppcoro::task<void> {
+    std::exception_ptr err;
+    try {
+      co_await qp_->send(send_pool_.view(buf, len), rdmapp::use_native_awaitable);
+    } catch (...) {
+      err = std::current_exception();
+    }
+    send_pool_.release(buf);
+    if (err) {
+      std::rethrow_exception(err);
+    }
+  }
+
+  // Sends a header-only frame: rendezvous acks and stream credit or cancel.
+  auto send_control(uint64_t req_id, uint32_t flags, uint32_t value) -> cppcoro::task<void> {
+    auto buf = send_pool_.acquire(sizeof(detail::RpcHeader), config_.wait);
+    auto *header = reinterpret_cast<detail::RpcHeader *>(buf.data);
+    header->req_id = req_id;
+    header->payload_len = 0;
+    header->fn_id = 0;
+    header->flags = flags;
+    header->reserved = value;
+    co_await send_frame(buf, sizeof(detail::RpcHeader));
+  }
+
+  auto on_stream_frame(uint32_t slot_idx, uint32_t flags, std::span<const std::byte> payload)
+      -> void {
+    auto &stream = streams_[slot_idx];
+    std::coroutine_handle<> waiter;
+    bool release = false;
+    {
+      std::lock_guard lock(stream.mutex);
+      if (flags & detail::kFlagStreamEnd) {
+        stream.ended = true;
+        stream.aborted = (flags & detail::kFlagStreamAbort) != 0;
+        release = stream.abandoned;
+      } else if (!stream.abandoned) {
+        stream.items.emplace_back(payload.begin(), payload.end());
+      }
+      waiter = std::exchange(stream.waiter, nullptr);
+    }
+    if (release) {
+      free_slots_.enqueue(slot_idx);
+    }
+    if (waiter) {
+      waiter.resume();
+    }
+  }
+
+  // The consumer dropped its generator before the end frame: cancel the stream if it is still
+  // running and free the slot once it is over.
+  auto abandon_stream(uint32_t slot_idx, uint64_t req_id) -> void {
+    auto &stream = streams_[slot_idx];
+    bool ended;
+    {
+      std::lock_guard lock(stream.mutex);
+      stream.abandoned = true;
+      stream.items.clear();
+      ended = stream.ended;
+    }
+    if (ended) {
+      free_slots_.enqueue(slot_idx);
+    } else {
+      // Started from the generator's destructor, so it runs on in cancels_.
+      cancels_.spawn(cancel_stream(req_id));
+    }
+  }
+
+  auto cancel_stream(uint64_t req_id) -> cppcoro::task<void> {
+    try {
+      co_await send_control(req_id, detail::kFlagStreamCancel, 0);
+    } catch (const std::exception &e) {
+      get_logger()->error("Client: stream cancel failed: {}", e.what());
+    }
+  }
+
+  auto acquire_slot() -> uint32_t {
+    uint32_t slot_idx;
+    utils::backoff slot_backoff(config_.wait);
+    while (!free_slots_.try_dequeue(slot_idx)) {
+      slot_backoff.pause();
+    }
+    return slot_idx;
+  }
+
+  // A one-way request holds a slot for the server receive it uses, as a call does, until the
+  // server's credit frame says the receive is posted again. Slots carry nothing for one-ways, so
+  // any parked slot can be returned for any credit.
+  auto park_oneway_slot() -> void { oneway_slots_.enqueue(acquire_slot()); }
+
+  auto return_oneway_slots(uint32_t count) -> void {
+    for (uint32_t i = 0; i < count; ++i) {
+      uint32_t slot_idx;
+      if (!oneway_slots_.try_dequeue(slot_idx)) [[unlikely]] {
+        get_logger()->error("Client: credit for {} one-way requests, {} were pending", count, i);
+        return;
+      }
+      free_slots_.enqueue(slot_idx);
+    }
+  }
+
+  // Pulls a rendezvous response into `resp_buffer` (or a resized `growable`), then tells the
+  // server it may release its copy.
+  auto pull_rendezvous(uint32_t slot_idx, std::span<std::byte> resp_buffer,
+                       std::vector<std::byte> *growable)
+      -> cppcoro::task<std::size_t> {
+    auto const desc = rendezvous_[slot_idx];
+    if (growable != nullptr) {
+      growable->resize(desc.length);
+      resp_buffer = *growable;
+    }
+    std::size_t len = std::min<std::size_t>(desc.length, resp_buffer.size());
+
+    std::exception_ptr err;
+    try {
+      co_await detail::rendezvous_read(*qp_, desc, resp_buffer.first(len));
+    } catch (...) {
+      err = std::current_exception();
+    }
+
+    co_await send_control(slots_[slot_idx].expected_req_id, detail::kFlagRendezvousAck, 0);
+
+    if (err) {
+      std::rethrow_exception(err);
+    }
+    co_return len;
+  }
+
   RpcConfig const config_;
   std::size_t const send_buffer_size_;
   std::size_t const recv_buffer_size_;
 
   std::shared_ptr<rdmapp::qp> qp_;
 
-  std::vector<std::byte> send_buffer_pool_;
-  rdmapp::local_mr send_mr_;
-  std::vector<std::byte> recv_buffer_pool_;
-  rdmapp::local_mr recv_mr_;
+  std::shared_ptr<registered_arena> arena_;
+  detail::buffer_pool send_pool_;
+  registered_arena::block recv_block_;
 
   std::vector<detail::RpcSlot> slots_;
+  std::vector<detail::RendezvousDesc> rendezvous_;
+  std::vector<detail::StreamState> streams_;
   moodycamel::ConcurrentQueue<uint32_t> free_slots_;
+  // Slots held by one-way requests the server has not credited back yet.
+  moodycamel::ConcurrentQueue<uint32_t> oneway_slots_;
+  detail::replay_sequencer replay_;
+
+  // The batch small requests are currently being coalesced into.
+  std::mutex batch_mutex_;
+  std::optional<open_batch> batch_;
+  std::atomic<uint64_t> batch_gen_{0};
+  std::atomic<uint32_t> batch_records_{0};
+  std::atomic<bool> batch_open_{false};
+
+  // Stream cancels still being sent; joined before the rest of Impl goes away.
+  cppcoro::async_scope cancels_;
 
-  std::atomic<uint64_t> global_seq_{0};
   std::jthread worker_;
+  // Only runs with coalescing enabled.
+  std::jthread flusher_;
 };
 
-basic_client::basic_client(std::shared_ptr<rdmapp::qp> qp, RpcConfig config)
-    : impl_(std::make_unique<Impl>(qp, config)) {}
+basic_client::basic_client(std::shared_ptr<rdmapp::qp> qp, RpcConfig config,
+                           std::shared_ptr<registered_arena> arena)
+    : impl_(std::make_unique<Impl>(qp, config, std::move(arena))) {}
 
 basic_client::~basic_client() = default;
 
-auto basic_client::call(uint32_t fn_id, std::span<const std::byte> req_data,
-                        std::span<std::byte> resp_buffer) -> cppcoro::task<std::size_t> {
-  if (req_data.size() > impl_->config_.max_req_payload) {
-    throw std::runtime_error("request payload too large");
-  }
+auto basic_client::call(rpc_method method, std::span<const std::byte> req_data,
+                        std::span<std::byte> resp_buffer, resume_target resume)
+    -> cppcoro::task<std::size_t> {
+  return call_impl(method, req_data, resp_buffer, nullptr, resume);
+}
 
-  uint32_t slot_idx;
-  while (!impl_->free_slots_.try_dequeue(slot_idx)) {
-    detail::pause();
+auto basic_client::call(rpc_method method, std::span<const std::byte> req_data,
+                        std::vector<std::byte> &resp_buffer, resume_target resume)
+    -> cppcoro::task<std::size_t> {
+  return call_impl(method, req_data, resp_buffer, &resp_buffer, resume);
+}
+
+auto basic_client::call_bulk(uint32_t fn_id, std::span<const std::byte> req_data,
+                             std::span<std::byte> resp_buffer, bulk_region bulk,
+                             resume_target resume) -> cppcoro::task<bulk_result> {
+  if (bulk.mr == nullptr || bulk.offset > bulk.mr->length()) [[unlikely]] {
+    throw std::invalid_argument("bulk region outside its memory region");
+  }
+  std::size_t const length = bulk.length != 0 ? bulk.length : bulk.mr->length() - bulk.offset;
+  if (length > bulk.mr->length() - bulk.offset || length > UINT32_MAX) [[unlikely]] {
+    throw std::invalid_argument("bulk region outside its memory region");
+  }
+  // Bulk requests are never pulled by rendezvous, so the descriptors must fit beside them.
+  std::size_t const replay_len =
+      impl_->config_.at_most_once.enabled ? sizeof(detail::ReplayDesc) : 0;
+  if (replay_len + sizeof(detail::BulkDesc) + req_data.size() > impl_->config_.max_req_payload)
+      [[unlikely]] {
+    throw std::runtime_error("bulk request exceeds max_req_payload");
   }
 
-  uint64_t seq = impl_->global_seq_.fetch_add(1);
-  uint64_t req_id = detail::make_req_id(seq, slot_idx);
+  detail::BulkDesc const desc{
+      .addr = reinterpret_cast<uint64_t>(bulk.mr->addr()) + bulk.offset,
+      .length = static_cast<uint32_t>(length),
+      .rkey = bulk.mr->rkey(),
+      .access = static_cast<uint32_t>(bulk.access),
+      .reserved = 0,
+  };
+  std::size_t bulk_len = 0;
+  std::size_t resp_len =
+      co_await call_impl(fn_id, req_data, resp_buffer, nullptr, resume, &desc, &bulk_len);
+  co_return bulk_result{.resp_len = resp_len, .bulk_len = bulk_len};
+}
 
+auto basic_client::call_impl(rpc_method method, std::span<const std::byte> req_data,
+                             std::span<std::byte> resp_buffer, std::vector<std::byte> *growable,
+                             resume_target resume, detail::BulkDesc const *bulk,
+                             std::size_t *bulk_len) -> cppcoro::task<std::size_t> {
+  std::optional<detail::ReplayDesc> replay;
+  if (impl_->config_.at_most_once.enabled) {
+    replay = impl_->replay_.begin();
+  }
+  std::size_t const replay_len = replay ? sizeof(detail::ReplayDesc) : 0;
+  bool const rendezvous = replay_len + req_data.size() > impl_->config_.max_req_payload;
+
+  // Kept registered until the response arrives, by which point the server has pulled it.
+  std::optional<rdmapp::local_mr> req_mr;
+  if (rendezvous) {
+    req_mr.emplace(impl_->qp_->pd_ptr()->reg_mr(const_cast<std::byte *>(req_data.data()),
+                                                req_data.size()));
+  }
+
+  uint32_t slot_idx = impl_->acquire_slot();
   detail::RpcSlot &slot = impl_->slots_[slot_idx];
-  slot.waiter.store(detail::kWaiterEmpty);
+  uint64_t req_id = detail::make_req_id(++slot.generation, slot_idx);
   slot.user_resp_buffer = resp_buffer;
   slot.expected_req_id = req_id;
 
-  std::size_t send_offset = slot_idx * impl_->send_buffer_size_;
-  auto send_slice_mr =
-      rdmapp::mr_view(impl_->send_mr_, send_offset, sizeof(detail::RpcHeader) + req_data.size());
+  std::size_t nbytes = 0;
+  uint32_t resp_flags = 0;
+  uint32_t resp_reserved = 0;
+  std::exception_ptr err;
+  // Only at-most-once calls are sent again: the server runs each of those once however often
+  // it arrives.
+  for (uint32_t attempt = 0;; ++attempt) {
+    slot.waiter.store(detail::kWaiterEmpty);
+    slot.resp_flags = 0;
+    try {
+      if (!rendezvous && bulk == nullptr && !replay && impl_->coalescable(req_data.size())) {
+        detail::RpcHeader header{
+            .req_id = req_id,
+            .payload_len = static_cast<uint32_t>(req_data.size()),
+            .fn_id = method.fn_id,
+            .flags = detail::method_flags(method),
+            .reserved = 0,
+        };
+        detail::stamp_deadline(header, impl_->config_.deadline);
+        if (auto due = impl_->add_to_batch(header, req_data, slot_idx)) {
+          co_await impl_->flush_batch(std::move(*due));
+        }
+      } else {
+        std::size_t const bulk_desc_len = bulk != nullptr ? sizeof(detail::BulkDesc) : 0;
+        std::size_t const payload_len =
+            replay_len + bulk_desc_len +
+            (rendezvous ? sizeof(detail::RendezvousDesc) : req_data.size());
+        std::size_t const frame_len = sizeof(detail::RpcHeader) + payload_len;
+        auto send_buf = impl_->send_pool_.acquire(frame_len, impl_->config_.wait);
+
+        detail::RpcHeader *header = reinterpret_cast<detail::RpcHeader *>(send_buf.data);
+        header->req_id = req_id;
+        header->payload_len = static_cast<uint32_t>(payload_len);
+        header->fn_id = method.fn_id;
+        header->flags = (rendezvous ? detail::kFlagRendezvous : 0) |
+                        (bulk ? detail::kFlagBulk : 0) | (replay ? detail::kFlagReplay : 0) |
+                        detail::method_flags(method);
+        header->reserved = 0;
+        detail::stamp_deadline(*header, impl_->config_.deadline);
+
+        std::byte *payload = send_buf.data + sizeof(detail::RpcHeader);
+        if (replay) {
+          std::memcpy(payload, &*replay, sizeof(*replay));
+          payload += sizeof(*replay);
+        }
+        if (bulk != nullptr) {
+          std::memcpy(payload, bulk, sizeof(*bulk));
+          payload += sizeof(*bulk);
+        }
+        if (rendezvous) {
+          auto desc = detail::make_rendezvous_desc(*req_mr);
+          std::memcpy(payload, &desc, sizeof(desc));
+        } else {
+          std::copy_n(req_data.data(), req_data.size(), payload);
+        }
+        co_await impl_->send_frame(send_buf, frame_len);
+      }
+      nbytes = co_await detail::RpcResponseAwaitable{slot};
+      if (bulk_len != nullptr) {
+        *bulk_len = slot.resp_reserved;
+      }
+      if (slot.resp_flags & detail::kFlagRendezvous) {
+        nbytes = co_await impl_->pull_rendezvous(slot_idx, resp_buffer, growable);
+      }
+    } catch (const std::exception &e) {
+      // Rethrown once the slot is free; a response that could not be pulled is not returned.
+      get_logger()->error("Client: RPC failed: {}", e.what());
+      err = std::current_exception();
+      break;
+    }
+    resp_flags = slot.resp_flags;
+    resp_reserved = slot.resp_reserved;
+    if (!replay || attempt >= impl_->config_.at_most_once.retries ||
+        !(resp_flags & (detail::kFlagExpired | detail::kFlagOverloaded))) {
+      break;
+    }
+  }
+  if (replay) {
+    impl_->replay_.end(replay->seq);
+  }
 
-  detail::RpcHeader *header = reinterpret_cast<detail::RpcHeader *>(send_slice_mr.span().data());
-  header->req_id = req_id;
+  impl_->free_slots_.enqueue(slot_idx);
+  if (!resume.is_inline()) {
+    // Only the hop itself runs on the completion thread; everything after it is the caller's.
+    co_await resume.hop(resume.scheduler);
+  }
+  if (err) {
+    std::rethrow_exception(err);
+  }
+  detail::check_rejected(resp_flags, resp_reserved);
+  co_return nbytes;
+}
+
+auto basic_client::call_oneway(rpc_method method, std::span<const std::byte> req_data,
+                               resume_target resume) -> cppcoro::task<void> {
+  if (req_data.size() > impl_->config_.max_req_payload) [[unlikely]] {
+    throw std::runtime_error("one-way request exceeds max_req_payload");
+  }
+
+  // Parked before the send, so the server's credit always finds it.
+  impl_->park_oneway_slot();
+  std::size_t const frame_len = sizeof(detail::RpcHeader) + req_data.size();
+  auto send_buf = impl_->send_pool_.acquire(frame_len, impl_->config_.wait);
+
+  auto *header = reinterpret_cast<detail::RpcHeader *>(send_buf.data);
+  header->req_id = 0;
   header->payload_len = static_cast<uint32_t>(req_data.size());
-  header->fn_id = fn_id;
+  header->fn_id = method.fn_id;
+  header->flags = detail::kFlagOneWay | detail::method_flags(method);
+  header->reserved = 0;
+  detail::stamp_deadline(*header, impl_->config_.deadline);
+  std::copy_n(req_data.data(), req_data.size(), send_buf.data + sizeof(detail::RpcHeader));
+
+  // The buffer goes back to the pool as soon as the send completes.
+  std::exception_ptr err;
+  try {
+    co_await impl_->send_frame(send_buf, frame_len);
+  } catch (...) {
+    err = std::current_exception();
+  }
+  if (err) {
+    // The server never saw it and will not credit it back.
+    impl_->return_oneway_slots(1);
+    std::rethrow_exception(err);
+  }
+  if (!resume.is_inline()) {
+    co_await resume.hop(resume.scheduler);
+  }
+}
 
-  std::copy_n(req_data.data(), req_data.size(),
-              send_slice_mr.span().data() + sizeof(detail::RpcHeader));
+auto basic_client::call_stream(uint32_t fn_id, std::span<const std::byte> req_data)
+    -> cppcoro::async_generator<std::span<const std::byte>> {
+  if (req_data.size() > impl_->config_.max_req_payload) [[unlikely]] {
+    throw std::runtime_error("stream request exceeds max_req_payload");
+  }
+  uint32_t const window = std::max<uint32_t>(impl_->config_.stream_window, 1);
 
-  std::size_t nbytes = 0;
+  uint32_t slot_idx = impl_->acquire_slot();
+  detail::RpcSlot &slot = impl_->slots_[slot_idx];
+  uint64_t req_id = detail::make_req_id(++slot.generation, slot_idx);
+  slot.expected_req_id = req_id;
+  auto &stream = impl_->streams_[slot_idx];
+  {
+    std::lock_guard lock(stream.mutex);
+    stream.items.clear();
+    stream.waiter = nullptr;
+    stream.ended = false;
+    stream.aborted = false;
+    stream.abandoned = false;
+  }
+
+  std::size_t const frame_len = sizeof(detail::RpcHeader) + req_data.size();
+  auto send_buf = impl_->send_pool_.acquire(frame_len, impl_->config_.wait);
+  auto *header = reinterpret_cast<detail::RpcHeader *>(send_buf.data);
+  header->req_id = req_id;
+  header->payload_len = static_cast<uint32_t>(req_data.size());
+  header->fn_id = fn_id;
+  header->flags = detail::kFlagStream;
+  header->reserved = window;
+  std::copy_n(req_data.data(), req_data.size(), send_buf.data + sizeof(detail::RpcHeader));
   try {
-    co_await impl_->qp_->send(send_slice_mr, rdmapp::use_native_awaitable);
-    nbytes = co_await detail::RpcResponseAwaitable{slot};
-  } catch (const std::exception &e) {
-    get_logger()->error("Client: RPC failed: {}", e.what());
+    co_await impl_->send_frame(send_buf, frame_len);
+  } catch (...) {
+    impl_->free_slots_.enqueue(slot_idx);
+    throw;
   }
 
+  // Runs when the generator is destroyed before the stream was drained.
+  struct abandon_guard {
+    Impl &impl;
+    uint32_t slot_idx;
+    uint64_t req_id;
+    bool done = false;
+    ~abandon_guard() {
+      if (!done) {
+        impl.abandon_stream(slot_idx, req_id);
+      }
+    }
+  } guard{*impl_, slot_idx, req_id};
+
+  // Hand credit back in batches of half the window so the server never stalls on a full one.
+  uint32_t const credit_batch = (window + 1) / 2;
+  uint32_t consumed = 0;
+  while (true) {
+    auto item = co_await detail::StreamItemAwaitable{stream};
+    if (!item) {
+      break;
+    }
+    co_yield std::span<const std::byte>(*item);
+    if (++consumed >= credit_batch) {
+      co_await impl_->send_control(req_id, detail::kFlagStreamCredit, consumed);
+      consumed = 0;
+    }
+  }
+
+  guard.done = true;
+  bool aborted;
+  {
+    std::lock_guard lock(stream.mutex);
+    aborted = stream.aborted;
+  }
   impl_->free_slots_.enqueue(slot_idx);
-  co_return nbytes;
+  if (aborted) {
+    throw std::runtime_error("stream aborted by the server");
+  }
 }
 
 } // namespace coverbs_rpc
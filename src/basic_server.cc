@@ -1,77 +1,610 @@
 #include "coverbs_rpc/basic_server.hpp"
+#include "coverbs_rpc/detail/coalesce.hpp"
 #include "coverbs_rpc/detail/logger.hpp"
 
-#include <cppcoro/async_scope.hpp>
+#include <algorithm>
+#include <cppcoro/single_consumer_event.hpp>
 #include <cppcoro/when_all.hpp>
+#include <cstring>
 #include <exception>
+#include <optional>
+#include <stdexcept>
+#include <utility>
 
 namespace coverbs_rpc {
 using detail::get_logger;
 
+struct basic_server::stream_state {
+  explicit stream_state(uint32_t window)
+      : credits(window) {}
+
+  std::atomic<uint32_t> credits;
+  std::atomic<bool> cancelled{false};
+  cppcoro::single_consumer_event credit_event;
+};
+
+basic_server::basic_server(std::shared_ptr<rdmapp::qp> qp, const basic_mux &mux, RpcConfig config,
+                           std::uint32_t thread_count, std::shared_ptr<registered_arena> arena,
+                           std::shared_ptr<admission_control> admission, rpc_session *session)
+    : basic_server(std::move(qp), mux, config,
+                   std::make_shared<cppcoro::static_thread_pool>(thread_count), std::move(arena),
+                   std::move(admission), nullptr, session) {}
+
 basic_server::basic_server(std::shared_ptr<rdmapp::qp> qp, const basic_mux &mux, RpcConfig config,
-                           std::uint32_t thread_count)
+                           std::shared_ptr<cppcoro::static_thread_pool> executor,
+                           std::shared_ptr<registered_arena> arena,
+                           std::shared_ptr<admission_control> admission,
+                           std::shared_ptr<priority_scheduler> scheduler,
+                           rpc_session *session)
     : mux_(mux)
     , config_(config)
     , send_buffer_size_(config_.max_resp_payload + sizeof(detail::RpcHeader))
     , recv_buffer_size_(config_.max_req_payload + sizeof(detail::RpcHeader))
     , qp_(qp)
-    , tp_(thread_count)
-    , recv_buffer_pool_(config_.max_inflight * recv_buffer_size_)
-    , recv_mr_(qp->pd_ptr()->reg_mr(recv_buffer_pool_.data(), recv_buffer_pool_.size()))
-    , send_buffer_pool_(config_.max_inflight * send_buffer_size_)
-    , send_mr_(qp->pd_ptr()->reg_mr(send_buffer_pool_.data(), send_buffer_pool_.size())) {
-  get_logger()->info("Server initialized with {} slots, thread_count={}", config_.max_inflight,
-                     thread_count);
+    , tp_(std::move(executor))
+    , arena_(arena ? std::move(arena) : registered_arena::create(qp->pd_ptr(), config_.memory))
+    , recv_block_(arena_->allocate(config_.max_inflight * recv_buffer_size_))
+    , send_pool_(*arena_, send_buffer_size_, config_.max_inflight, config_.min_send_class)
+    , admission_(admission ? std::move(admission)
+                           : std::make_shared<admission_control>(config_.admission))
+    , scheduler_(scheduler || !config_.priority.enabled
+                     ? std::move(scheduler)
+                     : std::make_shared<priority_scheduler>(tp_, config_.priority))
+    , session_(session) {
+  if (config_.max_resp_payload < sizeof(detail::RendezvousDesc)) [[unlikely]] {
+    throw std::runtime_error("max_resp_payload too small to carry a rendezvous descriptor");
+  }
+  get_logger()->info("Server initialized with {} slots, thread_count={}, send_pool={}",
+                     config_.max_inflight, tp_->thread_count(), send_pool_.registered_bytes());
 }
 
 auto basic_server::run() -> cppcoro::task<void> {
   cppcoro::async_scope scope;
   for (std::size_t i = 0; i < config_.max_inflight; ++i) {
-    scope.spawn(server_worker(i));
+    scope.spawn(server_worker(i, scope));
   }
   co_await scope.join();
+  get_logger()->info("Server: connection closed");
 }
 
-auto basic_server::server_worker(std::size_t idx) -> cppcoro::task<void> {
+auto basic_server::server_worker(std::size_t idx, cppcoro::async_scope &scope)
+    -> cppcoro::task<void> {
   std::size_t const recv_offset = idx * recv_buffer_size_;
-  std::size_t const send_offset = idx * send_buffer_size_;
-
-  auto recv_mr = rdmapp::mr_view(recv_mr_, recv_offset, recv_buffer_size_);
-  auto send_mr = rdmapp::mr_view(send_mr_, send_offset, send_buffer_size_);
 
-  auto const resp_payload_span =
-      std::span<std::byte>(static_cast<std::byte *>(send_mr.addr()) + sizeof(detail::RpcHeader),
-                           config_.max_resp_payload);
+  auto recv_mr = recv_block_.view(recv_offset, recv_buffer_size_);
 
+  bool credit_oneway = false;
   while (true) {
-    auto [nbytes, _] = co_await qp_->recv(recv_mr, rdmapp::use_native_awaitable);
+    // The client holds a slot for every one-way request until its receive is posted again.
+    if (std::exchange(credit_oneway, false)) {
+      return_oneway_credit(scope);
+    }
+    std::size_t nbytes = 0;
+    try {
+      auto [received, _] = co_await qp_->recv(recv_mr, rdmapp::use_native_awaitable);
+      nbytes = received;
+    } catch (const std::exception &e) {
+      // A failed QP flushes every posted receive, so all workers end here and run() returns.
+      get_logger()->debug("Server: worker {} stopped: {}", idx, e.what());
+      co_return;
+    }
 
     if (nbytes < sizeof(detail::RpcHeader)) [[unlikely]] {
       get_logger()->warn("Server: received too small packet: {}", nbytes);
       continue;
     }
-
-    co_await tp_.schedule();
+    // Deadline budgets count from here: waiting for a pool thread is what they guard against.
+    auto const arrived = std::chrono::steady_clock::now();
 
     auto *header = reinterpret_cast<detail::RpcHeader *>(recv_mr.addr());
+    credit_oneway = (header->flags & detail::kFlagOneWay) != 0;
+    if (header->flags & detail::kFlagRendezvousAck) {
+      release_rendezvous(header->req_id);
+      continue;
+    }
+    if (header->flags & (detail::kFlagStreamCredit | detail::kFlagStreamCancel)) {
+      update_stream(*header);
+      continue;
+    }
+
+    // Shed before any work is spent on the request, a rendezvous pull included. Batches are
+    // admitted record by record, and streams, which hold their slot for as long as they run,
+    // are not subject to admission.
+    std::optional<admission_control::ticket> admitted;
+    if (!(header->flags & (detail::kFlagBatch | detail::kFlagStream))) {
+      admitted = admission_->admit(header->fn_id, arrived);
+      if (!admitted) {
+        if (!(header->flags & detail::kFlagOneWay)) {
+          try {
+            co_await send_frame(header->req_id, header->fn_id, detail::kFlagOverloaded, {});
+          } catch (const std::exception &e) {
+            get_logger()->error("Server: send overloaded reply failed: {}", e.what());
+          }
+        }
+        continue;
+      }
+    }
+
     auto payload = std::span<std::byte>(
         static_cast<std::byte *>(recv_mr.addr()) + sizeof(detail::RpcHeader), header->payload_len);
-    auto *resp_header = reinterpret_cast<detail::RpcHeader *>(send_mr.addr());
 
-    std::size_t resp_payload_len = mux_.dispatch(header->fn_id, payload, resp_payload_span);
+    if (header->flags & detail::kFlagBatch) {
+      // The records stay in the receive buffer, which is not reposted until they are served.
+      priority_scheduler::running running;
+      if (scheduler_) {
+        // Scheduled as a whole, ahead of any of its records' own classes.
+        running = co_await scheduler_->schedule(rpc_priority::normal);
+      } else {
+        co_await tp_->schedule();
+      }
+      co_await serve_batch(payload, header->reserved, arrived);
+      continue;
+    }
 
-    resp_header->req_id = header->req_id;
-    resp_header->payload_len = static_cast<uint32_t>(resp_payload_len);
+    // At-most-once calls lead with their ReplayDesc, ahead of any rendezvous or bulk descriptor.
+    std::optional<detail::ReplayDesc> replay;
+    bool pulled = detail::take_replay(header->flags, payload, replay);
+    if (!pulled) [[unlikely]] {
+      get_logger()->warn("Server: malformed replay descriptor: {}", payload.size());
+    }
+
+    std::vector<std::byte> large_req;
+    if ((header->flags & detail::kFlagRendezvous) && pulled) {
+      detail::RendezvousDesc desc{};
+      if (payload.size() >= sizeof(desc)) {
+        std::memcpy(&desc, payload.data(), sizeof(desc));
+      }
+      if (payload.size() < sizeof(desc)) [[unlikely]] {
+        get_logger()->warn("Server: malformed rendezvous descriptor: {}", payload.size());
+        pulled = false;
+      } else if (desc.length > config_.max_rendezvous_bytes) [[unlikely]] {
+        get_logger()->warn("Server: rendezvous request of {} bytes exceeds the {} byte limit",
+                           desc.length, config_.max_rendezvous_bytes);
+        pulled = false;
+      } else {
+        large_req.resize(desc.length);
+        try {
+          co_await detail::rendezvous_read(*qp_, desc, large_req);
+        } catch (const std::exception &e) {
+          get_logger()->error("Server: rendezvous read of {} bytes failed: {}", desc.length,
+                              e.what());
+          pulled = false;
+        }
+      }
+      payload = large_req;
+    }
 
-    std::size_t resp_len = sizeof(detail::RpcHeader) + resp_payload_len;
-    auto send_view = rdmapp::mr_view(send_mr_, send_offset, resp_len);
+    // Bulk calls: the client's buffer is pulled before dispatch and written after it, both
+    // through one block of the already registered arena, so no call registers memory.
+    detail::BulkDesc bulk{};
+    registered_arena::block bulk_block;
+    if ((header->flags & detail::kFlagBulk) && pulled) {
+      if (payload.size() < sizeof(bulk)) [[unlikely]] {
+        get_logger()->warn("Server: malformed bulk descriptor: {}", payload.size());
+        pulled = false;
+      } else {
+        std::memcpy(&bulk, payload.data(), sizeof(bulk));
+        payload = payload.subspan(sizeof(bulk));
+      }
+      if (pulled && bulk.length > config_.max_bulk_bytes) [[unlikely]] {
+        get_logger()->warn("Server: bulk buffer of {} bytes exceeds the {} byte limit",
+                           bulk.length, config_.max_bulk_bytes);
+        // Checked before allocating; a refused call hands the handler no bulk spans.
+        bulk = {};
+        pulled = false;
+      } else if (pulled) {
+        bulk_block = arena_->allocate(bulk.length);
+        if ((bulk.access & static_cast<uint32_t>(bulk_access::read)) && bulk.length != 0) {
+          try {
+            co_await qp_->read(bulk_block.view(0, bulk.length),
+                               detail::to_remote_mr(detail::bulk_target(bulk), bulk.length),
+                               rdmapp::use_native_awaitable);
+          } catch (const std::exception &e) {
+            get_logger()->error("Server: bulk read of {} bytes failed: {}", bulk.length,
+                                e.what());
+            pulled = false;
+          }
+        }
+      }
+    }
+
+    if (header->flags & detail::kFlagStream) {
+      // Streams outlive this receive, so they run on their own and take a copy of the request.
+      if (pulled) {
+        scope.spawn(serve_stream(header->req_id, header->fn_id, header->reserved,
+                                 std::vector<std::byte>(payload.begin(), payload.end())));
+      } else {
+        try {
+          co_await send_frame(header->req_id, header->fn_id,
+                              detail::kFlagStream | detail::kFlagStreamEnd |
+                                  detail::kFlagStreamAbort,
+                              {});
+        } catch (const std::exception &e) {
+          get_logger()->error("Server: send stream abort failed: {}", e.what());
+        }
+      }
+      continue;
+    }
+
+    priority_scheduler::running running;
+    if (scheduler_) {
+      running = co_await scheduler_->schedule(mux_.priority(header->fn_id));
+    } else {
+      co_await tp_->schedule();
+    }
+    admitted->start();
+
+    // Handlers write straight into a full-size send buffer, of which the pool holds one per
+    // worker, so the response is not copied on its way out.
+    auto frame = send_pool_.acquire(send_buffer_size_, config_.wait);
+    auto const resp_payload_span =
+        std::span<std::byte>(frame.data + sizeof(detail::RpcHeader), config_.max_resp_payload);
+
+    // Checked before the handler runs and again before replying, so work nobody waits for any
+    // more is skipped under overload.
+    auto const deadline = detail::request_deadline(*header, arrived);
+    bool expired = detail::past(deadline);
+
+    rpc_context ctx;
+    ctx.session = session_;
+    ctx.replay = replay;
+    if (bulk.access & static_cast<uint32_t>(bulk_access::read)) {
+      ctx.bulk_in = bulk_block.span().first(bulk.length);
+    }
+    if (bulk.access & static_cast<uint32_t>(bulk_access::write)) {
+      ctx.bulk_out = bulk_block.span().first(bulk.length);
+    }
+    if (header->flags & detail::kFlagOneWay) {
+      try {
+        if (pulled && !expired) {
+          mux_.dispatch(*header, payload, resp_payload_span, ctx);
+        }
+      } catch (const std::exception &e) {
+        get_logger()->error("Server: one-way handler for fn_id={} failed: {}", header->fn_id,
+                            e.what());
+      }
+      send_pool_.release(frame);
+      continue;
+    }
+    std::size_t resp_payload_len = 0;
+    if (!pulled) {
+      ctx.failure = detail::failure_reason::malformed_request;
+    } else if (!expired) {
+      try {
+        resp_payload_len = mux_.dispatch(*header, payload, resp_payload_span, ctx);
+      } catch (const std::exception &e) {
+        get_logger()->error("Server: handler for fn_id={} failed: {}", header->fn_id, e.what());
+        ctx.failure = detail::failure_reason::handler_failed;
+      }
+    }
+    running.finish();
+    expired = expired || detail::past(deadline);
+
+    uint32_t resp_flags = 0;
+    uint32_t resp_reserved = 0;
+    if (expired) {
+      // Nothing of the response is staged or written back.
+      resp_flags = detail::kFlagExpired;
+      resp_payload_len = 0;
+      ctx.bulk_written = 0;
+    } else if (ctx.failure) {
+      resp_flags = detail::kFlagFailed;
+      resp_reserved = static_cast<uint32_t>(*ctx.failure);
+      resp_payload_len = 0;
+      ctx.bulk_written = 0;
+    } else if (!ctx.large_resp.empty()) {
+      ctx.large_resp.resize(resp_payload_len);
+      auto desc = stage_rendezvous(header->req_id, std::move(ctx.large_resp));
+      std::memcpy(resp_payload_span.data(), &desc, sizeof(desc));
+      resp_flags = detail::kFlagRendezvous;
+      resp_payload_len = sizeof(desc);
+    }
+
+    std::size_t const frame_len = sizeof(detail::RpcHeader) + resp_payload_len;
+    auto *resp_header = reinterpret_cast<detail::RpcHeader *>(frame.data);
+    *resp_header = detail::RpcHeader{.req_id = header->req_id,
+                                     .payload_len = static_cast<uint32_t>(resp_payload_len),
+                                     .fn_id = header->fn_id,
+                                     .flags = resp_flags,
+                                     .reserved = resp_reserved};
+
+    // Written before the response is sent, so on an RC QP it has landed when the client sees it.
+    if (ctx.bulk_written != 0) {
+      if (ctx.bulk_written > ctx.bulk_out.size()) [[unlikely]] {
+        get_logger()->error("Server: bulk output of {} bytes exceeds the {} writable bytes",
+                            ctx.bulk_written, ctx.bulk_out.size());
+      } else {
+        try {
+          co_await qp_->write(bulk_block.view(0, ctx.bulk_written),
+                              detail::to_remote_mr(detail::bulk_target(bulk), ctx.bulk_written),
+                              rdmapp::use_native_awaitable);
+          resp_header->reserved = static_cast<uint32_t>(ctx.bulk_written);
+        } catch (const std::exception &e) {
+          get_logger()->error("Server: bulk write of {} bytes failed: {}", ctx.bulk_written,
+                              e.what());
+        }
+      }
+    }
 
     try {
-      co_await qp_->send(send_view, rdmapp::use_native_awaitable);
+      co_await send_frame(frame, frame_len);
     } catch (const std::exception &e) {
       get_logger()->error("Server: send reply failed: {}", e.what());
     }
   }
 }
 
+auto basic_server::serve_batch(std::span<std::byte> records, uint32_t count,
+                               std::chrono::steady_clock::time_point arrived)
+    -> cppcoro::task<void> {
+  std::vector<std::pair<detail::RpcHeader, std::span<std::byte>>> reqs;
+  reqs.reserve(count);
+  bool const well_formed = detail::for_each_record(
+      records, count, [&](detail::RpcHeader const &req, std::span<std::byte> payload) {
+        reqs.emplace_back(req, payload);
+      });
+  if (!well_formed) [[unlikely]] {
+    get_logger()->warn("Server: malformed batch of {} records", count);
+  }
+
+  // Responses are packed the same way. The last frame goes out once every record is served, so
+  // unlike the client this side needs no timer.
+  std::optional<detail::buffer_pool::buffer> frame;
+  std::optional<detail::batch_writer> writer;
+  auto flush = [&]() -> cppcoro::task<void> {
+    if (writer) {
+      std::size_t const len = writer->finish();
+      writer.reset();
+      co_await send_frame(*std::exchange(frame, std::nullopt), len);
+      // Sends complete on the CQ thread; the remaining handlers belong on the pool.
+      co_await tp_->schedule();
+    }
+  };
+
+  for (auto const &[req, payload] : reqs) {
+    // Looked up per record: a flush may have moved this coroutine to another pool thread.
+    thread_local std::vector<std::byte> scratch;
+    if (scratch.size() < config_.max_resp_payload) {
+      scratch.resize(config_.max_resp_payload);
+    }
+    auto const resp_payload_span = std::span<std::byte>(scratch.data(), config_.max_resp_payload);
+
+    auto const deadline = detail::request_deadline(req, arrived);
+    auto admitted = admission_->admit(req.fn_id, arrived);
+    uint32_t resp_flags = 0;
+    if (!admitted) {
+      resp_flags = detail::kFlagOverloaded;
+    } else if (detail::past(deadline)) {
+      resp_flags = detail::kFlagExpired;
+    }
+    if (admitted) {
+      admitted->start();
+    }
+
+    rpc_context ctx;
+    ctx.session = session_;
+    if (req.flags & detail::kFlagOneWay) {
+      try {
+        if (resp_flags == 0) {
+          mux_.dispatch(req, payload, resp_payload_span, ctx);
+        }
+      } catch (const std::exception &e) {
+        get_logger()->error("Server: one-way handler for fn_id={} failed: {}", req.fn_id,
+                            e.what());
+      }
+      continue;
+    }
+    std::size_t resp_len = 0;
+    uint32_t resp_reserved = 0;
+    if (resp_flags == 0) {
+      try {
+        resp_len = mux_.dispatch(req, payload, resp_payload_span, ctx);
+      } catch (const std::exception &e) {
+        get_logger()->error("Server: handler for fn_id={} failed: {}", req.fn_id, e.what());
+        resp_flags = detail::kFlagFailed;
+        resp_reserved = static_cast<uint32_t>(detail::failure_reason::handler_failed);
+        ctx.large_resp.clear();
+      }
+    }
+    if (resp_flags == 0 && detail::past(deadline)) {
+      resp_flags = detail::kFlagExpired;
+      resp_len = 0;
+      ctx.large_resp.clear();
+    }
+
+    try {
+      if (!ctx.large_resp.empty()) {
+        // The client pulls it, as for an uncoalesced call.
+        ctx.large_resp.resize(resp_len);
+        auto desc = stage_rendezvous(req.req_id, std::move(ctx.large_resp));
+        co_await send_frame(req.req_id, req.fn_id, detail::kFlagRendezvous,
+                            std::as_bytes(std::span{&desc, 1}));
+        co_await tp_->schedule();
+        continue;
+      }
+      auto const resp = resp_payload_span.first(resp_len);
+      if (writer && !writer->fits(resp.size())) {
+        co_await flush();
+      }
+      if (!writer) {
+        frame = send_pool_.acquire(send_buffer_size_, config_.wait);
+        writer.emplace(frame->data, config_.max_resp_payload);
+        if (!writer->fits(resp.size())) {
+          // Only fits a frame of its own.
+          writer.reset();
+          send_pool_.release(*std::exchange(frame, std::nullopt));
+          co_await send_frame(req.req_id, req.fn_id, resp_flags, resp);
+          co_await tp_->schedule();
+          continue;
+        }
+      }
+      writer->append(detail::RpcHeader{.req_id = req.req_id,
+                                       .payload_len = static_cast<uint32_t>(resp.size()),
+                                       .fn_id = req.fn_id,
+                                       .flags = resp_flags,
+                                       .reserved = resp_reserved},
+                     resp);
+    } catch (const std::exception &e) {
+      get_logger()->error("Server: send batched reply failed: {}", e.what());
+    }
+  }
+  try {
+    co_await flush();
+  } catch (const std::exception &e) {
+    get_logger()->error("Server: send batched reply failed: {}", e.what());
+  }
+}
+
+auto basic_server::stage_rendezvous(uint64_t req_id, std::vector<std::byte> resp)
+    -> detail::RendezvousDesc {
+  auto buf = std::make_unique<detail::RendezvousBuffer>(*qp_->pd_ptr(), std::move(resp));
+  auto desc = detail::make_rendezvous_desc(buf->mr);
+  std::lock_guard lock(rendezvous_mutex_);
+  rendezvous_resps_[req_id] = std::move(buf);
+  return desc;
+}
+
+auto basic_server::send_frame(detail::buffer_pool::buffer buf, std::size_t len)
+    -> cppcoro::task<void> {
+  std::exception_ptr err;
+  try {
+    co_await qp_->send(send_pool_.view(buf, len), rdmapp::use_native_awaitable);
+  } catch (...) {
+    err = std::current_exception();
+  }
+  send_pool_.release(buf);
+  if (err) {
+    std::rethrow_exception(err);
+  }
+}
+
+auto basic_server::send_frame(uint64_t req_id, uint32_t fn_id, uint32_t flags,
+                              std::span<const std::byte> payload, uint32_t reserved)
+    -> cppcoro::task<void> {
+  std::size_t const len = sizeof(detail::RpcHeader) + payload.size();
+  auto buf = send_pool_.acquire(len, config_.wait);
+  auto *header = reinterpret_cast<detail::RpcHeader *>(buf.data);
+  header->req_id = req_id;
+  header->payload_len = static_cast<uint32_t>(payload.size());
+  header->fn_id = fn_id;
+  header->flags = flags;
+  header->reserved = reserved;
+  std::copy_n(payload.data(), payload.size(), buf.data + sizeof(detail::RpcHeader));
+  co_await send_frame(buf, len);
+}
+
+auto basic_server::return_oneway_credit(cppcoro::async_scope &scope) -> void {
+  oneway_credits_.fetch_add(1);
+  if (!crediting_.exchange(true)) {
+    scope.spawn(send_oneway_credits());
+  }
+}
+
+auto basic_server::send_oneway_credits() -> cppcoro::task<void> {
+  // One credit frame is in flight at a time; one-ways served meanwhile ride on the next.
+  while (true) {
+    uint32_t const n = oneway_credits_.exchange(0);
+    if (n == 0) {
+      crediting_.store(false);
+      // A one-way counted after the exchange saw crediting_ still set and left it to us.
+      if (oneway_credits_.load() == 0 || crediting_.exchange(true)) {
+        co_return;
+      }
+      continue;
+    }
+    try {
+      co_await send_frame(0, 0, detail::kFlagOneWay, {}, n);
+    } catch (const std::exception &e) {
+      get_logger()->error("Server: send one-way credit failed: {}", e.what());
+      co_return;
+    }
+  }
+}
+
+auto basic_server::serve_stream(uint64_t req_id, uint32_t fn_id, uint32_t window,
+                                std::vector<std::byte> req) -> cppcoro::task<void> {
+  // Registered while still on the worker that received the request, so a credit or cancel frame
+  // handled by another worker during the hop below finds the stream.
+  auto state = std::make_shared<stream_state>(std::max<uint32_t>(window, 1));
+  {
+    std::lock_guard lock(streams_mutex_);
+    streams_[req_id] = state;
+  }
+  co_await tp_->schedule();
+
+  uint32_t end_flags = detail::kFlagStream | detail::kFlagStreamEnd;
+  try {
+    auto items = mux_.open_stream(fn_id, req);
+    for (auto item = co_await items.begin(); item != items.end(); co_await ++item) {
+      // Wait for the client to hand back credit before running ahead of it.
+      while (state->credits.load(std::memory_order_acquire) == 0 &&
+             !state->cancelled.load(std::memory_order_acquire)) {
+        co_await state->credit_event;
+        state->credit_event.reset();
+        co_await tp_->schedule();
+      }
+      if (state->cancelled.load(std::memory_order_acquire)) {
+        break;
+      }
+      state->credits.fetch_sub(1, std::memory_order_acq_rel);
+
+      std::span<const std::byte> frame = *item;
+      if (frame.size() > config_.max_resp_payload) [[unlikely]] {
+        get_logger()->error("Server: stream item of {} bytes exceeds max_resp_payload",
+                            frame.size());
+        end_flags |= detail::kFlagStreamAbort;
+        break;
+      }
+      co_await send_frame(req_id, fn_id, detail::kFlagStream, frame);
+    }
+  } catch (const std::exception &e) {
+    get_logger()->error("Server: stream for fn_id={} failed: {}", fn_id, e.what());
+    end_flags |= detail::kFlagStreamAbort;
+  }
+
+  {
+    std::lock_guard lock(streams_mutex_);
+    streams_.erase(req_id);
+  }
+  try {
+    co_await send_frame(req_id, fn_id, end_flags, {});
+  } catch (const std::exception &e) {
+    get_logger()->error("Server: send end of stream failed: {}", e.what());
+  }
+}
+
+auto basic_server::update_stream(detail::RpcHeader const &header) -> void {
+  std::shared_ptr<stream_state> state;
+  {
+    std::lock_guard lock(streams_mutex_);
+    auto it = streams_.find(header.req_id);
+    if (it == streams_.end()) {
+      // The stream already ended; late credit or cancel frames are expected.
+      return;
+    }
+    state = it->second;
+  }
+  if (header.flags & detail::kFlagStreamCancel) {
+    state->cancelled.store(true, std::memory_order_release);
+  } else {
+    state->credits.fetch_add(header.reserved, std::memory_order_acq_rel);
+  }
+  state->credit_event.set();
+}
+
+auto basic_server::release_rendezvous(uint64_t req_id) -> void {
+  std::unique_ptr<detail::RendezvousBuffer> buf;
+  {
+    std::lock_guard lock(rendezvous_mutex_);
+    auto it = rendezvous_resps_.find(req_id);
+    if (it == rendezvous_resps_.end()) [[unlikely]] {
+      get_logger()->warn("Server: rendezvous ack for unknown req_id={}", req_id);
+      return;
+    }
+    buf = std::move(it->second);
+    rendezvous_resps_.erase(it);
+  }
+  // `buf` is deregistered and freed here, outside the lock.
+}
+
 } // namespace coverbs_rpc
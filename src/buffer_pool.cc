@@ -0,0 +1,113 @@
+#include "coverbs_rpc/detail/buffer_pool.hpp"
+#include "coverbs_rpc/utils/backoff.hpp"
+
+#include <algorithm>
+#include <concurrentqueue.h>
+#include <stdexcept>
+
+namespace coverbs_rpc::detail {
+
+struct buffer_pool::size_class {
+  std::size_t size;
+  std::size_t offset;
+  std::size_t count;
+  moodycamel::ConcurrentQueue<uint32_t> free;
+};
+
+namespace {
+
+constexpr std::size_t kClassGrowth = 16;
+constexpr std::size_t kCacheLine = 64;
+// Failed attempts an acquirer backs off through before sleeping until a release.
+constexpr uint32_t kBackoffAttempts = 1024;
+
+auto round_up(std::size_t n, std::size_t align) noexcept -> std::size_t {
+  return (n + align - 1) / align * align;
+}
+
+} // namespace
+
+auto buffer_pool::make_classes(std::size_t max_size, std::size_t count, std::size_t min_class)
+    -> std::vector<std::unique_ptr<size_class>> {
+  std::vector<std::unique_ptr<size_class>> classes;
+  std::size_t offset = 0;
+  std::size_t const top = round_up(max_size, kCacheLine);
+  std::size_t const n = std::max<std::size_t>(count, 1);
+  std::size_t size = round_up(std::min(min_class, max_size), kCacheLine);
+  while (true) {
+    auto cls = std::make_unique<size_class>(size, offset, n,
+                                            moodycamel::ConcurrentQueue<uint32_t>(n * 2));
+    for (uint32_t i = 0; i < n; ++i) {
+      cls->free.enqueue(i);
+    }
+    offset += size * n;
+    classes.push_back(std::move(cls));
+    if (size >= max_size) {
+      break;
+    }
+    size = std::min(size * kClassGrowth, top);
+    // A class over half the top one saves little and doubles the memory: fold it into the top.
+    if (size * 2 > top) {
+      size = top;
+    }
+  }
+  return classes;
+}
+
+buffer_pool::buffer_pool(registered_arena &arena, std::size_t max_size, std::size_t count,
+                         std::size_t min_class)
+    : classes_(make_classes(max_size, count, min_class))
+    , block_(arena.allocate(classes_.back()->offset +
+                            classes_.back()->size * classes_.back()->count)) {}
+
+buffer_pool::~buffer_pool() = default;
+
+auto buffer_pool::try_acquire(std::size_t size) -> std::optional<buffer> {
+  for (uint32_t c = 0; c < classes_.size(); ++c) {
+    auto &cls = *classes_[c];
+    if (cls.size < size) {
+      continue;
+    }
+    uint32_t idx;
+    if (cls.free.try_dequeue(idx)) {
+      return buffer{
+          .data = block_.data() + cls.offset + idx * cls.size,
+          .capacity = cls.size,
+          .class_idx = c,
+          .index = idx,
+      };
+    }
+  }
+  return std::nullopt;
+}
+
+auto buffer_pool::acquire(std::size_t size, WaitPolicy const &wait) -> buffer {
+  if (size > classes_.back()->size) [[unlikely]] {
+    throw std::runtime_error("buffer_pool: requested buffer exceeds the largest size class");
+  }
+  utils::backoff backoff(wait);
+  for (uint32_t attempt = 0;; ++attempt) {
+    // Read first, so a release that lands after the failed attempt wakes the sleep below.
+    uint32_t const seen = releases_.load(std::memory_order_acquire);
+    if (auto buf = try_acquire(size)) {
+      return *buf;
+    }
+    if (attempt < kBackoffAttempts) {
+      backoff.pause();
+    } else {
+      releases_.wait(seen, std::memory_order_acquire);
+    }
+  }
+}
+
+auto buffer_pool::release(buffer const &buf) -> void {
+  classes_[buf.class_idx]->free.enqueue(buf.index);
+  releases_.fetch_add(1, std::memory_order_release);
+  releases_.notify_all();
+}
+
+auto buffer_pool::view(buffer const &buf, std::size_t length) const -> rdmapp::mr_view {
+  return block_.view(static_cast<std::size_t>(buf.data - block_.data()), length);
+}
+
+} // namespace coverbs_rpc::detail
@@ -26,6 +26,7 @@ qp_acceptor::qp_acceptor(cppcoro::io_service &io_service, uint16_t port, std::sh
     : acceptor_socket_(cppcoro::net::socket::create_tcpv4(io_service))
     , pd_(pd)
     , srq_(srq)
+    , cqs_(pd, config)
     , port_(port)
     , io_service_(io_service)
     , config_(std::move(config)) {
@@ -40,13 +41,21 @@ qp_acceptor::qp_acceptor(cppcoro::io_service &io_service, uint16_t port, std::sh
   }
 }
 
-auto qp_acceptor::accept_qp(cppcoro::net::socket &socket, std::shared_ptr<rdmapp::cq> send_cq,
-                            std::shared_ptr<rdmapp::cq> recv_cq)
+auto qp_acceptor::accept_qp(cppcoro::net::socket &socket, cq_pool &pool, bool unified)
     -> cppcoro::task<std::shared_ptr<qp_t>> {
-  auto remote_qp = co_await recv_qp(socket);
-  auto local_qp =
-      std::make_shared<qp_t>(remote_qp.header.lid, remote_qp.header.qp_num, remote_qp.header.sq_psn,
-                             remote_qp.header.gid, pd_, recv_cq, send_cq, srq_, config_.qp_config);
+  auto cqs = pool.acquire(unified);
+  std::shared_ptr<qp_t> local_qp;
+  rdmapp::deserialized_qp remote_qp;
+  try {
+    remote_qp = co_await recv_qp(socket);
+    local_qp = std::make_shared<qp_t>(remote_qp.header.lid, remote_qp.header.qp_num,
+                                      remote_qp.header.sq_psn, remote_qp.header.gid, pd_,
+                                      cqs.recv, cqs.send, srq_, config_.qp_config);
+  } catch (...) {
+    pool.release(cqs);
+    throw;
+  }
+  pool.attach(cqs, local_qp);
   local_qp->user_data() = std::move(remote_qp.user_data);
   co_await send_qp(*local_qp, socket);
   co_return local_qp;
@@ -55,7 +64,13 @@ auto qp_acceptor::accept_qp(cppcoro::net::socket &socket, std::shared_ptr<rdmapp
 auto qp_acceptor::accept() -> cppcoro::task<std::shared_ptr<qp_t>> {
   cppcoro::net::socket socket = cppcoro::net::socket::create_tcpv4(io_service_);
   co_await acceptor_socket_.accept(socket);
-  co_return co_await accept_qp(socket, alloc_cq(), alloc_cq());
+  co_return co_await accept_qp(socket, cqs_);
+}
+
+auto qp_acceptor::accept(cq_pool &cqs) -> cppcoro::task<std::shared_ptr<qp_t>> {
+  cppcoro::net::socket socket = cppcoro::net::socket::create_tcpv4(io_service_);
+  co_await acceptor_socket_.accept(socket);
+  co_return co_await accept_qp(socket, cqs);
 }
 
 auto qp_acceptor::accept_multiple(qp_handshake &handshake)
@@ -71,19 +86,12 @@ auto qp_acceptor::accept_multiple(qp_handshake &handshake)
   std::vector<std::shared_ptr<qp_t>> result;
   result.reserve(handshake.nr_qp);
   for (unsigned int i = 0; i < handshake.nr_qp; i++) {
-    auto cq = alloc_cq();
-    result.emplace_back(co_await accept_qp(socket, cq, cq));
+    result.emplace_back(co_await accept_qp(socket, cqs_, true));
   }
   get_logger()->info("qp_acceptor: accept nr_qp={} sid={}", handshake.nr_qp, handshake.sid);
   co_return result;
 }
 
-auto qp_acceptor::alloc_cq() -> std::shared_ptr<rdmapp::cq> {
-  auto cq = std::make_shared<rdmapp::cq>(pd_->device_ptr(), config_.cq_size);
-  pollers_.emplace_back(cq);
-  return cq;
-}
-
 auto qp_acceptor::close() noexcept -> void {
   try {
     acceptor_socket_.close();
@@ -15,20 +15,21 @@ qp_connector::qp_connector(cppcoro::io_service &io_service, std::shared_ptr<pd>
                            std::shared_ptr<srq> srq, ConnConfig config)
     : pd_(pd)
     , srq_(srq)
+    , cqs_(pd, config)
     , io_service_(io_service)
     , config_(std::move(config)) {}
 
-auto qp_connector::alloc_cq() noexcept -> std::shared_ptr<cq> {
-  auto cq = std::make_shared<rdmapp::cq>(this->pd_->device_ptr(), config_.cq_size);
-  pollers_.emplace_back(cq);
-  return cq;
-}
-
 auto qp_connector::from_socket(cppcoro::net::socket &socket, std::span<std::byte const> userdata)
     -> cppcoro::task<std::shared_ptr<qp_t>> {
-  auto cq1 = alloc_cq();
-  auto cq2 = alloc_cq();
-  auto qp_ptr = std::make_shared<qp_t>(this->pd_, cq1, cq2, srq_, config_.qp_config);
+  auto cqs = cqs_.acquire();
+  std::shared_ptr<qp_t> qp_ptr;
+  try {
+    qp_ptr = std::make_shared<qp_t>(this->pd_, cqs.recv, cqs.send, srq_, config_.qp_config);
+  } catch (...) {
+    cqs_.release(cqs);
+    throw;
+  }
+  cqs_.attach(cqs, qp_ptr);
   qp_ptr->user_data().assign(userdata.begin(), userdata.end());
   co_await send_qp(*qp_ptr, socket);
 
@@ -0,0 +1,109 @@
+#include "coverbs_rpc/conn/cq_pool.hpp"
+#include "coverbs_rpc/detail/logger.hpp"
+
+#include <algorithm>
+#include <thread>
+
+namespace coverbs_rpc {
+
+using detail::get_logger;
+
+cq_pool::cq_pool(std::shared_ptr<rdmapp::pd> pd, ConnConfig const &config)
+    : pd_(std::move(pd))
+    , config_(config) {}
+
+auto cq_pool::make_group(std::size_t nr_qps, bool unified) -> group & {
+  auto const cq_size = config_.cq_size * std::max<std::size_t>(nr_qps, 1);
+  auto &g = groups_.emplace_back();
+  g.id = next_group_id_++;
+  g.send = make_cq(g, cq_size);
+  g.recv = unified ? g.send : make_cq(g, cq_size);
+  get_logger()->debug("cq_pool: created cq group {} with {} cqes, groups={}", g.id, cq_size,
+                      groups_.size());
+  return g;
+}
+
+auto cq_pool::make_cq(group &g, std::size_t cq_size) -> std::shared_ptr<rdmapp::cq> {
+  if (config_.wait.mode == wait_mode::hybrid) {
+    return g.hybrid_pollers.emplace_back(pd_->device_ptr(), cq_size, config_.wait).cq();
+  }
+  auto cq = std::make_shared<rdmapp::cq>(pd_->device_ptr(), cq_size);
+  g.pollers.emplace_back(cq);
+  return cq;
+}
+
+auto cq_pool::prune() -> void {
+  for (auto it = groups_.begin(); it != groups_.end();) {
+    std::erase_if(it->qps, [](auto const &qp) { return qp.expired(); });
+    // Per-core groups are long-lived; the others go away with their last QP.
+    if (it->load() == 0 && config_.cq_policy != cq_sharing::per_core) {
+      it = groups_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+auto cq_pool::pick_group(bool unified) -> group & {
+  switch (config_.cq_policy) {
+    case cq_sharing::per_qp:
+      return make_group(1, unified);
+    case cq_sharing::per_n_qps: {
+      for (auto &g : groups_) {
+        if (g.load() < config_.qps_per_cq) {
+          return g;
+        }
+      }
+      return make_group(config_.qps_per_cq, false);
+    }
+    case cq_sharing::per_core: {
+      auto const cores = std::max(std::thread::hardware_concurrency(), 1u);
+      if (groups_.size() < cores) {
+        return make_group(config_.qps_per_cq, false);
+      }
+      auto it = std::ranges::min_element(groups_, {}, &group::load);
+      if (it->load() >= config_.qps_per_cq) [[unlikely]] {
+        get_logger()->warn("cq_pool: all {} per-core cq groups hold {} qps, adding another",
+                           groups_.size(), config_.qps_per_cq);
+        return make_group(config_.qps_per_cq, false);
+      }
+      return *it;
+    }
+  }
+  return make_group(1, unified);
+}
+
+auto cq_pool::acquire(bool unified) -> cq_pair {
+  std::lock_guard lock(mutex_);
+  prune();
+  auto &g = pick_group(unified);
+  ++g.pending;
+  return cq_pair{.send = g.send, .recv = g.recv, .group = g.id};
+}
+
+auto cq_pool::attach(cq_pair const &pair, std::shared_ptr<rdmapp::qp> const &qp) -> void {
+  std::lock_guard lock(mutex_);
+  auto it = std::ranges::find(groups_, pair.group, &group::id);
+  if (it == groups_.end()) [[unlikely]] {
+    return;
+  }
+  --it->pending;
+  it->qps.push_back(qp);
+}
+
+auto cq_pool::release(cq_pair const &pair) -> void {
+  std::lock_guard lock(mutex_);
+  auto it = std::ranges::find(groups_, pair.group, &group::id);
+  if (it == groups_.end()) [[unlikely]] {
+    return;
+  }
+  --it->pending;
+  prune();
+}
+
+auto cq_pool::num_groups() const -> std::size_t {
+  std::lock_guard lock(mutex_);
+  return groups_.size();
+}
+
+} // namespace coverbs_rpc
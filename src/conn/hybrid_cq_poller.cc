@@ -0,0 +1,120 @@
+#include "coverbs_rpc/conn/hybrid_cq_poller.hpp"
+#include "coverbs_rpc/detail/logger.hpp"
+#include "coverbs_rpc/utils/spin_wait.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <poll.h>
+#include <rdmapp/cq_poller.h>
+#include <stdexcept>
+#include <string>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace coverbs_rpc {
+
+using detail::get_logger;
+
+namespace {
+
+// Only read the clock every kClockStride empty polls to keep spinning cheap.
+constexpr uint32_t kClockStride = 64;
+
+} // namespace
+
+hybrid_cq_poller::hybrid_cq_poller(std::shared_ptr<rdmapp::device> const &device,
+                                   std::size_t nr_cqe, WaitPolicy const &policy,
+                                   std::size_t batch_size)
+    : policy_(policy)
+    , wcs_(batch_size) {
+  channel_ = std::shared_ptr<ibv_comp_channel>(ibv_create_comp_channel(device->ctx_),
+                                               [](ibv_comp_channel *channel) {
+                                                 if (channel != nullptr) {
+                                                   ibv_destroy_comp_channel(channel);
+                                                 }
+                                               });
+  if (!channel_) [[unlikely]] {
+    throw std::runtime_error("hybrid_cq_poller: cannot create a completion channel");
+  }
+  // The deleter holds the channel open until the CQ attached to it is gone.
+  cq_ = std::shared_ptr<rdmapp::cq>(new rdmapp::cq(device, nr_cqe, channel_.get()),
+                                    [channel = channel_](rdmapp::cq *cq) { delete cq; });
+  wake_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (wake_fd_ < 0) [[unlikely]] {
+    throw std::runtime_error(std::string("hybrid_cq_poller: eventfd: ") + std::strerror(errno));
+  }
+  thread_ = std::jthread([this](std::stop_token stop) { run(stop); });
+}
+
+hybrid_cq_poller::~hybrid_cq_poller() {
+  thread_.request_stop();
+  uint64_t const one = 1;
+  [[maybe_unused]] auto _ = ::write(wake_fd_, &one, sizeof(one));
+  thread_.join();
+  ::close(wake_fd_);
+}
+
+auto hybrid_cq_poller::run(std::stop_token stop) -> void {
+  auto idle_since = std::chrono::steady_clock::now();
+  uint32_t empty_polls = 0;
+  while (!stop.stop_requested()) {
+    if (poll_once()) {
+      empty_polls = 0;
+      continue;
+    }
+    if (empty_polls++ == 0) {
+      idle_since = std::chrono::steady_clock::now();
+    }
+    if (empty_polls % kClockStride != 0 ||
+        std::chrono::steady_clock::now() - idle_since < policy_.spin_budget) {
+      utils::detail::cpu_relax();
+      continue;
+    }
+    if (ibv_req_notify_cq(cq_->cq_, 0) != 0) [[unlikely]] {
+      get_logger()->error("hybrid_cq_poller: cannot arm the cq, spinning instead");
+      utils::detail::cpu_relax();
+      continue;
+    }
+    // A completion that landed before the CQ was armed raises no event: look once more.
+    if (!poll_once()) {
+      wait_for_event();
+    }
+    empty_polls = 0;
+  }
+}
+
+auto hybrid_cq_poller::poll_once() -> bool {
+  std::size_t const n = cq_->poll(wcs_);
+  for (std::size_t i = 0; i < n; ++i) {
+    try {
+      rdmapp::native_cq_poller::process_wc(wcs_[i]);
+    } catch (const std::exception &e) {
+      get_logger()->error("hybrid_cq_poller: completion handler failed: {}", e.what());
+    }
+  }
+  return n != 0;
+}
+
+auto hybrid_cq_poller::wait_for_event() -> void {
+  pollfd fds[2] = {
+      {.fd = channel_->fd, .events = POLLIN, .revents = 0},
+      {.fd = wake_fd_, .events = POLLIN, .revents = 0},
+  };
+  if (::poll(fds, 2, -1) < 0) {
+    if (errno != EINTR) [[unlikely]] {
+      get_logger()->error("hybrid_cq_poller: poll: {}", std::strerror(errno));
+    }
+    return;
+  }
+  if (fds[0].revents & POLLIN) {
+    ibv_cq *event_cq = nullptr;
+    void *event_context = nullptr;
+    if (ibv_get_cq_event(channel_.get(), &event_cq, &event_context) == 0) {
+      ibv_ack_cq_events(event_cq, 1);
+    }
+  }
+}
+
+} // namespace coverbs_rpc
@@ -0,0 +1,253 @@
+#include "coverbs_rpc/message_client.hpp"
+#include "coverbs_rpc/detail/logger.hpp"
+#include "coverbs_rpc/detail/replay_sequencer.hpp"
+#include "coverbs_rpc/utils/backoff.hpp"
+
+#include <algorithm>
+#include <array>
+#include <concurrentqueue.h>
+#include <coroutine>
+#include <stdexcept>
+#include <thread>
+
+namespace coverbs_rpc {
+using detail::get_logger;
+
+namespace {
+
+struct alignas(64) Slot {
+  std::atomic<uintptr_t> waiter{detail::kWaiterEmpty};
+  uint64_t expected_req_id{};
+  std::span<std::byte> user_resp_buffer{};
+  std::vector<std::byte> *growable{};
+  std::size_t actual_len{};
+  uint32_t generation{};
+  uint32_t resp_flags{};
+  // The response header's reserved word: why a call flagged kFlagFailed failed.
+  uint32_t resp_reserved{};
+};
+static_assert(sizeof(Slot) == 64);
+
+struct ResponseAwaitable {
+  Slot &slot;
+  constexpr auto await_ready() const noexcept -> bool { return false; }
+  auto await_suspend(std::coroutine_handle<> h) noexcept -> bool {
+    uintptr_t expected = detail::kWaiterEmpty;
+    return slot.waiter.compare_exchange_strong(expected, uintptr_t(h.address()));
+  }
+  auto await_resume() noexcept -> std::size_t { return slot.actual_len; }
+};
+
+} // namespace
+
+struct message_client::Impl {
+  Impl(std::unique_ptr<message_channel> ch, RpcConfig config)
+      : config_(config)
+      , ch_(std::move(ch))
+      , slots_(config_.max_inflight)
+      , free_slots_(config_.max_inflight * 2)
+      , worker_([this](std::stop_token stop) { recv_loop(stop); }) {
+    for (uint32_t i = 0; i < config_.max_inflight; ++i) {
+      free_slots_.enqueue(i);
+    }
+    get_logger()->info("message client initialized with {} slots, max_message={}",
+                       config_.max_inflight, ch_->max_message());
+  }
+
+  ~Impl() {
+    worker_.request_stop();
+    ch_->close();
+  }
+
+  auto recv_loop(std::stop_token stop) -> void {
+    // Callers are resumed once the batch is handed over, so a long continuation never holds up
+    // the channel's buffer.
+    std::vector<Slot *> ready;
+    message_channel::on_message_fn const on_message = [&](std::span<std::byte> msg) {
+      if (auto *slot = on_response(msg)) {
+        ready.push_back(slot);
+      }
+    };
+    while (ch_->receive(on_message, config_.wait, stop)) {
+      for (auto *slot : ready) {
+        // A caller still on its way into the awaitable finds the slot done and carries on.
+        uintptr_t const w = slot->waiter.exchange(detail::kWaiterDone);
+        if (w != detail::kWaiterEmpty) {
+          std::coroutine_handle<>::from_address(reinterpret_cast<void *>(w)).resume();
+        }
+      }
+      ready.clear();
+    }
+    if (!stop.stop_requested()) {
+      get_logger()->error("message client: connection to the server lost");
+    }
+  }
+
+  // Copies a response into its slot and returns the slot whose caller is to be resumed.
+  auto on_response(std::span<std::byte> msg) -> Slot * {
+    if (msg.size() < sizeof(detail::RpcHeader)) [[unlikely]] {
+      get_logger()->warn("message client: received too small message: {}", msg.size());
+      return nullptr;
+    }
+    auto const *header = reinterpret_cast<detail::RpcHeader const *>(msg.data());
+    uint32_t const slot_idx = detail::parse_slot_idx(header->req_id);
+    if (slot_idx >= config_.max_inflight) [[unlikely]] {
+      get_logger()->error("message client: invalid slot_idx decoded: {}", slot_idx);
+      return nullptr;
+    }
+    auto &slot = slots_[slot_idx];
+    if (slot.expected_req_id != header->req_id) [[unlikely]] {
+      get_logger()->error("message client: mismatch req_id: expected={} get={}",
+                          slot.expected_req_id, header->req_id);
+      std::terminate();
+    }
+
+    auto payload = msg.subspan(sizeof(detail::RpcHeader));
+    payload = payload.first(std::min<std::size_t>(header->payload_len, payload.size()));
+    if (slot.growable != nullptr) {
+      slot.growable->resize(payload.size());
+      slot.user_resp_buffer = *slot.growable;
+    }
+    std::size_t const copy_len = std::min(payload.size(), slot.user_resp_buffer.size());
+    std::copy_n(payload.data(), copy_len, slot.user_resp_buffer.data());
+    slot.actual_len = copy_len;
+    slot.resp_flags = header->flags;
+    slot.resp_reserved = header->reserved;
+    return &slot;
+  }
+
+  auto acquire_slot() -> uint32_t {
+    uint32_t slot_idx;
+    utils::backoff slot_backoff(config_.wait);
+    while (!free_slots_.try_dequeue(slot_idx)) {
+      slot_backoff.pause();
+    }
+    return slot_idx;
+  }
+
+  auto send(detail::RpcHeader const &header, std::span<const std::byte> payload) -> void {
+    send(std::as_bytes(std::span{&header, 1}), payload);
+  }
+
+  // `prefix` is the header followed by whatever descriptors lead the payload.
+  auto send(std::span<const std::byte> prefix, std::span<const std::byte> payload) -> void {
+    ch_->send(prefix, payload, config_.wait);
+  }
+
+  RpcConfig const config_;
+  std::unique_ptr<message_channel> ch_;
+  std::vector<Slot> slots_;
+  moodycamel::ConcurrentQueue<uint32_t> free_slots_;
+  detail::replay_sequencer replay_;
+
+  std::jthread worker_;
+};
+
+message_client::message_client(std::unique_ptr<message_channel> ch, RpcConfig config)
+    : impl_(std::make_unique<Impl>(std::move(ch), config)) {}
+
+message_client::~message_client() = default;
+
+auto message_client::call(rpc_method method, std::span<const std::byte> req_data,
+                          std::span<std::byte> resp_buffer, resume_target resume)
+    -> cppcoro::task<std::size_t> {
+  return call_impl(method, req_data, resp_buffer, nullptr, resume);
+}
+
+auto message_client::call(rpc_method method, std::span<const std::byte> req_data,
+                          std::vector<std::byte> &resp_buffer, resume_target resume)
+    -> cppcoro::task<std::size_t> {
+  return call_impl(method, req_data, resp_buffer, &resp_buffer, resume);
+}
+
+auto message_client::call_impl(rpc_method method, std::span<const std::byte> req_data,
+                               std::span<std::byte> resp_buffer,
+                               std::vector<std::byte> *growable, resume_target resume)
+    -> cppcoro::task<std::size_t> {
+  std::optional<detail::ReplayDesc> replay;
+  if (impl_->config_.at_most_once.enabled) {
+    replay = impl_->replay_.begin();
+  }
+  std::size_t const replay_len = replay ? sizeof(detail::ReplayDesc) : 0;
+  if (sizeof(detail::RpcHeader) + replay_len + req_data.size() > impl_->ch_->max_message())
+      [[unlikely]] {
+    if (replay) {
+      impl_->replay_.end(replay->seq);
+    }
+    throw std::runtime_error("request exceeds the channel's max_message");
+  }
+
+  uint32_t slot_idx = impl_->acquire_slot();
+  Slot &slot = impl_->slots_[slot_idx];
+  uint64_t req_id = detail::make_req_id(++slot.generation, slot_idx);
+  slot.user_resp_buffer = resp_buffer;
+  slot.growable = growable;
+  slot.expected_req_id = req_id;
+
+  detail::RpcHeader header{
+      .req_id = req_id,
+      .payload_len = static_cast<uint32_t>(replay_len + req_data.size()),
+      .fn_id = method.fn_id,
+      .flags = detail::method_flags(method) | (replay ? detail::kFlagReplay : 0),
+      .reserved = 0,
+  };
+  detail::stamp_deadline(header, impl_->config_.deadline);
+  std::array<std::byte, sizeof(detail::RpcHeader) + sizeof(detail::ReplayDesc)> prefix;
+  std::memcpy(prefix.data(), &header, sizeof(header));
+  if (replay) {
+    std::memcpy(prefix.data() + sizeof(header), &*replay, sizeof(*replay));
+  }
+
+  std::size_t nbytes = 0;
+  uint32_t resp_flags = 0;
+  uint32_t resp_reserved = 0;
+  // Only at-most-once calls are sent again: the server runs each of those once however often
+  // it arrives.
+  for (uint32_t attempt = 0;; ++attempt) {
+    slot.waiter.store(detail::kWaiterEmpty);
+    slot.resp_flags = 0;
+    try {
+      impl_->send(std::span(prefix).first(sizeof(header) + replay_len), req_data);
+      nbytes = co_await ResponseAwaitable{slot};
+    } catch (const std::exception &e) {
+      get_logger()->error("message client: RPC failed: {}", e.what());
+    }
+    resp_flags = slot.resp_flags;
+    resp_reserved = slot.resp_reserved;
+    if (!replay || attempt >= impl_->config_.at_most_once.retries ||
+        !(resp_flags & (detail::kFlagExpired | detail::kFlagOverloaded))) {
+      break;
+    }
+  }
+  if (replay) {
+    impl_->replay_.end(replay->seq);
+  }
+
+  impl_->free_slots_.enqueue(slot_idx);
+  if (!resume.is_inline()) {
+    co_await resume.hop(resume.scheduler);
+  }
+  detail::check_rejected(resp_flags, resp_reserved);
+  co_return nbytes;
+}
+
+auto message_client::call_oneway(rpc_method method, std::span<const std::byte> req_data,
+                                 resume_target resume) -> cppcoro::task<void> {
+  if (sizeof(detail::RpcHeader) + req_data.size() > impl_->ch_->max_message()) [[unlikely]] {
+    throw std::runtime_error("one-way request exceeds the channel's max_message");
+  }
+  detail::RpcHeader header{
+      .req_id = 0,
+      .payload_len = static_cast<uint32_t>(req_data.size()),
+      .fn_id = method.fn_id,
+      .flags = detail::kFlagOneWay | detail::method_flags(method),
+      .reserved = 0,
+  };
+  detail::stamp_deadline(header, impl_->config_.deadline);
+  impl_->send(header, req_data);
+  if (!resume.is_inline()) {
+    co_await resume.hop(resume.scheduler);
+  }
+}
+
+} // namespace coverbs_rpc
@@ -0,0 +1,155 @@
+#include "coverbs_rpc/message_server.hpp"
+#include "coverbs_rpc/detail/logger.hpp"
+
+#include <algorithm>
+#include <cppcoro/async_scope.hpp>
+#include <cppcoro/sync_wait.hpp>
+#include <exception>
+
+namespace coverbs_rpc {
+using detail::get_logger;
+
+message_server::message_server(std::unique_ptr<message_channel> ch, basic_mux const &mux,
+                               RpcConfig config,
+                               std::shared_ptr<cppcoro::static_thread_pool> executor,
+                               std::shared_ptr<admission_control> admission,
+                               std::shared_ptr<priority_scheduler> scheduler,
+                               rpc_session *session)
+    : ch_(std::move(ch))
+    , mux_(mux)
+    , config_(config)
+    , tp_(std::move(executor))
+    , admission_(admission ? std::move(admission)
+                           : std::make_shared<admission_control>(config_.admission))
+    , scheduler_(scheduler || !config_.priority.enabled
+                     ? std::move(scheduler)
+                     : std::make_shared<priority_scheduler>(tp_, config_.priority))
+    , session_(session) {}
+
+auto message_server::run(std::stop_token stop) -> void {
+  cppcoro::async_scope scope;
+  message_channel::on_message_fn const on_message = [&](std::span<std::byte> msg) {
+    if (msg.size() < sizeof(detail::RpcHeader)) [[unlikely]] {
+      get_logger()->warn("message server: received too small message: {}", msg.size());
+      return;
+    }
+    auto const arrived = std::chrono::steady_clock::now();
+    auto const *header = reinterpret_cast<detail::RpcHeader const *>(msg.data());
+    auto admitted = admission_->admit(header->fn_id, arrived);
+    if (!admitted) {
+      // Shed right here, without a pool thread or a copy of the request.
+      if (!(header->flags & detail::kFlagOneWay)) {
+        detail::RpcHeader const reply{
+            .req_id = header->req_id,
+            .payload_len = 0,
+            .fn_id = header->fn_id,
+            .flags = detail::kFlagOverloaded,
+            .reserved = 0,
+        };
+        try {
+          ch_->send(std::as_bytes(std::span{&reply, 1}), {}, config_.wait);
+        } catch (const std::exception &e) {
+          get_logger()->error("message server: send overloaded reply failed: {}", e.what());
+        }
+      }
+      return;
+    }
+    // Copied out so the channel's buffer is free again before the handler even starts.
+    scope.spawn(handle(std::vector<std::byte>(msg.begin(), msg.end()), arrived,
+                       std::move(*admitted)));
+  };
+  while (ch_->receive(on_message, config_.wait, stop)) {
+  }
+  ch_->close();
+  cppcoro::sync_wait(scope.join());
+  get_logger()->info("message server: client disconnected");
+}
+
+auto message_server::handle(std::vector<std::byte> frame,
+                            std::chrono::steady_clock::time_point arrived,
+                            admission_control::ticket admitted) -> cppcoro::task<void> {
+  auto const header = *reinterpret_cast<detail::RpcHeader const *>(frame.data());
+  priority_scheduler::running running;
+  if (scheduler_) {
+    running = co_await scheduler_->schedule(mux_.priority(header.fn_id));
+  } else {
+    co_await tp_->schedule();
+  }
+  admitted.start();
+
+  auto payload = std::span<std::byte>(frame).subspan(sizeof(detail::RpcHeader));
+  payload = payload.first(std::min<std::size_t>(header.payload_len, payload.size()));
+  std::optional<detail::ReplayDesc> replay;
+  bool const well_formed = detail::take_replay(header.flags, payload, replay);
+  if (!well_formed) [[unlikely]] {
+    get_logger()->warn("message server: malformed replay descriptor: {}", payload.size());
+  }
+
+  thread_local std::vector<std::byte> scratch;
+  if (scratch.size() < config_.max_resp_payload) {
+    scratch.resize(config_.max_resp_payload);
+  }
+  auto const resp_payload_span = std::span<std::byte>(scratch.data(), config_.max_resp_payload);
+
+  auto const deadline = detail::request_deadline(header, arrived);
+  bool const expired = detail::past(deadline);
+
+  rpc_context ctx;
+  ctx.session = session_;
+  ctx.replay = replay;
+  if (header.flags & detail::kFlagOneWay) {
+    try {
+      if (!well_formed || expired) {
+        co_return;
+      }
+      mux_.dispatch(header, payload, resp_payload_span, ctx);
+    } catch (const std::exception &e) {
+      get_logger()->error("message server: one-way handler for fn_id={} failed: {}", header.fn_id,
+                          e.what());
+    }
+    co_return;
+  }
+  // Whatever goes wrong, the caller gets a reply rather than waiting for one forever.
+  std::size_t resp_len = 0;
+  if (!well_formed) {
+    ctx.failure = detail::failure_reason::malformed_request;
+  } else if (!expired) {
+    try {
+      resp_len = mux_.dispatch(header, payload, resp_payload_span, ctx);
+    } catch (const std::exception &e) {
+      get_logger()->error("message server: handler for fn_id={} failed: {}", header.fn_id,
+                          e.what());
+      ctx.failure = detail::failure_reason::handler_failed;
+    }
+  }
+  running.finish();
+  // No rendezvous needed: a large response goes through the channel like any other.
+  auto resp = ctx.large_resp.empty()
+                  ? std::span<const std::byte>(resp_payload_span.first(resp_len))
+                  : std::span<const std::byte>(ctx.large_resp).first(resp_len);
+  uint32_t flags = 0;
+  uint32_t reserved = 0;
+  if (expired || detail::past(deadline)) {
+    flags = detail::kFlagExpired;
+    resp = {};
+  } else if (ctx.failure) {
+    flags = detail::kFlagFailed;
+    reserved = static_cast<uint32_t>(*ctx.failure);
+    resp = {};
+  }
+
+  detail::RpcHeader const reply{
+      .req_id = header.req_id,
+      .payload_len = static_cast<uint32_t>(resp.size()),
+      .fn_id = header.fn_id,
+      .flags = flags,
+      .reserved = reserved,
+  };
+  try {
+    ch_->send(std::as_bytes(std::span{&reply, 1}), resp, config_.wait);
+  } catch (const std::exception &e) {
+    get_logger()->error("message server: send reply failed: {}", e.what());
+  }
+}
+
+} // namespace coverbs_rpc
@@ -0,0 +1,129 @@
+#include "coverbs_rpc/priority_scheduler.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace coverbs_rpc {
+
+namespace {
+
+struct detached_task {
+  struct promise_type {
+    auto get_return_object() noexcept -> detached_task { return {}; }
+    auto initial_suspend() noexcept -> std::suspend_never { return {}; }
+    auto final_suspend() noexcept -> std::suspend_never { return {}; }
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept {}
+  };
+};
+
+template <typename F>
+auto run_on(cppcoro::static_thread_pool &pool, F f) -> detached_task {
+  co_await pool.schedule();
+  f();
+}
+
+} // namespace
+
+priority_scheduler::running::running(running &&other) noexcept
+    : owner_(std::exchange(other.owner_, nullptr))
+    , priority_(other.priority_) {}
+
+auto priority_scheduler::running::operator=(running &&other) noexcept -> running & {
+  if (this != &other) {
+    finish();
+    owner_ = std::exchange(other.owner_, nullptr);
+    priority_ = other.priority_;
+  }
+  return *this;
+}
+
+auto priority_scheduler::running::finish() noexcept -> void {
+  if (owner_ != nullptr) {
+    std::exchange(owner_, nullptr)->release(priority_);
+  }
+}
+
+priority_scheduler::priority_scheduler(std::shared_ptr<cppcoro::static_thread_pool> executor,
+                                       PriorityConfig config)
+    : executor_(std::move(executor))
+    , normal_weight_(std::max<uint32_t>(config.normal_weight, 1))
+    , low_weight_(std::max<uint32_t>(config.low_weight, 1))
+    , shared_threads_(executor_->thread_count() > config.reserved_threads
+                          ? executor_->thread_count() - config.reserved_threads
+                          : 1) {}
+
+auto priority_scheduler::enqueue(rpc_priority priority, std::coroutine_handle<> h) -> void {
+  {
+    std::lock_guard lock(mutex_);
+    waiting_[static_cast<std::size_t>(priority)].push_back(h);
+  }
+  spawn_runner();
+}
+
+auto priority_scheduler::spawn_runner() -> void {
+  run_on(*executor_, [this] {
+    std::coroutine_handle<> next;
+    {
+      std::lock_guard lock(mutex_);
+      next = pick();
+    }
+    if (next) {
+      next.resume();
+    }
+  });
+}
+
+auto priority_scheduler::pick() -> std::coroutine_handle<> {
+  auto take = [](std::deque<std::coroutine_handle<>> &queue) {
+    auto h = queue.front();
+    queue.pop_front();
+    return h;
+  };
+  auto &high = waiting_[static_cast<std::size_t>(rpc_priority::high)];
+  auto &normal = waiting_[static_cast<std::size_t>(rpc_priority::normal)];
+  auto &low = waiting_[static_cast<std::size_t>(rpc_priority::low)];
+  if (!high.empty()) {
+    return take(high);
+  }
+  if ((normal.empty() && low.empty()) || running_shared_ >= shared_threads_) {
+    return nullptr;
+  }
+  ++running_shared_;
+  if (low.empty()) {
+    return take(normal);
+  }
+  if (normal.empty()) {
+    return take(low);
+  }
+  // Weighted round robin while both wait.
+  if (normal_credit_ == 0 && low_credit_ == 0) {
+    normal_credit_ = normal_weight_;
+    low_credit_ = low_weight_;
+  }
+  if (normal_credit_ > 0) {
+    --normal_credit_;
+    return take(normal);
+  }
+  --low_credit_;
+  return take(low);
+}
+
+auto priority_scheduler::release(rpc_priority priority) noexcept -> void {
+  if (priority == rpc_priority::high) {
+    return;
+  }
+  bool held_back;
+  {
+    std::lock_guard lock(mutex_);
+    --running_shared_;
+    // Their runners may have found the shared threads taken and left without starting them.
+    held_back = !(waiting_[static_cast<std::size_t>(rpc_priority::normal)].empty() &&
+                  waiting_[static_cast<std::size_t>(rpc_priority::low)].empty());
+  }
+  if (held_back) {
+    spawn_runner();
+  }
+}
+
+} // namespace coverbs_rpc
@@ -0,0 +1,84 @@
+#include "coverbs_rpc/region.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace coverbs_rpc {
+
+namespace detail {
+
+auto region_checksum(std::span<const std::byte> data) noexcept -> uint64_t {
+  constexpr uint64_t kMul = 0x9e3779b97f4a7c15ull;
+  uint64_t h = data.size() * kMul;
+  std::size_t i = 0;
+  for (; i + sizeof(uint64_t) <= data.size(); i += sizeof(uint64_t)) {
+    uint64_t w;
+    std::memcpy(&w, data.data() + i, sizeof(w));
+    h = std::rotl((h ^ w) * kMul, 29);
+  }
+  uint64_t tail = 0;
+  if (i < data.size()) {
+    std::memcpy(&tail, data.data() + i, data.size() - i);
+  }
+  return std::rotl((h ^ tail) * kMul, 29);
+}
+
+} // namespace detail
+
+published_region::published_region(rdmapp::pd &pd, std::size_t capacity)
+    : capacity_(capacity)
+    , memory_(sizeof(detail::RegionHeader) + capacity)
+    , mr_(pd.reg_mr(memory_.data(), memory_.size())) {
+  auto *h = new (memory_.data()) detail::RegionHeader{};
+  h->checksum = detail::region_checksum({});
+}
+
+auto published_region::publish(std::span<const std::byte> data) -> void {
+  if (data.size() > capacity_) [[unlikely]] {
+    throw std::runtime_error("published_region: data exceeds the region's capacity");
+  }
+  std::lock_guard lock(write_mutex_);
+  auto &h = header();
+  uint64_t const v = h.version.load(std::memory_order_relaxed);
+  h.version.store(v + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  std::copy_n(data.data(), data.size(), memory_.data() + sizeof(detail::RegionHeader));
+  h.length = data.size();
+  h.checksum = detail::region_checksum(data);
+  h.version.store(v + 2, std::memory_order_release);
+}
+
+remote_region::remote_region(std::shared_ptr<rdmapp::qp> qp, detail::RendezvousDesc desc)
+    : qp_(std::move(qp))
+    , desc_(desc)
+    , landing_(desc.length)
+    , mr_(qp_->pd_ptr()->reg_mr(landing_.data(), landing_.size())) {
+  if (desc_.length < sizeof(detail::RegionHeader)) [[unlikely]] {
+    throw std::runtime_error("remote_region: descriptor smaller than a region header");
+  }
+}
+
+auto remote_region::read(std::vector<std::byte> &out) -> cppcoro::task<bool> {
+  // Header and data in a single READ; the checksum catches a read torn by a concurrent update.
+  co_await qp_->read(rdmapp::mr_view(mr_, 0, landing_.size()),
+                     detail::to_remote_mr(desc_, landing_.size()), rdmapp::use_native_awaitable);
+
+  // version, length, checksum: the leading words of RegionHeader, as the NIC copied them.
+  uint64_t words[3];
+  std::memcpy(words, landing_.data(), sizeof(words));
+  auto const [version, length, checksum] = words;
+  std::size_t const capacity = landing_.size() - sizeof(detail::RegionHeader);
+  if ((version & 1) != 0 || length > capacity) {
+    co_return false;
+  }
+  auto data =
+      std::span<const std::byte>(landing_.data() + sizeof(detail::RegionHeader), length);
+  if (detail::region_checksum(data) != checksum) {
+    co_return false;
+  }
+  out.assign(data.begin(), data.end());
+  co_return true;
+}
+
+} // namespace coverbs_rpc
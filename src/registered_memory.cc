@@ -0,0 +1,261 @@
+#include "coverbs_rpc/registered_memory.hpp"
+#include "coverbs_rpc/detail/logger.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <infiniband/verbs.h>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <utility>
+
+namespace coverbs_rpc {
+using detail::get_logger;
+
+namespace {
+
+constexpr std::size_t kAlign = 64;
+constexpr std::size_t k2MiB = 2ul << 20;
+constexpr std::size_t k1GiB = 1ul << 30;
+constexpr int kMpolPreferred = 1;
+
+auto round_up(std::size_t n, std::size_t align) noexcept -> std::size_t {
+  return (n + align - 1) / align * align;
+}
+
+struct mapping {
+  void *addr = MAP_FAILED;
+  std::size_t length = 0;
+  std::size_t page_size = 0;
+
+  mapping() = default;
+  mapping(mapping &&other) noexcept
+      : addr(std::exchange(other.addr, MAP_FAILED))
+      , length(other.length)
+      , page_size(other.page_size) {}
+  auto operator=(mapping &&) -> mapping & = delete;
+  ~mapping() {
+    if (addr != MAP_FAILED) {
+      ::munmap(addr, length);
+    }
+  }
+};
+
+auto try_map(mapping &m, std::size_t length, std::size_t page_size, int extra_flags) -> bool {
+  std::size_t const len = round_up(length, page_size);
+  void *addr = ::mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | extra_flags, -1, 0);
+  if (addr == MAP_FAILED) {
+    return false;
+  }
+  m.addr = addr;
+  m.length = len;
+  m.page_size = page_size;
+  return true;
+}
+
+auto map_memory(std::size_t length, MemoryConfig const &config) -> mapping {
+  mapping m;
+  bool mapped = false;
+  if (config.hugepages) {
+    if (length >= k1GiB) {
+      mapped = try_map(m, length, k1GiB, MAP_HUGETLB | (30 << MAP_HUGE_SHIFT));
+    }
+    if (!mapped) {
+      mapped = try_map(m, length, k2MiB, MAP_HUGETLB | (21 << MAP_HUGE_SHIFT));
+    }
+  }
+  if (!mapped) {
+    auto const page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    if (!try_map(m, length, page, 0)) {
+      throw std::runtime_error("registered_arena: mmap failed");
+    }
+    if (config.hugepages) {
+      // Reserved hugepages are exhausted or absent; let THP back what it can.
+      ::madvise(m.addr, m.length, MADV_HUGEPAGE);
+    }
+  }
+
+  if (config.numa_node >= 0) {
+    constexpr std::size_t kWordBits = sizeof(unsigned long) * 8;
+    unsigned long nodemask[16] = {};
+    auto const node = static_cast<std::size_t>(config.numa_node);
+    if (node < sizeof(nodemask) * 8) {
+      nodemask[node / kWordBits] |= 1ul << (node % kWordBits);
+      if (::syscall(SYS_mbind, m.addr, m.length, kMpolPreferred, nodemask,
+                    sizeof(nodemask) * 8 + 1, 0) != 0) {
+        get_logger()->warn("registered_arena: mbind to node {} failed: {}", node,
+                           std::strerror(errno));
+      }
+    }
+  }
+
+  // Prefault now, after the NUMA policy is in place, so reg_mr does not fault page by page and
+  // the first messages do not pay for it either.
+  auto *p = static_cast<volatile std::byte *>(m.addr);
+  for (std::size_t off = 0; off < m.length; off += m.page_size) {
+    p[off] = std::byte{0};
+  }
+  return m;
+}
+
+} // namespace
+
+struct registered_arena::chunk {
+  chunk(rdmapp::pd &pd, std::size_t length, MemoryConfig const &config)
+      : mem(map_memory(length, config))
+      , mr(pd.reg_mr(mem.addr, mem.length)) {
+    free_ranges.emplace(0, mem.length);
+  }
+
+  auto base() const noexcept -> std::byte * { return static_cast<std::byte *>(mem.addr); }
+
+  mapping mem;
+  rdmapp::local_mr mr;
+  // offset -> length of free ranges, coalesced on free.
+  std::map<std::size_t, std::size_t> free_ranges;
+};
+
+registered_arena::block::block(std::shared_ptr<registered_arena> arena, chunk *c,
+                               std::size_t offset, std::size_t size)
+    : arena_(std::move(arena))
+    , chunk_(c)
+    , offset_(offset)
+    , size_(size)
+    , data_(c->base() + offset) {}
+
+registered_arena::block::block(block &&other) noexcept
+    : arena_(std::move(other.arena_))
+    , chunk_(std::exchange(other.chunk_, nullptr))
+    , offset_(other.offset_)
+    , size_(std::exchange(other.size_, 0))
+    , data_(std::exchange(other.data_, nullptr)) {}
+
+auto registered_arena::block::operator=(block &&other) noexcept -> block & {
+  if (this != &other) {
+    reset();
+    arena_ = std::move(other.arena_);
+    chunk_ = std::exchange(other.chunk_, nullptr);
+    offset_ = other.offset_;
+    size_ = std::exchange(other.size_, 0);
+    data_ = std::exchange(other.data_, nullptr);
+  }
+  return *this;
+}
+
+registered_arena::block::~block() { reset(); }
+
+auto registered_arena::block::reset() noexcept -> void {
+  if (arena_ && chunk_ != nullptr) {
+    arena_->free(chunk_, offset_, size_);
+  }
+  arena_.reset();
+  chunk_ = nullptr;
+}
+
+auto registered_arena::block::view(std::size_t offset, std::size_t length) const
+    -> rdmapp::mr_view {
+  return rdmapp::mr_view(chunk_->mr, offset_ + offset, length);
+}
+
+registered_arena::registered_arena(std::shared_ptr<rdmapp::pd> pd, MemoryConfig config)
+    : pd_(std::move(pd))
+    , config_(config) {}
+
+registered_arena::~registered_arena() = default;
+
+auto registered_arena::create(std::shared_ptr<rdmapp::pd> pd, MemoryConfig config)
+    -> std::shared_ptr<registered_arena> {
+  return std::shared_ptr<registered_arena>(new registered_arena(std::move(pd), config));
+}
+
+auto registered_arena::add_chunk(std::size_t min_size) -> chunk & {
+  auto &c = chunks_.emplace_back(*pd_, std::max(min_size, config_.chunk_size), config_);
+  get_logger()->info("registered_arena: mapped chunk of {} bytes, page_size={}, numa_node={}",
+                     c.mem.length, c.mem.page_size, config_.numa_node);
+  return c;
+}
+
+auto registered_arena::allocate(std::size_t size) -> block {
+  size = round_up(std::max<std::size_t>(size, 1), kAlign);
+  std::lock_guard lock(mutex_);
+  auto take = [&](chunk &c) -> std::optional<block> {
+    for (auto it = c.free_ranges.begin(); it != c.free_ranges.end(); ++it) {
+      auto [offset, length] = *it;
+      if (length < size) {
+        continue;
+      }
+      c.free_ranges.erase(it);
+      if (length > size) {
+        c.free_ranges.emplace(offset + size, length - size);
+      }
+      return block(shared_from_this(), &c, offset, size);
+    }
+    return std::nullopt;
+  };
+  for (auto &c : chunks_) {
+    if (auto b = take(c)) {
+      return std::move(*b);
+    }
+  }
+  return std::move(*take(add_chunk(size)));
+}
+
+auto registered_arena::free(chunk *c, std::size_t offset, std::size_t size) -> void {
+  std::lock_guard lock(mutex_);
+  auto [it, _] = c->free_ranges.emplace(offset, size);
+  auto next = std::next(it);
+  if (next != c->free_ranges.end() && it->first + it->second == next->first) {
+    it->second += next->second;
+    c->free_ranges.erase(next);
+  }
+  if (it != c->free_ranges.begin()) {
+    auto prev = std::prev(it);
+    if (prev->first + prev->second == it->first) {
+      prev->second += it->second;
+      c->free_ranges.erase(it);
+    }
+  }
+}
+
+auto registered_arena::registered_bytes() const -> std::size_t {
+  std::lock_guard lock(mutex_);
+  std::size_t total = 0;
+  for (auto const &c : chunks_) {
+    total += c.mem.length;
+  }
+  return total;
+}
+
+auto nic_numa_node(uint32_t device_nr) -> int {
+  int num_devices = 0;
+  auto **devices = ::ibv_get_device_list(&num_devices);
+  if (devices == nullptr) {
+    return -1;
+  }
+  int node = -1;
+  if (device_nr < static_cast<uint32_t>(num_devices)) {
+    std::ifstream in(std::string("/sys/class/infiniband/") +
+                     ::ibv_get_device_name(devices[device_nr]) + "/device/numa_node");
+    if (!(in >> node)) {
+      node = -1;
+    }
+  }
+  ::ibv_free_device_list(devices);
+  return node;
+}
+
+auto nic_local_memory_config(TypedRpcConfig const &config) -> MemoryConfig {
+  MemoryConfig memory = config.memory;
+  if (config.numa_local && memory.numa_node < 0) {
+    memory.numa_node = nic_numa_node(config.device_nr);
+  }
+  return memory;
+}
+
+} // namespace coverbs_rpc
@@ -0,0 +1,121 @@
+#include "coverbs_rpc/replay_cache.hpp"
+#include "coverbs_rpc/detail/logger.hpp"
+#include "coverbs_rpc/server_mux.hpp"
+
+#include <algorithm>
+
+namespace coverbs_rpc {
+
+using detail::get_logger;
+
+struct replay_cache::client_state {
+  struct call {
+    bool completed = false;
+    std::vector<std::byte> reply;
+  };
+
+  std::mutex mutex;
+  // Signalled whenever a call completes or is dropped.
+  std::condition_variable changed;
+  // Calls numbered below it were acknowledged or dropped; their repeats are refused.
+  uint64_t low_water = 0;
+  std::map<uint64_t, call> calls;
+  // Guarded by the shard's mutex.
+  std::chrono::steady_clock::time_point last_seen;
+};
+
+replay_cache::claim::claim(claim &&other) noexcept
+    : state_(std::move(other.state_))
+    , seq_(other.seq_) {}
+
+replay_cache::claim::~claim() {
+  if (!state_) {
+    return;
+  }
+  // The handler failed: forget the call so that a repeat runs it.
+  {
+    std::lock_guard lock(state_->mutex);
+    auto it = state_->calls.find(seq_);
+    if (it != state_->calls.end() && !it->second.completed) {
+      state_->calls.erase(it);
+    }
+  }
+  state_->changed.notify_all();
+}
+
+auto replay_cache::claim::complete(std::span<const std::byte> reply) -> void {
+  {
+    std::lock_guard lock(state_->mutex);
+    // Gone if the client acknowledged it meanwhile, which a repeat's reply lets it do.
+    if (auto it = state_->calls.find(seq_); it != state_->calls.end()) {
+      it->second.reply.assign(reply.begin(), reply.end());
+      it->second.completed = true;
+    }
+  }
+  state_->changed.notify_all();
+  state_.reset();
+}
+
+replay_cache::replay_cache(AtMostOnceConfig config)
+    : config_(config) {}
+
+replay_cache::~replay_cache() = default;
+
+auto replay_cache::client(uint64_t id) -> std::shared_ptr<client_state> {
+  auto &s = shards_[id % kShards];
+  auto const now = std::chrono::steady_clock::now();
+  std::lock_guard lock(s.mutex);
+  auto &state = s.clients[id];
+  if (!state) {
+    // New clients are rare enough to sweep out the idle ones on.
+    std::erase_if(s.clients, [&](auto const &entry) {
+      return entry.second && now - entry.second->last_seen > config_.client_ttl;
+    });
+    state = std::make_shared<client_state>();
+  }
+  state->last_seen = now;
+  return state;
+}
+
+auto replay_cache::acquire(detail::ReplayDesc const &id, std::span<std::byte> resp,
+                           rpc_context &ctx, std::size_t &len) -> claim {
+  auto state = client(id.client);
+  std::unique_lock lock(state->mutex);
+  if (id.acked > state->low_water) {
+    state->low_water = id.acked;
+    state->calls.erase(state->calls.begin(), state->calls.lower_bound(id.acked));
+    state->changed.notify_all();
+  }
+  while (true) {
+    if (id.seq < state->low_water) [[unlikely]] {
+      get_logger()->warn("replay_cache: refused repeat of call {} from client {}, already dropped",
+                         id.seq, id.client);
+      len = 0;
+      ctx.failure = detail::failure_reason::replay_refused;
+      return claim{};
+    }
+    auto [it, inserted] = state->calls.try_emplace(id.seq);
+    if (inserted) {
+      while (state->calls.size() > config_.window && state->calls.begin()->second.completed) {
+        state->low_water = state->calls.begin()->first + 1;
+        state->calls.erase(state->calls.begin());
+      }
+      return claim(state, id.seq);
+    }
+    if (it->second.completed) {
+      auto const &reply = it->second.reply;
+      if (reply.size() <= resp.size()) {
+        std::copy_n(reply.data(), reply.size(), resp.data());
+      } else {
+        ctx.large_resp.assign(reply.begin(), reply.end());
+      }
+      len = reply.size();
+      replayed_.fetch_add(1, std::memory_order_relaxed);
+      return claim{};
+    }
+    // The first copy is still running: its reply answers this one too.
+    state->changed.wait(lock);
+  }
+}
+
+} // namespace coverbs_rpc
@@ -0,0 +1,104 @@
+#include "coverbs_rpc/replicated_client.hpp"
+#include "coverbs_rpc/detail/logger.hpp"
+
+#include <algorithm>
+#include <cppcoro/sync_wait.hpp>
+#include <stdexcept>
+
+namespace coverbs_rpc {
+using detail::get_logger;
+
+replicated_client::replicated_client(cppcoro::io_service &io_service,
+                                     std::vector<server_address> const &replicas,
+                                     TypedRpcConfig config, HedgeConfig hedge)
+    : hedge_(hedge)
+    , io_service_(io_service) {
+  if (replicas.empty()) [[unlikely]] {
+    throw std::runtime_error("replicated_client: no replicas given");
+  }
+  replicas_.reserve(replicas.size());
+  for (auto const &address : replicas) {
+    auto r = std::make_unique<replica_state>();
+    r->client = std::make_unique<typed_client>(io_service, address.hostname, address.port, config);
+    replicas_.push_back(std::move(r));
+  }
+  if (hedge_.enabled) {
+    samples_.reserve(std::max<uint32_t>(hedge_.window, 1));
+  }
+  get_logger()->info("replicated_client: connected to {} replicas, hedging {}", replicas_.size(),
+                     hedge_.enabled ? "on" : "off");
+}
+
+replicated_client::~replicated_client() { cppcoro::sync_wait(scope_.join()); }
+
+auto replicated_client::pick(std::size_t exclude) noexcept -> std::size_t {
+  std::size_t const n = replicas_.size();
+  std::size_t const first = cursor_.fetch_add(1, std::memory_order_relaxed) % n;
+  std::size_t best = kNoReplica;
+  double best_score = 0;
+  for (std::size_t k = 0; k < n; ++k) {
+    std::size_t const i = (first + k) % n;
+    if (i == exclude) {
+      continue;
+    }
+    auto const &r = *replicas_[i];
+    // A replica that has not answered yet scores zero, so every one is tried early on.
+    double const score = static_cast<double>(r.in_flight.load(std::memory_order_relaxed) + 1) *
+                         static_cast<double>(r.latency_ns.load(std::memory_order_relaxed));
+    if (best == kNoReplica || score < best_score) {
+      best = i;
+      best_score = score;
+    }
+  }
+  // Only `exclude` itself when there is a single replica.
+  return best != kNoReplica ? best : exclude;
+}
+
+auto replicated_client::hedge_delay() const noexcept -> std::optional<std::chrono::nanoseconds> {
+  if (!hedge_.enabled || replicas_.size() < 2) {
+    return std::nullopt;
+  }
+  int64_t const delay = hedge_delay_ns_.load(std::memory_order_relaxed);
+  if (delay < 0) {
+    return std::nullopt;
+  }
+  return std::max<std::chrono::nanoseconds>(std::chrono::nanoseconds(delay), hedge_.min_delay);
+}
+
+auto replicated_client::finish(std::size_t i, std::chrono::steady_clock::time_point start,
+                               bool ok) -> void {
+  auto &r = *replicas_[i];
+  r.in_flight.fetch_sub(1, std::memory_order_relaxed);
+  int64_t sample = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  int64_t const average = r.latency_ns.load(std::memory_order_relaxed);
+  if (!ok) {
+    // Failures are often fast (a shed call); count them as slow so load moves elsewhere.
+    sample = std::max(sample, 2 * average);
+  }
+  // Weight 1/8 for the new sample, as TCP's smoothed RTT. Concurrent updates may lose one.
+  r.latency_ns.store(average == 0 ? sample : average + (sample - average) / 8,
+                     std::memory_order_relaxed);
+
+  if (!hedge_.enabled || !ok) {
+    return;
+  }
+  std::size_t const window = std::max<uint32_t>(hedge_.window, 1);
+  std::lock_guard lock(samples_mutex_);
+  if (samples_.size() < window) {
+    samples_.push_back(sample);
+  } else {
+    samples_[samples_seen_ % window] = sample;
+  }
+  if (++samples_seen_ % std::max<std::size_t>(window / 16, 1) != 0) {
+    return;
+  }
+  auto sorted = samples_;
+  auto const rank = static_cast<std::size_t>(
+      std::clamp(hedge_.percentile, 0.0, 1.0) * static_cast<double>(sorted.size() - 1));
+  std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+  hedge_delay_ns_.store(sorted[rank], std::memory_order_relaxed);
+}
+
+} // namespace coverbs_rpc
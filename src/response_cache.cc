@@ -0,0 +1,105 @@
+#include "coverbs_rpc/response_cache.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace coverbs_rpc {
+
+namespace {
+
+// Bookkeeping an entry costs on top of its key and response.
+constexpr std::size_t kEntryOverhead = 128;
+
+auto entry_bytes(std::size_t key_len, std::size_t resp_len) noexcept -> std::size_t {
+  return key_len + resp_len + kEntryOverhead;
+}
+
+} // namespace
+
+response_cache::response_cache(ResponseCacheConfig config)
+    : shard_bytes_(config.max_bytes / std::max<uint32_t>(config.shards, 1)) {
+  for (uint32_t i = 0; i < std::max<uint32_t>(config.shards, 1); ++i) {
+    shards_.push_back(std::make_unique<shard>());
+  }
+}
+
+response_cache::~response_cache() = default;
+
+auto response_cache::set_policy(uint32_t fn_id, cache_policy policy) -> void {
+  policies_[fn_id] = std::move(policy);
+}
+
+auto response_cache::locate(uint32_t fn_id, std::span<const std::byte> req)
+    -> std::pair<shard &, std::string_view> {
+  thread_local std::string key;
+  key.resize(sizeof(fn_id) + req.size());
+  std::memcpy(key.data(), &fn_id, sizeof(fn_id));
+  std::memcpy(key.data() + sizeof(fn_id), req.data(), req.size());
+  std::size_t const hash = std::hash<std::string_view>{}(key);
+  return {*shards_[hash % shards_.size()], key};
+}
+
+auto response_cache::lookup(uint32_t fn_id, std::span<const std::byte> req, uint64_t version,
+                            std::span<std::byte> out) -> std::optional<std::size_t> {
+  auto [s, key] = locate(fn_id, req);
+  std::lock_guard lock(s.mutex);
+  auto found = s.index.find(key);
+  if (found == s.index.end()) {
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return std::nullopt;
+  }
+  auto it = found->second;
+  if (it->version != version || std::chrono::steady_clock::now() >= it->expires) {
+    erase(s, it);
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return std::nullopt;
+  }
+  if (it->resp.size() > out.size()) [[unlikely]] {
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return std::nullopt;
+  }
+  s.lru.splice(s.lru.begin(), s.lru, it);
+  std::copy_n(it->resp.data(), it->resp.size(), out.data());
+  hits_.fetch_add(1, std::memory_order_relaxed);
+  return it->resp.size();
+}
+
+auto response_cache::store(uint32_t fn_id, std::span<const std::byte> req, uint64_t version,
+                           std::span<const std::byte> resp) -> void {
+  auto const *p = policy(fn_id);
+  if (p == nullptr) [[unlikely]] {
+    return;
+  }
+  auto [s, key] = locate(fn_id, req);
+  std::size_t const size = entry_bytes(key.size(), resp.size());
+  if (size > shard_bytes_) {
+    return;
+  }
+  auto const expires = p->ttl.count() != 0 ? std::chrono::steady_clock::now() + p->ttl
+                                           : std::chrono::steady_clock::time_point::max();
+
+  std::lock_guard lock(s.mutex);
+  if (auto found = s.index.find(key); found != s.index.end()) {
+    // Another thread filled it meanwhile; the newer response wins.
+    erase(s, found->second);
+  }
+  while (!s.lru.empty() && s.bytes + size > shard_bytes_) {
+    erase(s, std::prev(s.lru.end()));
+  }
+  s.lru.push_front(entry{
+      .key = std::string(key),
+      .resp = std::vector<std::byte>(resp.begin(), resp.end()),
+      .version = version,
+      .expires = expires,
+  });
+  s.index.emplace(s.lru.front().key, s.lru.begin());
+  s.bytes += size;
+}
+
+auto response_cache::erase(shard &s, std::list<entry>::iterator it) -> void {
+  s.bytes -= entry_bytes(it->key.size(), it->resp.size());
+  s.index.erase(it->key);
+  s.lru.erase(it);
+}
+
+} // namespace coverbs_rpc
@@ -1,11 +1,17 @@
 #include "coverbs_rpc/server_mux.hpp"
 #include "coverbs_rpc/detail/logger.hpp"
+#include "coverbs_rpc/replay_cache.hpp"
+#include "coverbs_rpc/response_cache.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
 
 namespace coverbs_rpc {
 using detail::get_logger;
 
 auto basic_mux::register_handler(uint32_t fn_id, std::string_view fn_name, Handler h) -> void {
-  if (handlers_.find(fn_id) != handlers_.end()) [[unlikely]] {
+  if (handlers_.contains(fn_id) || stream_handlers_.contains(fn_id)) [[unlikely]] {
     get_logger()->critical("server_mux: register the same handler for fn_id {}", fn_id);
     std::terminate();
   }
@@ -13,14 +19,124 @@ auto basic_mux::register_handler(uint32_t fn_id, std::string_view fn_name, Handl
   handlers_[fn_id] = std::move(h);
 }
 
-auto basic_mux::dispatch(uint32_t fn_id, std::span<std::byte> payload,
-                         std::span<std::byte> resp) const -> std::size_t {
+auto basic_mux::register_stream_handler(uint32_t fn_id, std::string_view fn_name,
+                                        StreamHandler h) -> void {
+  if (handlers_.contains(fn_id) || stream_handlers_.contains(fn_id)) [[unlikely]] {
+    get_logger()->critical("server_mux: register the same handler for fn_id {}", fn_id);
+    std::terminate();
+  }
+  get_logger()->info("server_mux: register stream: id={} name={}", fn_id, fn_name);
+  stream_handlers_[fn_id] = std::move(h);
+}
+
+auto basic_mux::set_priority(uint32_t fn_id, rpc_priority priority) -> void {
+  priorities_[fn_id] = priority;
+}
+
+auto basic_mux::priority(uint32_t fn_id) const -> rpc_priority {
+  auto it = priorities_.find(fn_id);
+  return it != priorities_.end() ? it->second : rpc_priority::normal;
+}
+
+auto basic_mux::set_cache(std::shared_ptr<response_cache> cache) -> void {
+  cache_ = std::move(cache);
+}
+
+template <typename Run>
+auto basic_mux::through_cache(uint32_t fn_id, std::span<std::byte> payload,
+                              std::span<std::byte> resp, rpc_context &ctx, Run &&run) const
+    -> std::size_t {
+  cache_policy const *policy = cache_ ? cache_->policy(fn_id) : nullptr;
+  // Bulk calls exchange more than the request and response bytes the key and entry hold.
+  if (policy == nullptr || !ctx.bulk_in.empty() || !ctx.bulk_out.empty()) {
+    return run();
+  }
+  uint64_t const version = policy->version ? policy->version() : 0;
+  if (auto hit = cache_->lookup(fn_id, payload, version, resp)) {
+    return *hit;
+  }
+  std::size_t const len = run();
+  // Responses through large_resp are too big to be worth a copy per hit.
+  if (ctx.large_resp.empty() && len <= resp.size()) {
+    cache_->store(fn_id, payload, version, resp.first(len));
+  }
+  return len;
+}
+
+auto basic_mux::set_replay(std::shared_ptr<replay_cache> replay) -> void {
+  replay_ = std::move(replay);
+}
+
+template <typename Run>
+auto basic_mux::through_replay(std::span<std::byte> resp, rpc_context &ctx, Run &&run) const
+    -> std::size_t {
+  if (!ctx.replay || !replay_) {
+    return run();
+  }
+  std::size_t len = 0;
+  auto claim = replay_->acquire(*ctx.replay, resp, ctx, len);
+  if (!claim.owned()) {
+    return len;
+  }
+  len = run();
+  if (ctx.large_resp.empty()) {
+    claim.complete(resp.first(std::min(len, resp.size())));
+  } else {
+    claim.complete(std::span<const std::byte>(ctx.large_resp).first(
+        std::min(len, ctx.large_resp.size())));
+  }
+  return len;
+}
+
+auto basic_mux::dispatch(uint32_t fn_id, std::span<std::byte> payload, std::span<std::byte> resp,
+                         rpc_context &ctx) const -> std::size_t {
+  return through_replay(resp, ctx, [&] {
+    return through_cache(fn_id, payload, resp, ctx,
+                         [&] { return invoke(fn_id, payload, resp, ctx); });
+  });
+}
+
+auto basic_mux::invoke(uint32_t fn_id, std::span<std::byte> payload, std::span<std::byte> resp,
+                       rpc_context &ctx) const -> std::size_t {
   auto it = handlers_.find(fn_id);
   if (it == handlers_.end()) [[unlikely]] {
     get_logger()->error("server_mux: handler not found for fn_id={}", fn_id);
     return 0;
   }
-  return it->second(payload, resp);
+  return it->second(payload, resp, ctx);
+}
+
+auto basic_mux::register_service(std::span<method_entry const> methods, void *instance) -> void {
+  services_.push_back({.methods = methods, .instance = instance});
+}
+
+auto basic_mux::dispatch(detail::RpcHeader const &header, std::span<std::byte> payload,
+                         std::span<std::byte> resp, rpc_context &ctx) const -> std::size_t {
+  auto run = [&]() -> std::size_t {
+    if (header.flags & detail::kFlagIndexed) {
+      uint32_t const index = header.flags >> detail::kMethodIndexShift;
+      // Servers host a handful of services at most; the fn_id check tells them apart.
+      for (auto const &service : services_) {
+        if (index < service.methods.size() && service.methods[index].fn_id == header.fn_id &&
+            service.methods[index].invoke != nullptr) {
+          return service.methods[index].invoke(service.instance, payload, resp, ctx);
+        }
+      }
+    }
+    return invoke(header.fn_id, payload, resp, ctx);
+  };
+  return through_replay(resp, ctx,
+                        [&] { return through_cache(header.fn_id, payload, resp, ctx, run); });
+}
+
+auto basic_mux::open_stream(uint32_t fn_id, std::span<std::byte> payload) const
+    -> cppcoro::async_generator<std::span<const std::byte>> {
+  auto it = stream_handlers_.find(fn_id);
+  if (it == stream_handlers_.end()) [[unlikely]] {
+    throw std::runtime_error("server_mux: stream handler not found for fn_id=" +
+                             std::to_string(fn_id));
+  }
+  return it->second(payload);
 }
 
 } // namespace coverbs_rpc
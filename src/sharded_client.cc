@@ -0,0 +1,106 @@
+#include "coverbs_rpc/sharded_client.hpp"
+#include "coverbs_rpc/detail/logger.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace coverbs_rpc {
+using detail::get_logger;
+
+namespace {
+
+auto same_address(server_address const &a, server_address const &b) noexcept -> bool {
+  return a.port == b.port && a.hostname == b.hostname;
+}
+
+} // namespace
+
+sharded_client::sharded_client(cppcoro::io_service &io_service,
+                               std::vector<server_address> const &shards, TypedRpcConfig config,
+                               ShardingConfig sharding)
+    : config_(config)
+    , sharding_(sharding)
+    , io_service_(io_service) {
+  if (config_.enable_rdma) {
+    try {
+      rdma_ = client_resources::open(io_service_, config_);
+    } catch (const std::exception &e) {
+      get_logger()->warn("sharded_client: cannot open the RDMA device ({}), not using RDMA",
+                         e.what());
+      config_.enable_rdma = false;
+    }
+  }
+  set_members(shards);
+}
+
+sharded_client::~sharded_client() = default;
+
+auto sharded_client::set_members(std::vector<server_address> const &shards) -> void {
+  if (shards.empty()) [[unlikely]] {
+    throw std::runtime_error("sharded_client: no shards given");
+  }
+  std::lock_guard lock(membership_mutex_);
+  ring const *current = ring_.load();
+
+  // Connect the newcomers first, so that a failure leaves everything as it was.
+  std::vector<std::unique_ptr<shard>> joined;
+  std::vector<shard *> members;
+  std::vector<std::string> names;
+  members.reserve(shards.size());
+  names.reserve(shards.size());
+  for (auto const &address : shards) {
+    shard *member = nullptr;
+    if (current != nullptr) {
+      auto it = std::find_if(current->shards.begin(), current->shards.end(),
+                             [&](shard *s) { return same_address(s->address, address); });
+      member = it != current->shards.end() ? *it : nullptr;
+    }
+    if (member == nullptr) {
+      auto s = std::make_unique<shard>();
+      s->address = address;
+      s->client = std::make_unique<typed_client>(io_service_, address.hostname, address.port,
+                                                 config_, rdma_);
+      member = joined.emplace_back(std::move(s)).get();
+    }
+    members.push_back(member);
+    names.push_back(address.hostname + ":" + std::to_string(address.port));
+  }
+
+  auto next = std::make_unique<ring>(
+      ring{detail::hash_ring(names, sharding_.vnodes, sharding_.ring_bits), std::move(members)});
+  if (current != nullptr) {
+    for (shard *s : current->shards) {
+      if (std::find(next->shards.begin(), next->shards.end(), s) == next->shards.end()) {
+        leaving_.push_back(s);
+      }
+    }
+  }
+  for (auto &s : joined) {
+    shards_.push_back(std::move(s));
+  }
+  ring_.store(next.get());
+  rings_.push_back(std::move(next));
+
+  // Disconnect the shards that left once no call holds them; see acquire().
+  std::erase_if(leaving_, [](shard *s) {
+    if (s->in_flight.load() != 0) {
+      return false;
+    }
+    s->client.reset();
+    return true;
+  });
+  get_logger()->info("sharded_client: routing over {} shards, {} connected", shards.size(),
+                     shards.size() + leaving_.size());
+}
+
+auto sharded_client::members() const -> std::vector<server_address> {
+  std::lock_guard lock(membership_mutex_);
+  std::vector<server_address> out;
+  for (shard const *s : ring_.load()->shards) {
+    out.push_back(s->address);
+  }
+  return out;
+}
+
+} // namespace coverbs_rpc
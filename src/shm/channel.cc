@@ -0,0 +1,349 @@
+#include "coverbs_rpc/shm/channel.hpp"
+#include "coverbs_rpc/detail/logger.hpp"
+#include "coverbs_rpc/utils/backoff.hpp"
+#include "coverbs_rpc/utils/spin_wait.hpp"
+
+#include <arpa/inet.h>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <ifaddrs.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <new>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace coverbs_rpc::shm {
+using detail::get_logger;
+
+namespace {
+
+constexpr uint64_t kSegmentMagic = 0x6d68732d73627663; // "cvbs-shm"
+constexpr std::size_t kSegmentHeaderSize = 256;
+
+// Start of the segment; the client->server ring follows it, then the server->client one.
+struct segment_header {
+  uint64_t magic;
+  uint64_t ring_size;
+  // Indexed by channel::side.
+  std::atomic<uint32_t> closed[2];
+};
+static_assert(sizeof(segment_header) <= kSegmentHeaderSize);
+
+auto segment_size(std::size_t ring_size) -> std::size_t {
+  return kSegmentHeaderSize + 2 * spsc_ring::footprint(ring_size);
+}
+
+auto segment(std::byte *base) -> segment_header * {
+  return reinterpret_cast<segment_header *>(base);
+}
+
+auto client_to_server(std::byte *base) -> std::byte * { return base + kSegmentHeaderSize; }
+
+auto server_to_client(std::byte *base, std::size_t ring_size) -> std::byte * {
+  return base + kSegmentHeaderSize + spsc_ring::footprint(ring_size);
+}
+
+auto throw_errno(char const *what) -> void {
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+// Abstract socket names live in the network namespace rather than the filesystem, so there is
+// nothing to clean up after a crash.
+auto socket_address(uint16_t port) -> std::pair<sockaddr_un, socklen_t> {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  auto name = "coverbs-rpc-" + std::to_string(port);
+  std::memcpy(addr.sun_path + 1, name.data(), name.size());
+  return {addr, static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + name.size())};
+}
+
+auto map_segment(int fd, std::size_t len) -> std::byte * {
+  void *base = ::mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) [[unlikely]] {
+    throw_errno("shm: mmap");
+  }
+  return static_cast<std::byte *>(base);
+}
+
+} // namespace
+
+channel::channel(int sock, std::byte *base, std::size_t map_len, std::size_t ring_size, side s)
+    : sock_(sock)
+    , base_(base)
+    , map_len_(map_len)
+    , side_(s)
+    , inbound_(s == side::server ? client_to_server(base) : server_to_client(base, ring_size),
+               ring_size)
+    , outbound_(s == side::server ? server_to_client(base, ring_size) : client_to_server(base),
+                ring_size) {}
+
+channel::~channel() {
+  close();
+  ::munmap(base_, map_len_);
+  ::close(sock_);
+}
+
+auto channel::send(std::span<const std::byte> header, std::span<const std::byte> payload,
+                   WaitPolicy const &wait) -> void {
+  if (header.size() + payload.size() > max_message()) [[unlikely]] {
+    throw std::runtime_error("shm: message of " + std::to_string(header.size() + payload.size()) +
+                             " bytes exceeds the ring's " + std::to_string(max_message()));
+  }
+  std::lock_guard lock(send_mutex_);
+  utils::backoff full_backoff(wait);
+  while (!outbound_.try_push(header, payload)) {
+    if (!alive()) [[unlikely]] {
+      throw std::runtime_error("shm: connection closed");
+    }
+    full_backoff.pause();
+  }
+  outbound_.notify();
+}
+
+auto channel::receive(on_message_fn const &on_message, WaitPolicy const &wait,
+                      std::stop_token const &stop) -> bool {
+  auto const spin_until = std::chrono::steady_clock::now() + wait.spin_budget;
+  for (uint64_t spins = 1; !inbound_.try_pop(on_message); ++spins) {
+    // Both checks cost more than a poll of the ring, so only make them every so often.
+    if (spins % kCheckStride != 0) {
+      utils::detail::cpu_relax();
+      continue;
+    }
+    if (stop.stop_requested() || !alive()) {
+      return false;
+    }
+    if (wait.mode == wait_mode::hybrid && std::chrono::steady_clock::now() >= spin_until) {
+      inbound_.wait(kParkTimeout);
+    }
+  }
+  return true;
+}
+
+auto channel::alive() noexcept -> bool {
+  auto *seg = segment(base_);
+  if (seg->closed[0].load(std::memory_order_acquire) != 0 ||
+      seg->closed[1].load(std::memory_order_acquire) != 0) {
+    return false;
+  }
+  pollfd pfd{.fd = sock_, .events = POLLRDHUP, .revents = 0};
+  return ::poll(&pfd, 1, 0) == 0;
+}
+
+auto channel::close() noexcept -> void {
+  auto &closed = segment(base_)->closed[static_cast<int>(side_)];
+  if (closed.exchange(1, std::memory_order_acq_rel) == 0) {
+    outbound_.notify();
+  }
+}
+
+listener::listener(uint16_t port, std::size_t ring_size)
+    : sock_(::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0))
+    , ring_size_(std::bit_ceil(ring_size)) {
+  if (sock_ < 0) [[unlikely]] {
+    throw_errno("shm: socket");
+  }
+  auto [addr, len] = socket_address(port);
+  if (::bind(sock_, reinterpret_cast<sockaddr *>(&addr), len) < 0 || ::listen(sock_, 64) < 0)
+      [[unlikely]] {
+    int err = errno;
+    ::close(sock_);
+    throw std::system_error(err, std::generic_category(), "shm: bind");
+  }
+  get_logger()->info("shm: listening for local clients of port {}, ring_size={}", port,
+                     ring_size_);
+}
+
+listener::~listener() {
+  close();
+  ::close(sock_);
+}
+
+auto listener::accept() -> std::unique_ptr<channel> {
+  while (true) {
+    int conn;
+    while ((conn = ::accept4(sock_, nullptr, nullptr, SOCK_CLOEXEC)) < 0) {
+      if (closed_.load()) {
+        return nullptr;
+      }
+      if (errno != EINTR && errno != ECONNABORTED) [[unlikely]] {
+        throw_errno("shm: accept");
+      }
+    }
+    if (closed_.load()) [[unlikely]] {
+      ::close(conn);
+      return nullptr;
+    }
+    try {
+      return handshake(conn);
+    } catch (const std::exception &e) {
+      get_logger()->warn("shm: dropped a local client: {}", e.what());
+    }
+  }
+}
+
+auto listener::handshake(int conn) -> std::unique_ptr<channel> {
+  std::size_t const map_len = segment_size(ring_size_);
+  int fd = ::memfd_create("coverbs-rpc-shm", MFD_CLOEXEC);
+  if (fd < 0 || ::ftruncate(fd, static_cast<off_t>(map_len)) < 0) [[unlikely]] {
+    int err = errno;
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    ::close(conn);
+    throw std::system_error(err, std::generic_category(), "shm: memfd");
+  }
+  std::byte *base;
+  try {
+    base = map_segment(fd, map_len);
+  } catch (...) {
+    ::close(fd);
+    ::close(conn);
+    throw;
+  }
+
+  auto *seg = new (base) segment_header;
+  seg->magic = kSegmentMagic;
+  seg->ring_size = ring_size_;
+  seg->closed[0].store(0, std::memory_order_relaxed);
+  seg->closed[1].store(0, std::memory_order_relaxed);
+  spsc_ring::init(client_to_server(base));
+  spsc_ring::init(server_to_client(base, ring_size_));
+
+  // The ring size rides along with the descriptor so the client can map the segment.
+  uint64_t ring_size = ring_size_;
+  iovec iov{.iov_base = &ring_size, .iov_len = sizeof(ring_size)};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))]{};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  auto *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(fd));
+  bool const sent = ::sendmsg(conn, &msg, MSG_NOSIGNAL) == sizeof(ring_size);
+  int const send_err = errno;
+  ::close(fd);
+
+  auto ch = std::make_unique<channel>(conn, base, map_len, ring_size_, channel::side::server);
+  if (!sent) [[unlikely]] {
+    throw std::system_error(send_err, std::generic_category(), "shm: sendmsg");
+  }
+  return ch;
+}
+
+auto listener::close() noexcept -> void {
+  if (!closed_.exchange(true)) {
+    // Wakes a thread blocked in accept().
+    ::shutdown(sock_, SHUT_RDWR);
+  }
+}
+
+auto connect(uint16_t port) -> std::unique_ptr<channel> {
+  int sock = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (sock < 0) [[unlikely]] {
+    throw_errno("shm: socket");
+  }
+  auto [addr, len] = socket_address(port);
+  if (::connect(sock, reinterpret_cast<sockaddr *>(&addr), len) < 0) {
+    ::close(sock);
+    return nullptr;
+  }
+
+  uint64_t ring_size = 0;
+  iovec iov{.iov_base = &ring_size, .iov_len = sizeof(ring_size)};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))]{};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  ssize_t n;
+  while ((n = ::recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR) {
+  }
+  auto *cmsg = CMSG_FIRSTHDR(&msg);
+  if (n != sizeof(ring_size) || cmsg == nullptr || cmsg->cmsg_type != SCM_RIGHTS ||
+      !std::has_single_bit(ring_size)) [[unlikely]] {
+    ::close(sock);
+    throw std::runtime_error("shm: malformed handshake");
+  }
+  int fd;
+  std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+
+  std::size_t const map_len = segment_size(ring_size);
+  std::byte *base;
+  try {
+    base = map_segment(fd, map_len);
+  } catch (...) {
+    ::close(fd);
+    ::close(sock);
+    throw;
+  }
+  ::close(fd);
+  if (segment(base)->magic != kSegmentMagic) [[unlikely]] {
+    ::munmap(base, map_len);
+    ::close(sock);
+    throw std::runtime_error("shm: segment magic mismatch");
+  }
+  return std::make_unique<channel>(sock, base, map_len, ring_size, channel::side::client);
+}
+
+auto is_local_host(std::string_view hostname) -> bool {
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *resolved = nullptr;
+  if (::getaddrinfo(std::string(hostname).c_str(), nullptr, &hints, &resolved) != 0) {
+    return false;
+  }
+  ifaddrs *ifs = nullptr;
+  if (::getifaddrs(&ifs) != 0) {
+    ifs = nullptr;
+  }
+
+  auto same = [](sockaddr const *a, sockaddr const *b) {
+    if (a == nullptr || b == nullptr || a->sa_family != b->sa_family) {
+      return false;
+    }
+    if (a->sa_family == AF_INET) {
+      return reinterpret_cast<sockaddr_in const *>(a)->sin_addr.s_addr ==
+             reinterpret_cast<sockaddr_in const *>(b)->sin_addr.s_addr;
+    }
+    if (a->sa_family == AF_INET6) {
+      return std::memcmp(&reinterpret_cast<sockaddr_in6 const *>(a)->sin6_addr,
+                         &reinterpret_cast<sockaddr_in6 const *>(b)->sin6_addr,
+                         sizeof(in6_addr)) == 0;
+    }
+    return false;
+  };
+
+  bool local = false;
+  for (auto *ai = resolved; ai != nullptr && !local; ai = ai->ai_next) {
+    if (ai->ai_family == AF_INET) {
+      auto const ip = ntohl(reinterpret_cast<sockaddr_in const *>(ai->ai_addr)->sin_addr.s_addr);
+      local = (ip >> 24) == 127;
+    } else if (ai->ai_family == AF_INET6) {
+      local = IN6_IS_ADDR_LOOPBACK(&reinterpret_cast<sockaddr_in6 const *>(ai->ai_addr)->sin6_addr);
+    }
+    for (auto *ifa = ifs; ifa != nullptr && !local; ifa = ifa->ifa_next) {
+      local = same(ai->ai_addr, ifa->ifa_addr);
+    }
+  }
+  if (ifs != nullptr) {
+    ::freeifaddrs(ifs);
+  }
+  ::freeaddrinfo(resolved);
+  return local;
+}
+
+} // namespace coverbs_rpc::shm
@@ -0,0 +1,106 @@
+#include "coverbs_rpc/shm/ring.hpp"
+
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <new>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace coverbs_rpc::shm {
+
+namespace {
+
+// Not FUTEX_PRIVATE: the word is shared with another process.
+auto futex_wait(std::atomic<uint32_t> *word, uint32_t expected, timespec const *timeout) -> void {
+  ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAIT, expected, timeout, nullptr,
+            0);
+}
+
+auto futex_wake(std::atomic<uint32_t> *word) -> void {
+  ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr,
+            0);
+}
+
+} // namespace
+
+spsc_ring::spsc_ring(std::byte *base, std::size_t capacity) noexcept
+    : header_(reinterpret_cast<ring_header *>(base))
+    , data_(base + kHeaderSize)
+    , capacity_(capacity)
+    , head_(header_->head.load(std::memory_order_relaxed))
+    , tail_(header_->tail.load(std::memory_order_relaxed))
+    , head_cache_(head_)
+    , tail_cache_(tail_) {}
+
+auto spsc_ring::init(std::byte *base) noexcept -> void {
+  auto *header = new (base) ring_header;
+  header->tail.store(0, std::memory_order_relaxed);
+  header->head.store(0, std::memory_order_relaxed);
+  header->seq.store(0, std::memory_order_relaxed);
+  header->waiting.store(0, std::memory_order_release);
+}
+
+auto spsc_ring::try_push(std::span<const std::byte> first,
+                         std::span<const std::byte> second) noexcept -> bool {
+  std::size_t const len = first.size() + second.size();
+  if (len > max_record()) [[unlikely]] {
+    return false;
+  }
+  std::size_t const need = record_size(len);
+  std::size_t const pos = tail_ & (capacity_ - 1);
+  std::size_t const to_end = capacity_ - pos;
+  std::size_t const total = need <= to_end ? need : to_end + need;
+
+  if (tail_ + total - head_cache_ > capacity_) {
+    head_cache_ = header_->head.load(std::memory_order_acquire);
+    if (tail_ + total - head_cache_ > capacity_) {
+      return false;
+    }
+  }
+
+  std::size_t at = pos;
+  if (need > to_end) {
+    // Records are 8-aligned, so there is always room for the marker.
+    std::memcpy(data_ + pos, &kWrapMarker, kLenSize);
+    at = 0;
+  }
+  auto const len32 = static_cast<uint32_t>(len);
+  std::memcpy(data_ + at, &len32, kLenSize);
+  if (!first.empty()) {
+    std::memcpy(data_ + at + kLenSize, first.data(), first.size());
+  }
+  if (!second.empty()) {
+    std::memcpy(data_ + at + kLenSize + first.size(), second.data(), second.size());
+  }
+  tail_ += total;
+  header_->tail.store(tail_, std::memory_order_release);
+  return true;
+}
+
+auto spsc_ring::notify() noexcept -> void {
+  // Pairs with the fence in wait(): either the consumer sees the new tail, or we see it waiting.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (header_->waiting.load(std::memory_order_relaxed) != 0) {
+    header_->seq.fetch_add(1, std::memory_order_release);
+    futex_wake(&header_->seq);
+  }
+}
+
+auto spsc_ring::wait(std::chrono::milliseconds timeout) noexcept -> void {
+  uint32_t const seq = header_->seq.load(std::memory_order_acquire);
+  header_->waiting.store(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (empty()) {
+    auto const secs = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+    timespec const ts{
+        .tv_sec = static_cast<time_t>(secs.count()),
+        .tv_nsec = static_cast<long>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(timeout - secs).count()),
+    };
+    futex_wait(&header_->seq, seq, &ts);
+  }
+  header_->waiting.store(0, std::memory_order_relaxed);
+}
+
+} // namespace coverbs_rpc::shm
@@ -0,0 +1,251 @@
+#include "coverbs_rpc/tcp/channel.hpp"
+#include "coverbs_rpc/detail/logger.hpp"
+#include "coverbs_rpc/utils/backoff.hpp"
+#include "coverbs_rpc/utils/spin_wait.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace coverbs_rpc::tcp {
+using detail::get_logger;
+
+namespace {
+
+auto set_nodelay(int sock) -> void {
+  int one = 1;
+  ::setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+} // namespace
+
+channel::channel(int sock)
+    : sock_(sock)
+    , read_buf_(kReadChunk) {
+  set_nodelay(sock_);
+}
+
+channel::~channel() {
+  close();
+  ::close(sock_);
+}
+
+auto channel::send(std::span<const std::byte> header, std::span<const std::byte> payload,
+                   WaitPolicy const &wait) -> void {
+  if (header.size() + payload.size() > kMaxMessage) [[unlikely]] {
+    throw std::runtime_error("tcp: message of " + std::to_string(header.size() + payload.size()) +
+                             " bytes exceeds the " + std::to_string(kMaxMessage) + " byte limit");
+  }
+  std::unique_lock lock(send_mutex_);
+  utils::backoff full_backoff(wait);
+  while (flushing_ && pending_.size() >= kMaxPending) {
+    lock.unlock();
+    full_backoff.pause();
+    lock.lock();
+  }
+  if (closed_.load(std::memory_order_acquire)) [[unlikely]] {
+    throw std::runtime_error("tcp: connection closed");
+  }
+  pending_.insert(pending_.end(), header.begin(), header.end());
+  pending_.insert(pending_.end(), payload.begin(), payload.end());
+  if (flushing_) {
+    // The thread already flushing writes this message with its next batch.
+    return;
+  }
+
+  flushing_ = true;
+  while (!pending_.empty()) {
+    std::swap(pending_, flushing_buf_);
+    lock.unlock();
+    bool const ok = write_all(flushing_buf_);
+    flushing_buf_.clear();
+    lock.lock();
+    if (!ok) [[unlikely]] {
+      int const err = errno;
+      flushing_ = false;
+      pending_.clear();
+      closed_.store(true, std::memory_order_release);
+      throw std::system_error(err, std::generic_category(), "tcp: send");
+    }
+  }
+  flushing_ = false;
+}
+
+auto channel::write_all(std::span<const std::byte> bytes) -> bool {
+  while (!bytes.empty()) {
+    ssize_t n = ::send(sock_, bytes.data(), bytes.size(), MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    bytes = bytes.subspan(static_cast<std::size_t>(n));
+  }
+  return true;
+}
+
+auto channel::receive(on_message_fn const &on_message, WaitPolicy const &wait,
+                      std::stop_token const &stop) -> bool {
+  auto const spin_until = std::chrono::steady_clock::now() + wait.spin_budget;
+  while (!deliver(on_message)) {
+    if (stop.stop_requested() || closed_.load(std::memory_order_acquire)) {
+      return false;
+    }
+
+    // Make room for at least one more chunk, and for the whole of a frame already begun.
+    std::size_t const buffered = read_end_ - read_begin_;
+    std::size_t want = kReadChunk;
+    if (buffered >= sizeof(detail::RpcHeader)) {
+      detail::RpcHeader header;
+      std::memcpy(&header, read_buf_.data() + read_begin_, sizeof(header));
+      if (sizeof(header) + header.payload_len > kMaxMessage) [[unlikely]] {
+        get_logger()->error("tcp: frame of {} bytes exceeds the limit", header.payload_len);
+        close();
+        return false;
+      }
+      want = std::max(want, sizeof(header) + header.payload_len - buffered);
+    }
+    if (read_buf_.size() - read_end_ < want) {
+      std::memmove(read_buf_.data(), read_buf_.data() + read_begin_, buffered);
+      read_begin_ = 0;
+      read_end_ = buffered;
+      if (read_buf_.size() - read_end_ < want) {
+        read_buf_.resize(read_end_ + want);
+      }
+    }
+
+    ssize_t n = ::recv(sock_, read_buf_.data() + read_end_, read_buf_.size() - read_end_,
+                       MSG_DONTWAIT);
+    if (n > 0) {
+      read_end_ += static_cast<std::size_t>(n);
+      continue;
+    }
+    if (n == 0) {
+      return false;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK) [[unlikely]] {
+      get_logger()->error("tcp: recv failed: {}", std::strerror(errno));
+      return false;
+    }
+    if (wait.mode == wait_mode::hybrid && std::chrono::steady_clock::now() >= spin_until) {
+      pollfd pfd{.fd = sock_, .events = POLLIN, .revents = 0};
+      ::poll(&pfd, 1, static_cast<int>(kParkTimeout.count()));
+    } else {
+      utils::detail::cpu_relax();
+    }
+  }
+  return true;
+}
+
+auto channel::deliver(on_message_fn const &on_message) -> bool {
+  bool delivered = false;
+  while (read_end_ - read_begin_ >= sizeof(detail::RpcHeader)) {
+    detail::RpcHeader header;
+    std::memcpy(&header, read_buf_.data() + read_begin_, sizeof(header));
+    std::size_t const frame_len = sizeof(header) + header.payload_len;
+    if (read_end_ - read_begin_ < frame_len) {
+      break;
+    }
+    on_message(std::span<std::byte>(read_buf_.data() + read_begin_, frame_len));
+    read_begin_ += frame_len;
+    delivered = true;
+  }
+  if (read_begin_ == read_end_) {
+    read_begin_ = read_end_ = 0;
+  }
+  return delivered;
+}
+
+auto channel::close() noexcept -> void {
+  if (!closed_.exchange(true)) {
+    ::shutdown(sock_, SHUT_RDWR);
+  }
+}
+
+listener::listener(uint16_t port)
+    : sock_(::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) {
+  if (sock_ < 0) [[unlikely]] {
+    throw std::system_error(errno, std::generic_category(), "tcp: socket");
+  }
+  int one = 1;
+  ::setsockopt(sock_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (::bind(sock_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+      ::listen(sock_, 128) < 0) [[unlikely]] {
+    int err = errno;
+    ::close(sock_);
+    throw std::system_error(err, std::generic_category(), "tcp: bind");
+  }
+  get_logger()->info("tcp: listening on port {}", port);
+}
+
+listener::~listener() {
+  close();
+  ::close(sock_);
+}
+
+auto listener::accept() -> std::unique_ptr<channel> {
+  int conn;
+  while ((conn = ::accept4(sock_, nullptr, nullptr, SOCK_CLOEXEC)) < 0) {
+    if (closed_.load()) {
+      return nullptr;
+    }
+    if (errno != EINTR && errno != ECONNABORTED) [[unlikely]] {
+      throw std::system_error(errno, std::generic_category(), "tcp: accept");
+    }
+  }
+  if (closed_.load()) [[unlikely]] {
+    ::close(conn);
+    return nullptr;
+  }
+  return std::make_unique<channel>(conn);
+}
+
+auto listener::close() noexcept -> void {
+  if (!closed_.exchange(true)) {
+    // Wakes a thread blocked in accept().
+    ::shutdown(sock_, SHUT_RDWR);
+  }
+}
+
+auto connect(std::string_view hostname, uint16_t port) -> std::unique_ptr<channel> {
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *resolved = nullptr;
+  if (::getaddrinfo(std::string(hostname).c_str(), std::to_string(port).c_str(), &hints,
+                    &resolved) != 0) {
+    return nullptr;
+  }
+  int sock = -1;
+  for (auto *ai = resolved; ai != nullptr && sock < 0; ai = ai->ai_next) {
+    sock = ::socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+    if (sock >= 0 && ::connect(sock, ai->ai_addr, ai->ai_addrlen) < 0) {
+      ::close(sock);
+      sock = -1;
+    }
+  }
+  ::freeaddrinfo(resolved);
+  if (sock < 0) {
+    return nullptr;
+  }
+  return std::make_unique<channel>(sock);
+}
+
+} // namespace coverbs_rpc::tcp
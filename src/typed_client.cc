@@ -1,4 +1,8 @@
 #include "coverbs_rpc/typed_client.hpp"
+#include "coverbs_rpc/detail/logger.hpp"
+#include "coverbs_rpc/registered_memory.hpp"
+#include "coverbs_rpc/shm/channel.hpp"
+#include "coverbs_rpc/tcp/channel.hpp"
 
 #include <cppcoro/sync_wait.hpp>
 #include <rdmapp/device.h>
@@ -6,16 +10,81 @@
 #include <rdmapp/qp.h>
 
 namespace coverbs_rpc {
+using detail::get_logger;
+
+namespace {
+
+auto open_resources(cppcoro::io_service &io_service, TypedRpcConfig const &config,
+                    MemoryConfig memory) -> std::shared_ptr<client_resources> {
+  auto r = std::make_shared<client_resources>();
+  r->device = std::make_shared<rdmapp::device>(config.device_nr, config.port_nr);
+  r->pd = std::make_shared<rdmapp::pd>(r->device);
+  r->connector =
+      std::make_unique<qp_connector>(io_service, r->pd, nullptr, config.to_conn_config());
+  r->arena = registered_arena::create(r->pd, memory);
+  return r;
+}
+
+} // namespace
 
 typed_client::typed_client(cppcoro::io_service &io_service, std::string_view hostname,
-                           uint16_t port, TypedRpcConfig config)
+                           uint16_t port, TypedRpcConfig config,
+                           std::shared_ptr<client_resources> shared)
     : config_(config)
-    , device_(std::make_shared<rdmapp::device>(config.device_nr, config.port_nr))
-    , pd_(std::make_shared<rdmapp::pd>(device_))
-    , io_service_(io_service)
-    , connector_(io_service_, pd_, nullptr, config.to_conn_config()) {
-  qp_ = cppcoro::sync_wait(connector_.connect(hostname, port));
-  client_ = std::make_unique<basic_client>(qp_, config_);
+    , io_service_(io_service) {
+  if (config_.enable_shm && shm::is_local_host(hostname)) {
+    if (auto ch = shm::connect(port)) {
+      get_logger()->info("typed_client: connected to {}:{} over shared memory", hostname, port);
+      transport_ = transport_kind::shm;
+      msg_client_ = std::make_unique<message_client>(std::move(ch), config_);
+      return;
+    }
+  }
+  if (config_.enable_rdma) {
+    try {
+      connect_rdma(hostname, port, std::move(shared));
+      transport_ = transport_kind::rdma;
+      return;
+    } catch (const std::exception &e) {
+      if (!config_.enable_tcp) {
+        throw;
+      }
+      get_logger()->warn("typed_client: RDMA connection to {}:{} failed ({}), trying TCP",
+                         hostname, port, e.what());
+      client_.reset();
+      qp_.reset();
+      pd_.reset();
+      rdma_.reset();
+    }
+  }
+  if (config_.enable_tcp) {
+    uint16_t const tcp_port = config_.tcp_port_for(port);
+    if (auto ch = tcp::connect(hostname, tcp_port)) {
+      get_logger()->info("typed_client: connected to {}:{} over TCP", hostname, tcp_port);
+      transport_ = transport_kind::tcp;
+      msg_client_ = std::make_unique<message_client>(std::move(ch), config_);
+      return;
+    }
+  }
+  throw std::runtime_error("typed_client: no enabled transport reached the server");
+}
+
+auto typed_client::connect_rdma(std::string_view hostname, uint16_t port,
+                                std::shared_ptr<client_resources> shared) -> void {
+  rdma_ = shared ? std::move(shared)
+                 : open_resources(io_service_, config_, nic_local_memory_config(config_));
+  pd_ = rdma_->pd;
+  qp_ = cppcoro::sync_wait(rdma_->connector->connect(hostname, port));
+  client_ = std::make_unique<basic_client>(qp_, config_, rdma_->arena);
+}
+
+auto client_resources::open(cppcoro::io_service &io_service, TypedRpcConfig const &config)
+    -> std::shared_ptr<client_resources> {
+  auto memory = nic_local_memory_config(config);
+  if (memory.chunk_size == 0) {
+    memory.chunk_size = config.shared_chunk_size;
+  }
+  return open_resources(io_service, config, memory);
 }
 
 } // namespace coverbs_rpc
@@ -1,41 +1,339 @@
 #include "coverbs_rpc/typed_server.hpp"
 #include "coverbs_rpc/basic_server.hpp"
 #include "coverbs_rpc/detail/logger.hpp"
+#include "coverbs_rpc/message_server.hpp"
+#include "coverbs_rpc/replay_cache.hpp"
+#include <algorithm>
 #include <cppcoro/async_scope.hpp>
+#include <cppcoro/sync_wait.hpp>
+#include <cstring>
+#include <infiniband/verbs.h>
+#include <pthread.h>
+#include <sched.h>
 
 namespace coverbs_rpc {
 
 using detail::get_logger;
 
+namespace {
+
+// Pins the executor's single thread to `cpu` and tags it with its shard index.
+auto init_shard_thread(cppcoro::static_thread_pool &executor, uint32_t cpu, int core)
+    -> cppcoro::task<void> {
+  co_await executor.schedule();
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set) != 0) {
+    get_logger()->warn("typed_server: failed to pin core shard {} to cpu {}", core, cpu);
+  }
+  detail::tls_core_id = core;
+}
+
+auto open_device(TypedRpcConfig const &config) -> std::shared_ptr<rdmapp::device> {
+  if (!config.enable_rdma) {
+    return nullptr;
+  }
+  try {
+    return std::make_shared<rdmapp::device>(config.device_nr, config.port_nr);
+  } catch (const std::exception &e) {
+    if (!config.enable_shm && !config.enable_tcp) {
+      throw;
+    }
+    get_logger()->warn("typed_server: no usable RDMA device ({}), serving without RDMA",
+                       e.what());
+    return nullptr;
+  }
+}
+
+// Flushes every posted work request of `qp` with an error, which ends its basic_server.
+auto fail_qp(rdmapp::qp &qp) noexcept -> void {
+  ibv_qp_attr attr{};
+  attr.qp_state = IBV_QPS_ERR;
+  if (int rc = ::ibv_modify_qp(qp.qp_, &attr, IBV_QP_STATE); rc != 0) [[unlikely]] {
+    get_logger()->error("typed_server: cannot move a qp to the error state: {}",
+                        std::strerror(rc));
+  }
+}
+
+} // namespace
+
+typed_server::core_shard::core_shard(uint32_t id, std::shared_ptr<rdmapp::pd> pd,
+                                     ConnConfig const &conn, MemoryConfig const &memory,
+                                     PriorityConfig const &priority)
+    : id(id)
+    , executor(std::make_shared<cppcoro::static_thread_pool>(1))
+    , scheduler(priority.enabled ? std::make_shared<priority_scheduler>(executor, priority)
+                                 : nullptr)
+    , cqs(pd, conn)
+    , arena(registered_arena::create(pd, memory)) {}
+
 typed_server::typed_server(cppcoro::io_service &io_service, uint16_t port, TypedRpcConfig config,
                            std::uint32_t thread_count)
     : config_(config)
     , thread_count_(thread_count)
-    , device_(std::make_shared<rdmapp::device>(config.device_nr, config.port_nr))
-    , pd_(std::make_shared<rdmapp::pd>(device_))
+    , device_(open_device(config))
+    , pd_(device_ ? std::make_shared<rdmapp::pd>(device_) : nullptr)
     , io_service_(io_service)
-    , acceptor_(io_service_, port, pd_, nullptr, config.to_conn_config())
-    , mux_() {}
+    , acceptor_(pd_ ? std::make_unique<qp_acceptor>(io_service_, port, pd_, nullptr,
+                                                    config.to_conn_config())
+                    : nullptr)
+    , mux_()
+    , admission_(std::make_shared<admission_control>(config_.admission)) {
+  if (!config_.enable_rdma && !config_.enable_shm && !config_.enable_tcp) [[unlikely]] {
+    throw std::invalid_argument("typed_server: no transport enabled");
+  }
+  register_handler_impl<&detail::region_lookup>(
+      [this](detail::RegionLookupReq const &req) { return lookup_region(req); });
+  // Holds nothing until a client sends at-most-once calls.
+  mux_.set_replay(std::make_shared<replay_cache>(config_.at_most_once));
+
+  if (config_.enable_shm) {
+    shm_listener_ = std::make_unique<shm::listener>(port, config_.shm_ring_size);
+  }
+  if (config_.enable_tcp) {
+    try {
+      tcp_listener_ = std::make_unique<tcp::listener>(config_.tcp_port_for(port));
+    } catch (const std::exception &e) {
+      // TCP is a fallback; only fatal when nothing else can serve.
+      if (!pd_ && !shm_listener_) {
+        throw;
+      }
+      get_logger()->warn("typed_server: cannot listen for TCP clients ({}), serving without TCP",
+                         e.what());
+    }
+  }
+  if (shm_listener_ || tcp_listener_) {
+    msg_executor_ = std::make_shared<cppcoro::static_thread_pool>(thread_count_);
+    if (config_.priority.enabled) {
+      msg_scheduler_ = std::make_shared<priority_scheduler>(msg_executor_, config_.priority);
+    }
+  }
+  if (!pd_) {
+    return;
+  }
+
+  auto memory = nic_local_memory_config(config_);
+  if (memory.chunk_size == 0) {
+    memory.chunk_size = config_.shared_chunk_size;
+  }
+  arena_ = registered_arena::create(pd_, memory);
+
+  if (config_.num_cores > 0) {
+    // One CQ pair per shard, grown only if a shard outgrows qps_per_cq connections.
+    auto conn = config_.to_conn_config();
+    conn.cq_policy = cq_sharing::per_n_qps;
+    for (uint32_t i = 0; i < config_.num_cores; ++i) {
+      auto &shard = shards_.emplace_back(
+          std::make_unique<core_shard>(i, pd_, conn, memory, config_.priority));
+      cppcoro::sync_wait(
+          init_shard_thread(*shard->executor, config_.first_cpu + i, static_cast<int>(i)));
+    }
+    get_logger()->info("typed_server: shared-nothing mode with {} core shards", shards_.size());
+  }
+}
+
+auto typed_server::publish(std::string name, std::size_t capacity)
+    -> std::shared_ptr<published_region> {
+  if (!pd_) [[unlikely]] {
+    throw std::runtime_error("typed_server: publishing regions needs the RDMA transport");
+  }
+  auto region = std::make_shared<published_region>(*pd_, capacity);
+  std::lock_guard lock(regions_mutex_);
+  auto [it, inserted] = regions_.try_emplace(std::move(name), region);
+  if (!inserted) [[unlikely]] {
+    throw std::runtime_error("typed_server: region already published under this name");
+  }
+  get_logger()->info("typed_server: published region {} of {} bytes", it->first, capacity);
+  return region;
+}
+
+auto typed_server::lookup_region(detail::RegionLookupReq const &req) -> detail::RegionLookupResp {
+  std::lock_guard lock(regions_mutex_);
+  auto it = regions_.find(req.name);
+  if (it == regions_.end()) {
+    return detail::RegionLookupResp{.found = false, .addr = 0, .length = 0, .rkey = 0};
+  }
+  auto desc = it->second->descriptor();
+  return detail::RegionLookupResp{
+      .found = true, .addr = desc.addr, .length = desc.length, .rkey = desc.rkey};
+}
 
 auto typed_server::run() -> cppcoro::task<void> {
+  // Started here rather than in the constructor so no client is served before every handler is
+  // registered.
+  if (shm_listener_) {
+    msg_acceptors_.emplace_back([this] {
+      accept_messages(transport_kind::shm, "shared-memory",
+                      [this] { return shm_listener_->accept(); });
+    });
+  }
+  if (tcp_listener_) {
+    msg_acceptors_.emplace_back([this] {
+      accept_messages(transport_kind::tcp, "TCP", [this] { return tcp_listener_->accept(); });
+    });
+  }
+  if (!acceptor_) {
+    // No RDMA: the other transports serve their connections on their own threads.
+    co_await msg_closed_;
+    co_return;
+  }
   cppcoro::async_scope scope;
   while (true) {
-    auto qp = co_await acceptor_.accept();
-    get_logger()->info("typed_server: accepted connection");
-    scope.spawn(handle_connection(std::move(qp)));
+    core_shard *shard = shards_.empty() ? nullptr : &pick_shard();
+    std::shared_ptr<rdmapp::qp> qp;
+    try {
+      qp = shard ? co_await acceptor_->accept(shard->cqs) : co_await acceptor_->accept();
+    } catch (const std::exception &) {
+      // Closing the acceptor is how stop() ends this loop.
+      if (!stopping_.load(std::memory_order_acquire)) {
+        throw;
+      }
+    }
+    if (!qp) {
+      break;
+    }
+    track(qp);
+    if (shard) {
+      get_logger()->info("typed_server: accepted connection on core shard {}", shard->id);
+      scope.spawn(handle_connection(std::move(qp), *shard));
+    } else {
+      get_logger()->info("typed_server: accepted connection");
+      scope.spawn(handle_connection(std::move(qp)));
+    }
   }
   co_await scope.join();
+  get_logger()->info("typed_server: stopped");
 }
 
-typed_server::~typed_server() { acceptor_.close(); }
+auto typed_server::stop() -> void {
+  if (stopping_.exchange(true, std::memory_order_acq_rel)) {
+    return;
+  }
+  if (acceptor_) {
+    acceptor_->close();
+  }
+  if (shm_listener_) {
+    shm_listener_->close();
+  }
+  if (tcp_listener_) {
+    tcp_listener_->close();
+  }
+  {
+    std::lock_guard lock(rdma_mutex_);
+    for (auto const &weak : rdma_qps_) {
+      if (auto qp = weak.lock()) {
+        fail_qp(*qp);
+      }
+    }
+  }
+  std::lock_guard lock(msg_mutex_);
+  for (auto &conn : msg_connections_) {
+    conn.thread.request_stop();
+  }
+}
+
+auto typed_server::track(std::shared_ptr<rdmapp::qp> const &qp) -> void {
+  std::lock_guard lock(rdma_mutex_);
+  if (stopping_.load(std::memory_order_acquire)) {
+    fail_qp(*qp);
+    return;
+  }
+  std::erase_if(rdma_qps_, [](auto const &weak) { return weak.expired(); });
+  rdma_qps_.push_back(qp);
+}
+
+typed_server::~typed_server() { stop(); }
+
+auto typed_server::accept_messages(transport_kind kind, std::string_view transport,
+                                   std::function<std::unique_ptr<message_channel>()> accept)
+    -> void {
+  try {
+    while (auto ch = accept()) {
+      get_logger()->info("typed_server: accepted {} connection", transport);
+      // A connection that cannot be served is dropped; the listener carries on.
+      try {
+        std::lock_guard lock(msg_mutex_);
+        // Reap finished connections, and any whose thread failed to start.
+        msg_connections_.remove_if([](msg_connection const &conn) {
+          return conn.done.load(std::memory_order_acquire) || !conn.thread.joinable();
+        });
+        auto &conn = msg_connections_.emplace_back();
+        conn.thread = std::jthread([this, kind, &conn, ch = std::move(ch)](
+                                       std::stop_token stop) mutable {
+          rpc_session session(next_session_.fetch_add(1, std::memory_order_relaxed), kind);
+          open_session(session);
+          message_server(std::move(ch), mux_, config_, msg_executor_, admission_, msg_scheduler_,
+                         &session)
+              .run(stop);
+          close_session(session);
+          conn.done.store(true, std::memory_order_release);
+        });
+      } catch (const std::exception &e) {
+        get_logger()->error("typed_server: cannot serve {} connection: {}", transport, e.what());
+      }
+    }
+  } catch (const std::exception &e) {
+    get_logger()->error("typed_server: {} listener failed: {}", transport, e.what());
+  }
+  msg_closed_.set();
+}
+
+auto typed_server::open_session(rpc_session &session) noexcept -> void {
+  if (!session_open_) {
+    return;
+  }
+  try {
+    session_open_(session);
+  } catch (const std::exception &e) {
+    get_logger()->error("typed_server: session {} open hook failed: {}", session.id(), e.what());
+  }
+}
+
+auto typed_server::close_session(rpc_session &session) noexcept -> void {
+  if (!session_close_) {
+    return;
+  }
+  try {
+    session_close_(session);
+  } catch (const std::exception &e) {
+    get_logger()->error("typed_server: session {} close hook failed: {}", session.id(),
+                        e.what());
+  }
+}
 
 auto typed_server::handle_connection(std::shared_ptr<rdmapp::qp> qp) -> cppcoro::task<void> {
-  basic_server server(qp, mux_, config_, thread_count_);
+  rpc_session session(next_session_.fetch_add(1, std::memory_order_relaxed), transport_kind::rdma);
+  basic_server server(qp, mux_, config_, thread_count_, arena_, admission_, &session);
+  open_session(session);
+  try {
+    co_await server.run();
+  } catch (const std::exception &e) {
+    get_logger()->warn("typed_server: connection closed with error: {}", e.what());
+  }
+  close_session(session);
+}
+
+auto typed_server::pick_shard() -> core_shard & {
+  return **std::ranges::min_element(shards_, {}, [](auto const &shard) {
+    return shard->connections.load(std::memory_order_relaxed);
+  });
+}
+
+auto typed_server::handle_connection(std::shared_ptr<rdmapp::qp> qp, core_shard &shard)
+    -> cppcoro::task<void> {
+  shard.connections.fetch_add(1, std::memory_order_relaxed);
+  rpc_session session(next_session_.fetch_add(1, std::memory_order_relaxed), transport_kind::rdma);
+  basic_server server(qp, mux_, config_, shard.executor, shard.arena, admission_,
+                      shard.scheduler, &session);
+  open_session(session);
   try {
     co_await server.run();
   } catch (const std::exception &e) {
     get_logger()->warn("typed_server: connection closed with error: {}", e.what());
   }
+  close_session(session);
+  shard.connections.fetch_sub(1, std::memory_order_relaxed);
 }
 
 } // namespace coverbs_rpc
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <string>
 
 namespace coverbs_rpc::benchmark {
@@ -7,6 +8,8 @@ namespace coverbs_rpc::benchmark {
 constexpr int kNumCalls = 200000;
 constexpr int kThreads = 4;
 constexpr int kReportInterval = 10000;
+// Calling-thread counts for the scaling sweep.
+constexpr std::array kScalingThreads = {1, 2, 4, 8, 16, 32};
 
 struct BenchmarkRequest {
   std::string data;
@@ -2,9 +2,12 @@
 #include "coverbs_rpc/utils/spin_wait.hpp"
 
 #include <cassert>
+#include <chrono>
+#include <cppcoro/single_consumer_event.hpp>
 #include <cppcoro/sync_wait.hpp>
 #include <cppcoro/task.hpp>
 #include <string>
+#include <thread>
 
 using namespace coverbs_rpc::utils;
 using coverbs_rpc::detail::get_logger;
@@ -17,6 +20,11 @@ cppcoro::task<std::string> test_string(std::string s) { co_return s; }
 
 cppcoro::task<int &> test_ref(int &val) { co_return val; }
 
+cppcoro::task<int> test_slow(cppcoro::single_consumer_event &event) {
+  co_await event;
+  co_return 7;
+}
+
 cppcoro::task<void> test_exception() {
   throw std::runtime_error("test exception");
   co_return;
@@ -56,6 +64,20 @@ int main() {
     get_logger()->info("test_exception passed: {}", e.what());
   }
 
+  // Test parking: the result arrives long after the spin and yield phases are over
+  auto before = spin_wait_stats();
+  cppcoro::single_consumer_event event;
+  std::jthread setter([&event] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    event.set();
+  });
+  int slow = spin_wait(test_slow(event));
+  assert(slow == 7);
+  auto after = spin_wait_stats();
+  assert(after.parked == before.parked + 1);
+  get_logger()->info("test_parked passed: immediate={} spun={} yielded={} parked={}",
+                     after.immediate, after.spun, after.yielded, after.parked);
+
   get_logger()->info("All spin_wait tests passed!");
 
   return 0;
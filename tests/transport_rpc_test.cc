@@ -0,0 +1,333 @@
+#include "coverbs_rpc/detail/logger.hpp"
+#include "coverbs_rpc/replicated_client.hpp"
+#include "coverbs_rpc/sharded_client.hpp"
+#include "coverbs_rpc/typed_client.hpp"
+#include "coverbs_rpc/typed_server.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cppcoro/io_service.hpp>
+#include <cppcoro/sync_wait.hpp>
+#include <cppcoro/task.hpp>
+#include <cppcoro/when_all.hpp>
+#include <csignal>
+#include <stdexcept>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// RPC over the shared-memory and TCP transports only: no RDMA device is opened on either side,
+// so this runs on machines without one. The server runs in a forked child process.
+
+namespace coverbs_rpc {
+using detail::get_logger;
+}
+
+struct EchoReq {
+  std::string msg;
+};
+
+struct EchoResp {
+  std::string msg;
+};
+
+auto echo(const EchoReq &req) -> EchoResp { return EchoResp{.msg = "Echo: " + req.msg}; }
+
+// Outlives the budget the deadline test gives it, and is limited to one call at a time.
+auto slow_echo(const EchoReq &req) -> EchoResp {
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  return echo(req);
+}
+
+auto shout(const EchoReq &req) -> EchoResp { return EchoResp{.msg = "Shout: " + req.msg}; }
+
+// Counts the calls made over its connection in the session's state.
+auto count_calls(const EchoReq &, coverbs_rpc::rpc_session &session) -> EchoResp {
+  return EchoResp{.msg = std::to_string(++*session.state<int>())};
+}
+
+// Numbers its runs, so a cached response shows as a repeated number.
+auto numbered(const EchoReq &req) -> EchoResp {
+  static std::atomic<int> runs{0};
+  return EchoResp{.msg = req.msg + " #" + std::to_string(++runs)};
+}
+
+// Not idempotent, and slow enough to outlive the budget the at-most-once test gives it.
+auto slow_increment(const EchoReq &) -> EchoResp {
+  static std::atomic<int> value{0};
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  return EchoResp{.msg = std::to_string(++value)};
+}
+
+// Data-plane work that holds a handler thread for a while; the priority test floods with it.
+auto busy_normal(const EchoReq &req) -> EchoResp {
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  return echo(req);
+}
+
+auto busy_low(const EchoReq &req) -> EchoResp {
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  return echo(req);
+}
+
+// Control-plane call that must not queue behind the flood.
+auto ping(const EchoReq &req) -> EchoResp { return echo(req); }
+
+auto reject(const EchoReq &req) -> EchoResp { throw std::runtime_error("rejected: " + req.msg); }
+
+auto echo_key(const EchoReq &req) -> std::string_view { return req.msg; }
+
+using echo_service = coverbs_rpc::service<&echo, &shout>;
+
+auto run_server(cppcoro::io_service &io_service, uint16_t port,
+                coverbs_rpc::TypedRpcConfig config) -> cppcoro::task<void> {
+  coverbs_rpc::typed_server server(io_service, port, config);
+  server.serve<echo_service>();
+  server.register_handler<slow_echo>();
+  server.register_handler<count_calls>();
+  server.register_handler<numbered>();
+  server.register_handler<slow_increment>();
+  server.register_handler<reject>();
+  server.register_handler<busy_normal>();
+  server.register_handler<busy_low>();
+  server.register_handler<ping>();
+  server.prioritize<busy_low>(coverbs_rpc::rpc_priority::low);
+  server.prioritize<ping>(coverbs_rpc::rpc_priority::high);
+  server.cache<numbered>({.ttl = std::chrono::seconds(10), .version = nullptr});
+  server.on_session_open([](coverbs_rpc::rpc_session &session) { session.emplace_state<int>(0); });
+  server.limit<slow_echo>(1);
+  co_await server.run();
+}
+
+auto run_client(cppcoro::io_service &io_service, uint16_t port, coverbs_rpc::TypedRpcConfig config,
+                coverbs_rpc::transport_kind expected) -> cppcoro::task<void> {
+  // The server may still be starting up.
+  std::unique_ptr<coverbs_rpc::typed_client> client;
+  for (int attempt = 0; !client; ++attempt) {
+    try {
+      client = std::make_unique<coverbs_rpc::typed_client>(io_service, "127.0.0.1", port, config);
+    } catch (const std::exception &) {
+      if (attempt == 100) {
+        throw;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+  }
+  if (client->transport() != expected) {
+    coverbs_rpc::get_logger()->error("Transport Test Failed: connected over the wrong transport");
+    std::terminate();
+  }
+
+  EchoReq req{.msg = "Hello Message Channels!"};
+  auto resp = co_await client->call<echo>(req);
+  if (resp.msg != "Echo: " + req.msg) {
+    coverbs_rpc::get_logger()->error("Echo Test Failed: {}", resp.msg);
+    std::terminate();
+  }
+  coverbs_rpc::get_logger()->info("Echo Test Passed!");
+
+  // A throwing handler fails its call and leaves the connection serving.
+  bool failed = false;
+  try {
+    co_await client->call<reject>(req);
+  } catch (const coverbs_rpc::remote_error &) {
+    failed = true;
+  }
+  if (!failed || (co_await client->call<echo>(req)).msg != "Echo: " + req.msg) {
+    coverbs_rpc::get_logger()->error("Handler Failure Test Failed!");
+    std::terminate();
+  }
+  coverbs_rpc::get_logger()->info("Handler Failure Test Passed!");
+
+  // Larger than max_resp_payload, so the handler's response goes through large_resp.
+  EchoReq large_req{.msg = std::string(512 * 1024, 'x')};
+  auto large_resp = co_await client->call<echo>(large_req);
+  if (large_resp.msg != "Echo: " + large_req.msg) {
+    coverbs_rpc::get_logger()->error("Large Payload Test Failed!");
+    std::terminate();
+  }
+  coverbs_rpc::get_logger()->info("Large Payload Test Passed!");
+
+  // Through the service stub: dispatched by method index, and still by fn_id for plain calls.
+  auto stub = client->stub<echo_service>();
+  if ((co_await stub.call<&shout>(req)).msg != "Shout: " + req.msg ||
+      (co_await stub.call<&echo>(req)).msg != "Echo: " + req.msg ||
+      (co_await client->call<shout>(req)).msg != "Shout: " + req.msg) {
+    coverbs_rpc::get_logger()->error("Service Test Failed!");
+    std::terminate();
+  }
+  coverbs_rpc::get_logger()->info("Service Test Passed!");
+
+  if ((co_await client->call<count_calls>(req)).msg != "1" ||
+      (co_await client->call<count_calls>(req)).msg != "2") {
+    coverbs_rpc::get_logger()->error("Session Test Failed!");
+    std::terminate();
+  }
+  coverbs_rpc::get_logger()->info("Session Test Passed!");
+
+  // The repeat is served from the cache rather than numbered anew.
+  auto first = co_await client->call<numbered>(req);
+  auto repeat = co_await client->call<numbered>(req);
+  if (repeat.msg != first.msg) {
+    coverbs_rpc::get_logger()->error("Cache Test Failed: {} / {}", first.msg, repeat.msg);
+    std::terminate();
+  }
+  coverbs_rpc::get_logger()->info("Cache Test Passed!");
+
+  auto budgeted_config = config;
+  budgeted_config.deadline = std::chrono::milliseconds(5);
+  coverbs_rpc::typed_client budgeted(io_service, "127.0.0.1", port, budgeted_config);
+  bool dropped = false;
+  try {
+    co_await budgeted.call<slow_echo>(req);
+  } catch (const coverbs_rpc::deadline_exceeded &) {
+    dropped = true;
+  }
+  if (!dropped || (co_await budgeted.call<echo>(req)).msg != "Echo: " + req.msg) {
+    coverbs_rpc::get_logger()->error("Deadline Test Failed!");
+    std::terminate();
+  }
+  coverbs_rpc::get_logger()->info("Deadline Test Passed!");
+
+  // The first attempt runs but expires; its retry is answered with the recorded reply instead
+  // of incrementing again, and would otherwise expire too.
+  auto once_config = config;
+  once_config.deadline = std::chrono::milliseconds(5);
+  once_config.at_most_once = {.enabled = true, .retries = 1};
+  coverbs_rpc::typed_client once(io_service, "127.0.0.1", port, once_config);
+  auto before = std::stoi((co_await once.call<slow_increment>(req)).msg);
+  auto after = std::stoi((co_await once.call<slow_increment>(req)).msg);
+  if (after != before + 1) {
+    coverbs_rpc::get_logger()->error("At-most-once Test Failed: {} then {}", before, after);
+    std::terminate();
+  }
+  coverbs_rpc::get_logger()->info("At-most-once Test Passed!");
+
+  // Two replicas that are the same server, hedging every call slower than the median.
+  coverbs_rpc::replicated_client replicated(
+      io_service, {{"127.0.0.1", port}, {"127.0.0.1", port}}, config,
+      {.enabled = true,
+       .percentile = 0.5,
+       .min_delay = std::chrono::microseconds(1),
+       .window = 64});
+  for (int i = 0; i < 256; ++i) {
+    if ((co_await replicated.call<echo>(req)).msg != "Echo: " + req.msg) {
+      coverbs_rpc::get_logger()->error("Replicated Test Failed!");
+      std::terminate();
+    }
+  }
+  if (replicated.latency(0).count() == 0 || replicated.latency(1).count() == 0) {
+    coverbs_rpc::get_logger()->error("Replicated Test Failed: a replica was never picked");
+    std::terminate();
+  }
+  coverbs_rpc::get_logger()->info("Replicated Test Passed: {} calls hedged", replicated.hedged());
+
+  // A ring of one shard, then rebalanced onto the same server under another name.
+  coverbs_rpc::sharded_client sharded(io_service, {{"127.0.0.1", port}}, config);
+  auto sharded_resp = co_await sharded.call<echo, &echo_key>(req);
+  sharded.set_members({{"127.0.0.1", port}, {"localhost", port}});
+  auto keyed_resp = co_await sharded.call_key<echo>(uint64_t{42}, req);
+  if (sharded_resp.msg != "Echo: " + req.msg || keyed_resp.msg != sharded_resp.msg ||
+      sharded.members().size() != 2) {
+    coverbs_rpc::get_logger()->error("Sharded Test Failed!");
+    std::terminate();
+  }
+  coverbs_rpc::get_logger()->info("Sharded Test Passed: key routed to {}",
+                                  sharded.owner(echo_key(req)).hostname);
+
+  // Two at once against a limit of one: the second is shed.
+  int shed = 0;
+  auto guarded_call = [&]() -> cppcoro::task<void> {
+    try {
+      co_await client->call<slow_echo>(req);
+    } catch (const coverbs_rpc::server_overloaded &) {
+      ++shed;
+    }
+  };
+  co_await cppcoro::when_all(guarded_call(), guarded_call());
+  if (shed != 1) {
+    coverbs_rpc::get_logger()->error("Admission Test Failed: {} calls shed", shed);
+    std::terminate();
+  }
+  coverbs_rpc::get_logger()->info("Admission Test Passed!");
+
+  // A high-priority call issued behind a flood of normal and low ones starts on the reserved
+  // thread instead of waiting for the flood to drain.
+  constexpr int kFlood = 32;
+  auto flood_call = [&](bool low) -> cppcoro::task<void> {
+    if (low) {
+      co_await client->call<busy_low>(req);
+    } else {
+      co_await client->call<busy_normal>(req);
+    }
+  };
+  std::vector<cppcoro::task<void>> flood;
+  for (int i = 0; i < kFlood; ++i) {
+    flood.push_back(flood_call(false));
+    flood.push_back(flood_call(true));
+  }
+  std::chrono::steady_clock::duration high_latency{};
+  auto probe = [&]() -> cppcoro::task<void> {
+    // Let the flood queue up first.
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    auto const sent = std::chrono::steady_clock::now();
+    co_await client->call<ping>(req);
+    high_latency = std::chrono::steady_clock::now() - sent;
+  };
+  auto const flood_start = std::chrono::steady_clock::now();
+  co_await cppcoro::when_all(cppcoro::when_all(std::move(flood)), probe());
+  auto const flood_elapsed = std::chrono::steady_clock::now() - flood_start;
+  if (high_latency * 4 > flood_elapsed) {
+    coverbs_rpc::get_logger()->error(
+        "Priority Test Failed: high call took {} us behind a {} us flood",
+        std::chrono::duration_cast<std::chrono::microseconds>(high_latency).count(),
+        std::chrono::duration_cast<std::chrono::microseconds>(flood_elapsed).count());
+    std::terminate();
+  }
+  coverbs_rpc::get_logger()->info(
+      "Priority Test Passed: high call took {} us behind a {} us flood",
+      std::chrono::duration_cast<std::chrono::microseconds>(high_latency).count(),
+      std::chrono::duration_cast<std::chrono::microseconds>(flood_elapsed).count());
+
+  constexpr int kCalls = 100000;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kCalls; ++i) {
+    co_await client->call<echo>(req);
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  coverbs_rpc::get_logger()->info(
+      "Latency Test Passed: {} ns per call",
+      std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / kCalls);
+}
+
+auto main(int argc, char *argv[]) -> int {
+  uint16_t const port = argc > 1 ? std::stoi(argv[1]) : 23456;
+  coverbs_rpc::TypedRpcConfig config;
+  config.max_req_payload = 1024;
+  config.max_resp_payload = 1024;
+  config.enable_rdma = false;
+  config.enable_shm = true;
+  config.enable_tcp = true;
+  config.shm_ring_size = 2ul << 20;
+  config.priority.enabled = true;
+
+  pid_t server_pid = ::fork();
+  cppcoro::io_service io_service;
+  auto looper = std::jthread([&io_service]() { io_service.process_events(); });
+
+  if (server_pid == 0) {
+    cppcoro::sync_wait(run_server(io_service, port, config));
+    return 0;
+  }
+  cppcoro::sync_wait(run_client(io_service, port, config, coverbs_rpc::transport_kind::shm));
+  // Same host, but with shared memory off the client falls through to TCP.
+  config.enable_shm = false;
+  cppcoro::sync_wait(run_client(io_service, port, config, coverbs_rpc::transport_kind::tcp));
+
+  ::kill(server_pid, SIGTERM);
+  ::waitpid(server_pid, nullptr, 0);
+  io_service.stop();
+  return 0;
+}
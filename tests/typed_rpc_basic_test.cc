@@ -2,10 +2,18 @@
 #include "coverbs_rpc/typed_client.hpp"
 #include "coverbs_rpc/typed_server.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cppcoro/async_generator.hpp>
 #include <cppcoro/io_service.hpp>
+#include <cppcoro/single_consumer_event.hpp>
 #include <cppcoro/sync_wait.hpp>
 #include <cppcoro/task.hpp>
+#include <cppcoro/when_all.hpp>
+#include <string>
 #include <thread>
+#include <vector>
 
 namespace coverbs_rpc {
 using detail::get_logger;
@@ -21,11 +29,69 @@ struct EchoResp {
 
 auto echo(const EchoReq &req) -> EchoResp { return EchoResp{.msg = "Echo: " + req.msg}; }
 
+struct CountReq {
+  uint64_t n;
+};
+
+struct CountResp {
+  uint64_t total;
+};
+
+std::atomic<uint64_t> recorded_total{0};
+
+// One-way: returns nothing, so no reply is sent.
+auto record(const CountReq &req) -> void { recorded_total += req.n; }
+
+auto recorded(const CountReq &) -> CountResp { return CountResp{.total = recorded_total.load()}; }
+
+// Bulk: sums the client's buffer in place and overwrites its first n bytes with 0xab.
+auto sum_and_fill(const CountReq &req, coverbs_rpc::rpc_context &ctx) -> CountResp {
+  uint64_t sum = 0;
+  for (auto b : ctx.bulk_in) {
+    sum += static_cast<uint64_t>(b);
+  }
+  ctx.bulk_written = std::min<std::size_t>(req.n, ctx.bulk_out.size());
+  std::fill_n(ctx.bulk_out.begin(), ctx.bulk_written, std::byte{0xab});
+  return CountResp{.total = sum};
+}
+
+// A response of n bytes for a request of a few, so a coalesced call can get a large reply.
+auto repeat(const CountReq &req) -> EchoResp { return EchoResp{.msg = std::string(req.n, 'y')}; }
+
+// Set by shutdown_server; run_server then stops the server, leaving the client with a dead peer.
+cppcoro::single_consumer_event shutdown_requested;
+
+auto shutdown_server(const CountReq &) -> CountResp {
+  shutdown_requested.set();
+  return CountResp{.total = 0};
+}
+
+// Server-streaming: yields 0 .. n-1.
+auto count_up(const CountReq &req) -> cppcoro::async_generator<CountResp> {
+  for (uint64_t i = 0; i < req.n; ++i) {
+    co_yield CountResp{.total = i};
+  }
+}
+
 cppcoro::task<void> run_server(cppcoro::io_service &io_service, uint16_t port,
                                coverbs_rpc::TypedRpcConfig config) {
   coverbs_rpc::typed_server server(io_service, port, config);
   server.register_handler<echo>();
-  co_await server.run();
+  server.register_handler<record>();
+  server.register_handler<recorded>();
+  server.register_handler<count_up>();
+  server.register_handler<sum_and_fill>();
+  server.register_handler<repeat>();
+  server.register_handler<shutdown_server>();
+  auto greeting = server.publish("greeting", 256);
+  greeting->store(EchoResp{.msg = "Echo: Hello Typed RPC!"});
+  auto stop_on_request = [&]() -> cppcoro::task<void> {
+    co_await shutdown_requested;
+    // Leaves the reply to shutdown_server time to go out first.
+    co_await io_service.schedule_after(std::chrono::milliseconds(100));
+    server.stop();
+  };
+  co_await cppcoro::when_all(server.run(), stop_on_request());
 }
 
 cppcoro::task<void> run_client(cppcoro::io_service &io_service, std::string hostname, uint16_t port,
@@ -42,6 +108,164 @@ cppcoro::task<void> run_client(cppcoro::io_service &io_service, std::string host
     coverbs_rpc::get_logger()->error("Test Failed!");
     std::terminate();
   }
+
+  // Both directions exceed the 1 KiB slots and go through the rendezvous path.
+  EchoReq large_req{.msg = std::string(4 * 1024 * 1024, 'x')};
+  auto large_resp = co_await client.call<echo>(large_req);
+  coverbs_rpc::get_logger()->info("Received large response: {} bytes", large_resp.msg.size());
+
+  if (large_resp.msg == "Echo: " + large_req.msg) {
+    coverbs_rpc::get_logger()->info("Large Payload Test Passed!");
+  } else {
+    coverbs_rpc::get_logger()->error("Large Payload Test Failed!");
+    std::terminate();
+  }
+
+  // One-way calls are dispatched on the server's pool, so poll until all of them have landed.
+  constexpr uint64_t kOneWayCalls = 1000;
+  for (uint64_t i = 0; i < kOneWayCalls; ++i) {
+    co_await client.call<record>(CountReq{.n = 1});
+  }
+  uint64_t total = 0;
+  for (int attempt = 0; attempt < 1000 && total != kOneWayCalls; ++attempt) {
+    total = (co_await client.call<recorded>(CountReq{.n = 0})).total;
+    if (total != kOneWayCalls) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  if (total == kOneWayCalls) {
+    coverbs_rpc::get_logger()->info("One-way Test Passed!");
+  } else {
+    coverbs_rpc::get_logger()->error("One-way Test Failed: {} of {} recorded", total,
+                                     kOneWayCalls);
+    std::terminate();
+  }
+
+  // Far more items than the credit window, so the stream has to be flow-controlled.
+  constexpr uint64_t kStreamItems = 1000;
+  uint64_t expected = 0;
+  auto items = client.stream<count_up>(CountReq{.n = kStreamItems});
+  for (auto it = co_await items.begin(); it != items.end(); co_await ++it) {
+    if ((*it).total != expected) {
+      coverbs_rpc::get_logger()->error("Stream Test Failed: got {} expected {}", (*it).total,
+                                       expected);
+      std::terminate();
+    }
+    ++expected;
+  }
+  if (expected != kStreamItems) {
+    coverbs_rpc::get_logger()->error("Stream Test Failed: {} of {} items", expected, kStreamItems);
+    std::terminate();
+  }
+
+  // Stop early; the rest of the stream is cancelled and its slot reclaimed.
+  {
+    auto partial = client.stream<count_up>(CountReq{.n = kStreamItems});
+    auto it = co_await partial.begin();
+    for (int i = 0; i < 10 && it != partial.end(); ++i) {
+      co_await ++it;
+    }
+  }
+  auto after_cancel = co_await client.call<echo>(req);
+  if (after_cancel.msg != resp.msg) {
+    coverbs_rpc::get_logger()->error("Stream Cancel Test Failed!");
+    std::terminate();
+  }
+  coverbs_rpc::get_logger()->info("Stream Test Passed!");
+
+  // Served by a one-sided READ of the published region instead of the handler.
+  auto region = co_await client.open_region("greeting");
+  auto snapshot = co_await client.read_region<EchoResp>(region);
+  auto via_region = co_await client.read_snapshot_or_call<echo>(region, req);
+  if (snapshot && snapshot->msg == resp.msg && via_region.msg == resp.msg) {
+    coverbs_rpc::get_logger()->info("Region Read Test Passed!");
+  } else {
+    coverbs_rpc::get_logger()->error("Region Read Test Failed!");
+    std::terminate();
+  }
+
+  // 8 MiB of application memory, read and then written in place by the server.
+  std::vector<std::byte> blob(8 << 20, std::byte{1});
+  auto blob_mr = client.pd()->reg_mr(blob.data(), blob.size());
+  coverbs_rpc::bulk_region blob_region{.mr = &blob_mr,
+                                       .access = coverbs_rpc::bulk_access::read_write};
+  auto bulk = co_await client.call_bulk<sum_and_fill>(CountReq{.n = 4096}, blob_region);
+  bool filled = std::all_of(blob.begin(), blob.begin() + 4096,
+                            [](std::byte b) { return b == std::byte{0xab}; });
+  if (bulk.resp.total == blob.size() && bulk.bulk_len == 4096 && filled &&
+      blob[4096] == std::byte{1}) {
+    coverbs_rpc::get_logger()->info("Bulk Test Passed!");
+  } else {
+    coverbs_rpc::get_logger()->error("Bulk Test Failed!");
+    std::terminate();
+  }
+}
+
+// Runs last: its final step shuts the server down.
+cppcoro::task<void> run_coalesced_client(cppcoro::io_service &io_service, std::string hostname,
+                                         uint16_t port, coverbs_rpc::TypedRpcConfig config) {
+  config.coalesce = {.enabled = true,
+                     .max_records = 8,
+                     .max_delay = std::chrono::microseconds(200),
+                     .idle_delay = std::chrono::microseconds(50)};
+  coverbs_rpc::typed_client client(io_service, hostname, port, config);
+
+  // Issued together, so they share frames both ways; each reply must land in its own call.
+  constexpr int kCalls = 64;
+  std::vector<std::string> replies(kCalls);
+  auto numbered_call = [&](int i) -> cppcoro::task<void> {
+    replies[i] = (co_await client.call<echo>(EchoReq{.msg = std::to_string(i)})).msg;
+  };
+  // The large reply goes out on its own as a rendezvous, its request having been batched.
+  EchoResp large;
+  auto large_call = [&]() -> cppcoro::task<void> {
+    large = co_await client.call<repeat>(CountReq{.n = 64 * 1024});
+  };
+  std::vector<cppcoro::task<void>> calls;
+  for (int i = 0; i < kCalls; ++i) {
+    calls.push_back(numbered_call(i));
+  }
+  calls.push_back(large_call());
+  co_await cppcoro::when_all(std::move(calls));
+  for (int i = 0; i < kCalls; ++i) {
+    if (replies[i] != "Echo: " + std::to_string(i)) {
+      coverbs_rpc::get_logger()->error("Coalesced Test Failed: call {} got {}", i, replies[i]);
+      std::terminate();
+    }
+  }
+  if (large.msg != std::string(64 * 1024, 'y')) {
+    coverbs_rpc::get_logger()->error("Coalesced Rendezvous Test Failed!");
+    std::terminate();
+  }
+  coverbs_rpc::get_logger()->info("Coalesced Test Passed!");
+
+  // With the server gone, a batch's send fails; every call in it must fail with transport_error
+  // rather than hang or return an empty reply.
+  co_await client.call<shutdown_server>(CountReq{.n = 0});
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  // Failed calls complete on whichever thread saw the failure.
+  std::atomic<int> failed{0};
+  auto doomed_call = [&](int i) -> cppcoro::task<void> {
+    try {
+      co_await client.call<echo>(EchoReq{.msg = std::to_string(i)});
+    } catch (const coverbs_rpc::transport_error &) {
+      ++failed;
+    } catch (const std::exception &e) {
+      coverbs_rpc::get_logger()->error("Coalesced Send Failure Test: call {} threw {}", i,
+                                       e.what());
+    }
+  };
+  std::vector<cppcoro::task<void>> doomed;
+  for (int i = 0; i < 8; ++i) {
+    doomed.push_back(doomed_call(i));
+  }
+  co_await cppcoro::when_all(std::move(doomed));
+  if (failed.load() != 8) {
+    coverbs_rpc::get_logger()->error("Coalesced Send Failure Test Failed: {} of 8 failed",
+                                     failed.load());
+    std::terminate();
+  }
+  coverbs_rpc::get_logger()->info("Coalesced Send Failure Test Passed!");
 }
 
 auto main(int argc, char *argv[]) -> int {
@@ -56,6 +280,7 @@ auto main(int argc, char *argv[]) -> int {
     cppcoro::sync_wait(run_server(io_service, std::stoi(argv[1]), config));
   } else if (argc == 3) {
     cppcoro::sync_wait(run_client(io_service, argv[1], std::stoi(argv[2]), config));
+    cppcoro::sync_wait(run_coalesced_client(io_service, argv[1], std::stoi(argv[2]), config));
   } else {
     coverbs_rpc::get_logger()->info(
         "Usage: {} [port] for server and {} [server_ip] [port] for client", argv[0], argv[0]);
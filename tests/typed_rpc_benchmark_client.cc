@@ -45,6 +45,7 @@ void run_bench(typed_client &client, int threads_count, const std::string &label
   // Warmup
   work(100);
 
+  auto start = std::chrono::high_resolution_clock::now();
   if (threads_count == 1) {
     work(benchmark::kNumCalls);
   } else {
@@ -53,6 +54,11 @@ void run_bench(typed_client &client, int threads_count, const std::string &label
       threads.emplace_back(work, benchmark::kNumCalls / threads_count, t);
     }
   }
+  auto elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::high_resolution_clock::now() - start)
+                        .count();
+  get_logger()->info("Case {} ({} threads): Throughput = {:.2f} Kops/s", label, threads_count,
+                     benchmark::kNumCalls * 1000.0 / (double)elapsed_us);
 }
 
 int main(int argc, char **argv) {
@@ -83,6 +89,19 @@ int main(int argc, char **argv) {
     // Case 2: 256B req, 4KB resp
     run_bench<1>(client, 1, "2 (256B/4KB)");
     run_bench<1>(client, benchmark::kThreads, "2 (256B/4KB)");
+
+    // Case 3: 256B req, 256B resp, scaling the number of calling threads
+    for (int threads : benchmark::kScalingThreads) {
+      run_bench<0>(client, threads, "3 (256B/256B scaling)");
+    }
+
+    // Case 4: as case 3, over a connection that coalesces concurrent calls into shared frames
+    TypedRpcConfig coalesced_config = config;
+    coalesced_config.coalesce.enabled = true;
+    typed_client coalesced(io_service, server_ip, server_port, coalesced_config);
+    for (int threads : benchmark::kScalingThreads) {
+      run_bench<0>(coalesced, threads, "4 (256B/256B coalesced)");
+    }
     get_logger()->info("Done.");
   } catch (const std::exception &e) {
     get_logger()->error("Exception: {}", e.what());
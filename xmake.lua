@@ -29,6 +29,8 @@ target("coverbs-rpc")
     add_packages("spdlog", {private=true})
     add_packages("concurrentqueue", {private=true})
     add_files("src/conn/*.cc")
+    add_files("src/shm/*.cc")
+    add_files("src/tcp/*.cc")
     add_files("src/*.cc")
 
 if has_config("tests") then
@@ -72,6 +74,10 @@ if has_config("tests") then
         add_files("tests/typed_rpc_basic_test.cc")
         add_rules("test_config")
 
+    target("transport_rpc_test")
+        add_files("tests/transport_rpc_test.cc")
+        add_rules("test_config")
+
     target("typed_rpc_mux_test_server")
         add_files("tests/typed_rpc_mux_test_server.cc")
         add_rules("test_config")